@@ -2,266 +2,92 @@
 #include <sections/data.h>
 #include <helpers/numeric.h>
 #include <helpers/memory.h>
+#include <helpers/cpu.h>
 
 #include <stddef.h> // offsetof
 #include <string.h> // memcpy
+#include <pthread.h>
+
+#if defined(CPU_AVX2_KERNELS) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 static struct instruction_representation
 instructions_defaults[n_known_instructions] = {
 	[inst_add_immediate] = {
 		.mnemonic_id = inst_add_immediate,
-		.args = {
-			[0] = {
-				.type = arg_register,
-				.value = r0
-			},
-			[1] = {
-				.type = arg_register,
-				.value = r0
-			},
-			[2] = {
-				.type = arg_immediate,
-				.value = 0
-			}
-		}
+		.types  = {arg_register, arg_register, arg_immediate},
+		.values = {r0, r0, 0}
 	},
 	[inst_b_address] = {
 		.mnemonic_id = inst_b_address,
-		.args = {
-			[0] = {
-				.type = arg_condition,
-				.value = cond_al
-			},
-			[1] = {
-				.type = arg_frame_address_pc_relative,
-				.value = 0
-			},
-			[2] = {
-				.type = arg_invalid,
-				.value = 0
-			}
-		}
+		.types  = {arg_condition, arg_frame_address_pc_relative, arg_invalid},
+		.values = {cond_al, 0, 0}
 	},
 	[inst_bl_address] = {
 		.mnemonic_id = inst_bl_address,
-		.args = {
-			[0] = {
-				.type = arg_condition,
-				.value = cond_al
-			},
-			[1] = {
-				.type = arg_frame_address_pc_relative,
-				.value = 0
-			},
-			[2] = {
-				.type = arg_invalid,
-				.value = 0
-			}
-		}
+		.types  = {arg_condition, arg_frame_address_pc_relative, arg_invalid},
+		.values = {cond_al, 0, 0}
 	},
 	[inst_blx_address] = {
 		.mnemonic_id = inst_blx_address,
-		.args = {
-			[0] = {
-				.type = arg_condition,
-				.value = cond_al
-			},
-			[1] = {
-				.type = arg_frame_address_pc_relative,
-				.value = 0
-			},
-			[2] = {
-				.type = arg_invalid,
-				.value = 0
-			}
-		}
+		.types  = {arg_condition, arg_frame_address_pc_relative, arg_invalid},
+		.values = {cond_al, 0, 0}
 	},
 	[inst_blx_register] = {
 		.mnemonic_id = inst_blx_register,
-		.args = {
-			[0] = {
-				.type = arg_condition,
-				.value = cond_al
-			},
-			[1] = {
-				.type = arg_register,
-				.value = reg_lr
-			},
-			[2] = {
-				.type = arg_invalid,
-				.value = 0
-			}
-		}
+		.types  = {arg_condition, arg_register, arg_invalid},
+		.values = {cond_al, reg_lr, 0}
 	},
 	[inst_bx_register] = {
 		.mnemonic_id = inst_bx_register,
-		.args = {
-			[0] = {
-				.type = arg_condition,
-				.value = cond_al
-			},
-			[1] = {
-				.type = arg_register,
-				.value = reg_lr
-			},
-			[2] = {
-				.type = arg_invalid,
-				.value = 0
-			}
-		}
+		.types  = {arg_condition, arg_register, arg_invalid},
+		.values = {cond_al, reg_lr, 0}
 	},
 	[inst_mov_immediate] = {
 		.mnemonic_id = inst_mov_immediate,
-		.args = {
-			[0] = {
-				.type = arg_register,
-				.value = r0
-			},
-			[1] = {
-				.type = arg_immediate,
-				.value = 0
-			},
-			[2] = {
-				.type = arg_invalid,
-				.value = 0
-			}
-		}
+		.types  = {arg_register, arg_immediate, arg_invalid},
+		.values = {r0, 0, 0}
 	},
 	[inst_mov_register] = {
 		.mnemonic_id = inst_mov_register,
-		.args = {
-			[0] = {
-				.type = arg_register,
-				.value = r4
-			},
-			[1] = {
-				.type = arg_register,
-				.value = r0
-			},
-			[2] = {
-				.type = arg_invalid,
-				.value = 0
-			}
-		}
+		.types  = {arg_register, arg_register, arg_invalid},
+		.values = {r4, r0, 0}
 	},
 	[inst_movt_immediate] = {
 		.mnemonic_id = inst_movt_immediate,
-		.args = {
-			[0] = {
-				.type = arg_register,
-				.value = r0
-			},
-			[1] = {
-				.type = arg_data_symbol_address_top16,
-				.value = 0
-			},
-			[2] = {
-				.type = arg_invalid,
-				.value = 0
-			}
-		}
+		.types  = {arg_register, arg_data_symbol_address_top16, arg_invalid},
+		.values = {r0, 0, 0}
 	},
 	[inst_movw_immediate] = {
 		.mnemonic_id = inst_movw_immediate,
-		.args = {
-			[0] = {
-				.type = arg_register,
-				.value = r0
-			},
-			[1] = {
-				.type = arg_data_symbol_address_bottom16,
-				.value = 0
-			},
-			[2] = {
-				.type = arg_invalid,
-				.value = 0
-			}
-		}
+		.types  = {arg_register, arg_data_symbol_address_bottom16, arg_invalid},
+		.values = {r0, 0, 0}
 	},
 	[inst_mvn_immediate] = {
 		.mnemonic_id = inst_mvn_immediate,
-		.args = {
-			[0] = {
-				.type = arg_register,
-				.value = r0
-			},
-			[1] = {
-				.type = arg_immediate,
-				.value = 1
-			},
-			[2] = {
-				.type = arg_invalid,
-				.value = 0
-			}
-		}
+		.types  = {arg_register, arg_immediate, arg_invalid},
+		.values = {r0, 1, 0}
 	},
 	[inst_pop_regmask] = {
 		.mnemonic_id = inst_pop_regmask,
-		.args = {
-			[0] = {
-				.type = arg_regmask,
-				.value = 0b1000000011110000
-			},
-			[1] = {
-				.type = arg_invalid,
-				.value = 0
-			},
-			[2] = {
-				.type = arg_invalid,
-				.value = 0
-			}
-		}
+		.types  = {arg_regmask, arg_invalid, arg_invalid},
+		.values = {0b1000000011110000, 0, 0}
 	},
 	[inst_push_regmask] = {
 		.mnemonic_id = inst_push_regmask,
-		.args = {
-			[0] = {
-				.type = arg_regmask,
-				.value = 0b0100000011110000
-			},
-			[1] = {
-				.type = arg_invalid,
-				.value = 0
-			},
-			[2] = {
-				.type = arg_invalid,
-				.value = 0
-			}
-		}
+		.types  = {arg_regmask, arg_invalid, arg_invalid},
+		.values = {0b0100000011110000, 0, 0}
 	},
 	[inst_sub_immediate] = {
 		.mnemonic_id = inst_sub_immediate,
-		.args = {
-			[0] = {
-				.type = arg_register,
-				.value = r0,
-			},
-			[1] = {
-				.type = arg_register,
-				.value = r0,
-			},
-			[2] = {
-				.type = arg_immediate,
-				.value = 0
-			}
-		}
+		.types  = {arg_register, arg_register, arg_immediate},
+		.values = {r0, r0, 0}
 	},
 	[inst_svc_immediate] = {
 		.mnemonic_id = inst_svc_immediate,
-		.args = {
-			[0] = {
-				.type = arg_immediate,
-				.value = 0,
-			},
-			[1] = {
-				.type = arg_invalid,
-				.value = 0
-			},
-			[2] = {
-				.type = arg_invalid,
-				.value = 0
-			}
-		}
+		.types  = {arg_immediate, arg_invalid, arg_invalid},
+		.values = {0, 0, 0}
 	}
 };
 
@@ -466,59 +292,88 @@ uint32_t op_svc_immediate(immediate value)
 	return cond | fixed_part | imm24;
 }
 
-struct args_values { unsigned int val0, val1, val2; };
+/* Not found when the argument refers to a data symbol that the section
+ * doesn't hold, like a deleted one. Its value is then 0. */
+static struct uint32_result get_value
+(struct data_section const * __restrict const symbols,
+ struct armv7_text_section const * __restrict const text_section,
+ uint8_t const type,
+ int32_t const set_value,
+ unsigned int const pc)
+{
+	uint32_t value = 0;
+	unsigned int found = 1;
+	switch(type) {
+		case arg_data_symbol_address:
+		case arg_data_symbol_address_top16:
+		case arg_data_symbol_address_bottom16:
+		case arg_data_symbol_size:
+			found = (symbols != NULL &&
+				data_section_has_symbol(symbols, set_value));
+			if (!found) goto unknown_symbol;
+			break;
+		default:
+			break;
+	}
+
+	switch(type) {
+		case arg_invalid:
+			value = 0;
+			break;
+		case arg_condition:
+			value = clamp_condition(set_value);
+			break;
+		case arg_register:
+			value = clamp_standard_register(set_value);
+			break;
+		case arg_immediate:
+		case arg_address:
+			value = set_value;
+			break;
+		case arg_data_symbol_address:
+			value = data_address(symbols, set_value);
+			break;
+		case arg_data_symbol_address_top16:
+			value = data_address_upper16(symbols, set_value);
+			break;
+		case arg_data_symbol_address_bottom16:
+			value = data_address_lower16(symbols, set_value);
+			break;
+		case arg_data_symbol_size:
+			value = data_size(symbols, set_value);
+			break;
+		case arg_frame_address:
+			value = text_section_frame_address(text_section, set_value);
+			break;
+		case arg_frame_address_pc_relative: {
+				uint32_t address = 
+					text_section_frame_address(text_section, set_value);
+				// We currently only support ARM mode.
+				value = address - pc - 8;
+			}
+			break;
+		case arg_regmask:
+			value = set_value;
+			break;
+	}
+
+unknown_symbol:
+	return (struct uint32_result) {.found = found, .value = value};
+}
 
 struct args_values get_values
 (struct data_section const * __restrict const symbols,
  struct armv7_text_section const * __restrict const text_section,
- struct instruction_args_infos const * __restrict const args,
+ struct instruction_representation const * __restrict const instruction,
  unsigned int const pc)
 {
 	
 	uint32_t values[MAX_ARGS];
-	for (unsigned int a = 0; a < MAX_ARGS; a++) {
-		uint32_t set_value = args[a].value;
-		switch(args[a].type) {
-			case arg_invalid:
-				values[a] = 0;
-				break;
-			case arg_condition:
-				values[a] = clamp_condition(set_value);
-				break;
-			case arg_register:
-				values[a] = clamp_standard_register(set_value);
-				break;
-			case arg_immediate:
-			case arg_address:
-				values[a] = set_value;
-				break;
-			case arg_data_symbol_address:
-				values[a] = data_address(symbols, set_value);
-				break;
-			case arg_data_symbol_address_top16:
-				values[a] = data_address_upper16(symbols, set_value);
-				break;
-			case arg_data_symbol_address_bottom16:
-				values[a] = data_address_lower16(symbols, set_value);
-				break;
-			case arg_data_symbol_size:
-				values[a] = data_size(symbols, set_value);
-				break;
-			case arg_frame_address:
-				values[a] = text_section_frame_address(text_section, set_value);
-				break;
-			case arg_frame_address_pc_relative: {
-					uint32_t address = 
-						text_section_frame_address(text_section, set_value);
-					// We currently only support ARM mode.
-					values[a] = address - pc - 8;
-				}
-				break;
-			case arg_regmask:
-				values[a] = set_value;
-				break;
-		}
-	}
+	for (unsigned int a = 0; a < MAX_ARGS; a++)
+		values[a] = get_value(
+			symbols, text_section,
+			instruction->types[a], instruction->values[a], pc
+		).value;
 	
 	struct args_values vals = {
 		.val0 = values[0],
@@ -547,6 +402,342 @@ uint32_t (*op_functions[n_known_instructions])() = {
 	[inst_svc_immediate] = op_svc_immediate
 };
 
+#define ARMV7_FIELD(arg_index, value_mask, right, left) \
+	{ .arg = arg_index, .mask = value_mask, \
+	  .right_shift = right, .left_shift = left }
+#define ARMV7_COND_FIELD(arg_index) ARMV7_FIELD(arg_index, 0xf, 0, 28)
+
+struct armv7_encoding const armv7_encodings[n_known_instructions] = {
+	[inst_add_immediate] = {
+		.fixed = 0xe2800000, .negative_flip = 0x00c00000,
+		.is_signed = 1, .signed_arg = 2, .negate = 1,
+		.fields = {
+			ARMV7_FIELD(1, 0xffff, 0, 16),
+			ARMV7_FIELD(0, 0xfffff, 0, 12),
+			ARMV7_FIELD(2, 0xfff, 0, 0)
+		}
+	},
+	[inst_b_address] = {
+		.fixed = 0x0a000000,
+		.fields = {
+			ARMV7_COND_FIELD(0),
+			ARMV7_FIELD(1, 0xffffff, 2, 0)
+		}
+	},
+	[inst_bl_address] = {
+		.fixed = 0x0b000000,
+		.fields = {
+			ARMV7_COND_FIELD(0),
+			ARMV7_FIELD(1, 0xffffff, 2, 0)
+		}
+	},
+	/* op_blx_address takes the address as its first value */
+	[inst_blx_address] = {
+		.fixed = 0xfa000000,
+		.fields = {
+			ARMV7_FIELD(0, 0x1000000, 0, 0),
+			ARMV7_FIELD(0, 0x7fffff, 2, 0)
+		}
+	},
+	[inst_blx_register] = {
+		.fixed = 0x012fff30,
+		.fields = {
+			ARMV7_COND_FIELD(0),
+			ARMV7_FIELD(1, 0xf, 0, 0)
+		}
+	},
+	[inst_bx_register] = {
+		.fixed = 0x012fff10,
+		.fields = {
+			ARMV7_COND_FIELD(0),
+			ARMV7_FIELD(1, 0xf, 0, 0)
+		}
+	},
+	[inst_mov_immediate] = {
+		.fixed = 0xe3a00000, .negative_flip = 0x00400000,
+		.is_signed = 1, .signed_arg = 1, .negate = 0,
+		.fields = {
+			ARMV7_FIELD(0, 0xfffff, 0, 12),
+			ARMV7_FIELD(1, 0xfff, 0, 0)
+		}
+	},
+	[inst_mov_register] = {
+		.fixed = 0xe1a00000,
+		.fields = {
+			ARMV7_FIELD(0, 0xfffff, 0, 12),
+			ARMV7_FIELD(1, 0xffffffff, 0, 0)
+		}
+	},
+	[inst_movt_immediate] = {
+		.fixed = 0xe3400000,
+		.fields = {
+			ARMV7_FIELD(0, 0xf, 0, 12),
+			ARMV7_FIELD(1, 0xf000, 0, 16),
+			ARMV7_FIELD(1, 0xfff, 0, 0)
+		}
+	},
+	[inst_movw_immediate] = {
+		.fixed = 0xe3000000,
+		.fields = {
+			ARMV7_FIELD(0, 0xf, 0, 12),
+			ARMV7_FIELD(1, 0xf000, 0, 16),
+			ARMV7_FIELD(1, 0xfff, 0, 0)
+		}
+	},
+	[inst_mvn_immediate] = {
+		.fixed = 0xe3e00000, .negative_flip = 0x00400000,
+		.is_signed = 1, .signed_arg = 1, .negate = 0,
+		.fields = {
+			ARMV7_FIELD(0, 0xfffff, 0, 12),
+			ARMV7_FIELD(1, 0xfff, 0, 0)
+		}
+	},
+	[inst_pop_regmask] = {
+		.fixed = 0x08bd0000,
+		.fields = {
+			ARMV7_COND_FIELD(0),
+			ARMV7_FIELD(1, 0xffff, 0, 0)
+		}
+	},
+	[inst_push_regmask] = {
+		.fixed = 0x092d0000,
+		.fields = {
+			ARMV7_COND_FIELD(0),
+			ARMV7_FIELD(1, 0xffff, 0, 0)
+		}
+	},
+	[inst_sub_immediate] = {
+		.fixed = 0xe2400000, .negative_flip = 0x00c00000,
+		.is_signed = 1, .signed_arg = 2, .negate = 1,
+		.fields = {
+			ARMV7_FIELD(1, 0xffff, 0, 16),
+			ARMV7_FIELD(0, 0xfffff, 0, 12),
+			ARMV7_FIELD(2, 0xfff, 0, 0)
+		}
+	},
+	[inst_svc_immediate] = {
+		.fixed = 0xef000000,
+		.fields = {
+			ARMV7_FIELD(0, 0xffffff, 0, 0)
+		}
+	}
+};
+
+uint32_t armv7_encode_values
+(enum known_instructions const mnemonic_id,
+ uint32_t const * __restrict const values)
+{
+	struct armv7_encoding const * __restrict const encoding =
+		armv7_encodings + mnemonic_id;
+	uint32_t args[MAX_ARGS] = {values[0], values[1], values[2]};
+
+	uint32_t const negative =
+		(args[encoding->signed_arg] >> 31) & encoding->is_signed;
+	args[encoding->signed_arg] =
+		(args[encoding->signed_arg] ^ -negative) + (negative & encoding->negate);
+
+	uint32_t code = encoding->fixed ^ (encoding->negative_flip & -negative);
+	for (unsigned int f = 0; f < ARMV7_ENCODING_FIELDS; f++) {
+		struct armv7_encoding_field const field = encoding->fields[f];
+		code |= ((args[field.arg] >> field.right_shift) & field.mask)
+			<< field.left_shift;
+	}
+	return code;
+}
+
+/* The mask applied to the arguments values that are used as-is.
+ * The others are resolved through get_value. */
+static uint32_t const arguments_masks[arg_regmask+1] = {
+	[arg_invalid]   = 0,
+	[arg_condition] = 0xf,
+	[arg_register]  = 0xf,
+	[arg_immediate] = 0xffffffff,
+	[arg_address]   = 0xffffffff,
+	[arg_regmask]   = 0xffffffff
+};
+static uint8_t const arguments_resolved[arg_regmask+1] = {
+	[arg_data_symbol_address]         = 1,
+	[arg_data_symbol_address_top16]   = 1,
+	[arg_data_symbol_address_bottom16] = 1,
+	[arg_data_symbol_size]            = 1,
+	[arg_frame_address]               = 1,
+	[arg_frame_address_pc_relative]   = 1
+};
+
+static inline struct uint32_result resolve_arg
+(struct data_section const * __restrict const data_section,
+ struct armv7_text_section const * __restrict const text_section,
+ struct instruction_representation const * __restrict const instruction,
+ unsigned int const a,
+ uint32_t const pc)
+{
+	uint8_t const type = instruction->types[a];
+	struct uint32_result value = {
+		.found = 1,
+		.value = instruction->values[a] & arguments_masks[type]
+	};
+	if (arguments_resolved[type])
+		value = get_value(
+			data_section, text_section, type, instruction->values[a], pc
+		);
+	return value;
+}
+
+struct uint32_result armv7_encode_instruction_resolved
+(struct data_section const * __restrict const data_section,
+ struct armv7_text_section const * __restrict const text_section,
+ struct instruction_representation const * __restrict const instruction,
+ uint32_t const pc)
+{
+	uint32_t values[MAX_ARGS];
+	unsigned int found = 1;
+	for (unsigned int a = 0; a < MAX_ARGS; a++) {
+		struct uint32_result const value = resolve_arg(
+			data_section, text_section, instruction, a, pc
+		);
+		values[a] = value.value;
+		found &= value.found;
+	}
+	return (struct uint32_result) {
+		.found = found,
+		.value = armv7_encode_values(instruction->mnemonic_id, values)
+	};
+}
+
+uint32_t armv7_encode_instruction
+(struct data_section const * __restrict const data_section,
+ struct armv7_text_section const * __restrict const text_section,
+ struct instruction_representation const * __restrict const instruction,
+ uint32_t const pc)
+{
+	return armv7_encode_instruction_resolved(
+		data_section, text_section, instruction, pc
+	).value;
+}
+
+#if defined(CPU_AVX2_KERNELS)
+
+static inline CPU_TARGET_AVX2 void encode_block_avx2
+(struct armv7_encoding const * __restrict const encoding,
+ uint32_t const * __restrict const * __restrict const values,
+ uint32_t const index,
+ uint32_t * __restrict const output)
+{
+	__m256i args[MAX_ARGS];
+	for (unsigned int a = 0; a < MAX_ARGS; a++)
+		args[a] = _mm256_loadu_si256((__m256i const *) (values[a]+index));
+
+	__m256i const is_signed = _mm256_set1_epi32(-encoding->is_signed);
+	__m256i const signed_value = args[encoding->signed_arg];
+	__m256i const negative =
+		_mm256_and_si256(_mm256_srai_epi32(signed_value, 31), is_signed);
+	args[encoding->signed_arg] = _mm256_add_epi32(
+		_mm256_xor_si256(signed_value, negative),
+		_mm256_and_si256(negative, _mm256_set1_epi32(encoding->negate))
+	);
+
+	__m256i code = _mm256_xor_si256(
+		_mm256_set1_epi32(encoding->fixed),
+		_mm256_and_si256(negative, _mm256_set1_epi32(encoding->negative_flip))
+	);
+	for (unsigned int f = 0; f < ARMV7_ENCODING_FIELDS; f++) {
+		struct armv7_encoding_field const field = encoding->fields[f];
+		__m256i const value = _mm256_and_si256(
+			_mm256_srl_epi32(
+				args[field.arg], _mm_cvtsi32_si128(field.right_shift)
+			),
+			_mm256_set1_epi32(field.mask)
+		);
+		code = _mm256_or_si256(
+			code, _mm256_sll_epi32(value, _mm_cvtsi32_si128(field.left_shift))
+		);
+	}
+	_mm256_storeu_si256((__m256i *) (output+index), code);
+}
+
+/* Returns the number of values encoded, by blocks of 8 */
+static CPU_TARGET_AVX2 uint32_t encode_blocks_avx2
+(struct armv7_encoding const * __restrict const encoding,
+ uint32_t const * __restrict const * __restrict const values,
+ uint32_t const n,
+ uint32_t * __restrict const output)
+{
+	uint32_t i = 0;
+	for (; i + 8 <= n; i += 8)
+		encode_block_avx2(encoding, values, i, output);
+	return i;
+}
+
+#endif
+
+#if defined(__SSE2__)
+
+static inline void encode_block_sse2
+(struct armv7_encoding const * __restrict const encoding,
+ uint32_t const * __restrict const * __restrict const values,
+ uint32_t const index,
+ uint32_t * __restrict const output)
+{
+	__m128i args[MAX_ARGS];
+	for (unsigned int a = 0; a < MAX_ARGS; a++)
+		args[a] = _mm_loadu_si128((__m128i const *) (values[a]+index));
+
+	__m128i const is_signed = _mm_set1_epi32(-encoding->is_signed);
+	__m128i const signed_value = args[encoding->signed_arg];
+	__m128i const negative =
+		_mm_and_si128(_mm_srai_epi32(signed_value, 31), is_signed);
+	args[encoding->signed_arg] = _mm_add_epi32(
+		_mm_xor_si128(signed_value, negative),
+		_mm_and_si128(negative, _mm_set1_epi32(encoding->negate))
+	);
+
+	__m128i code = _mm_xor_si128(
+		_mm_set1_epi32(encoding->fixed),
+		_mm_and_si128(negative, _mm_set1_epi32(encoding->negative_flip))
+	);
+	for (unsigned int f = 0; f < ARMV7_ENCODING_FIELDS; f++) {
+		struct armv7_encoding_field const field = encoding->fields[f];
+		__m128i const value = _mm_and_si128(
+			_mm_srl_epi32(args[field.arg], _mm_cvtsi32_si128(field.right_shift)),
+			_mm_set1_epi32(field.mask)
+		);
+		code = _mm_or_si128(
+			code, _mm_sll_epi32(value, _mm_cvtsi32_si128(field.left_shift))
+		);
+	}
+	_mm_storeu_si128((__m128i *) (output+index), code);
+}
+
+#endif
+
+void armv7_encode_values_batch
+(enum known_instructions const mnemonic_id,
+ uint32_t const * __restrict const * __restrict const values,
+ uint32_t const n,
+ uint32_t * __restrict const output)
+{
+	uint32_t i = 0;
+
+#if defined(CPU_AVX2_KERNELS) || defined(__SSE2__)
+	struct armv7_encoding const * __restrict const encoding =
+		armv7_encodings + mnemonic_id;
+#endif
+#if defined(CPU_AVX2_KERNELS)
+	if (cpu_supports_avx2())
+		i = encode_blocks_avx2(encoding, values, n, output);
+#endif
+#if defined(__SSE2__)
+	for (; i + 4 <= n; i += 4)
+		encode_block_sse2(encoding, values, i, output);
+#endif
+
+	for (; i < n; i++) {
+		uint32_t const instruction_values[MAX_ARGS] =
+			{values[0][i], values[1][i], values[2][i]};
+		output[i] = armv7_encode_values(mnemonic_id, instruction_values);
+	}
+}
+
 uint32_t assemble_code
 (struct data_section const * __restrict const data_infos,
  struct instructions const * __restrict const instructions,
@@ -556,11 +747,8 @@ uint32_t assemble_code
 	struct instruction_representation * __restrict const internal_insts =
 		instructions->converted;
 	for (unsigned int i = 0; i < n_instructions; i++) {
-		struct args_values values = 
-			get_values(data_infos, NULL, internal_insts[i].args, 0);
-		result_code[i] = op_functions[internal_insts[i].mnemonic_id](
-			values.val0, values.val1, values.val2
-		);
+		result_code[i] =
+			armv7_encode_instruction(data_infos, NULL, internal_insts+i, 0);
 	}
 	return n_instructions * sizeof(uint32_t);
 }
@@ -573,9 +761,9 @@ uint32_t add_instruction
 	uint32_t new_index = instructions->n;
 	instructions->n++;
 	instructions->converted[new_index].mnemonic_id = id;
-	instructions->converted[new_index].args[0].value = val0;
-	instructions->converted[new_index].args[1].value = val1;
-	instructions->converted[new_index].args[2].value = val2;
+	instructions->converted[new_index].values[0] = val0;
+	instructions->converted[new_index].values[1] = val1;
+	instructions->converted[new_index].values[2] = val2;
 	return new_index;
 }
 
@@ -585,16 +773,78 @@ uint32_t instructions_size
 	return instructions->n * 4;
 }
 
-struct armv7_text_frame * generate_armv7_text_frame
-(uint32_t (*id_generator)())
+/* ARMV7_FRAMES_POOL_CLASSES for arrays outside the pool */
+static unsigned int frames_pool_class_of
+(struct armv7_frames_pool const * __restrict const pool,
+ uint32_t const n_instructions)
+{
+	unsigned int size_class = ARMV7_FRAMES_POOL_CLASSES;
+	if (pool == NULL || n_instructions > ARMV7_FRAMES_POOL_MAX_INSTRUCTIONS)
+		goto not_pooled;
+
+	size_class = 0;
+	uint32_t class_instructions = ARMV7_FRAMES_POOL_MIN_INSTRUCTIONS;
+	while (class_instructions < n_instructions) {
+		class_instructions *= 2;
+		size_class++;
+	}
+
+not_pooled:
+	return size_class;
+}
+
+/* Pooled arrays are chained in the free lists through their first
+ * bytes */
+static struct instruction_representation * frame_allocate_instructions
+(struct armv7_frames_pool * __restrict const pool,
+ uint32_t const n_instructions)
+{
+	unsigned int const size_class =
+		frames_pool_class_of(pool, n_instructions);
+	uint32_t const size =
+		n_instructions * sizeof(struct instruction_representation);
+	struct instruction_representation * __restrict instructions;
+
+	if (size_class == ARMV7_FRAMES_POOL_CLASSES)
+		instructions = allocate_durable_memory(size);
+	else if (pool->free_arrays[size_class] != NULL) {
+		instructions = pool->free_arrays[size_class];
+		pool->free_arrays[size_class] =
+			*((struct instruction_representation **) instructions);
+	}
+	else instructions = slabs_allocate(&pool->slabs, size);
+
+	return instructions;
+}
+
+static void frame_release_instructions
+(struct armv7_frames_pool * __restrict const pool,
+ struct instruction_representation * __restrict const instructions,
+ uint32_t const n_instructions)
+{
+	unsigned int const size_class =
+		frames_pool_class_of(pool, n_instructions);
+
+	if (size_class == ARMV7_FRAMES_POOL_CLASSES)
+		free_durable_memory(instructions);
+	else {
+		*((struct instruction_representation **) instructions) =
+			pool->free_arrays[size_class];
+		pool->free_arrays[size_class] = instructions;
+	}
+}
+
+static struct armv7_text_frame * frame_generate
+(struct armv7_frames_pool * __restrict const pool,
+ uint32_t (*id_generator)(),
+ uint32_t const n_instructions)
 {
 	struct armv7_text_frame * __restrict text_frame = NULL;
 
-	unsigned int const n_instructions_default = 128;
 	unsigned int const instructions_array_size =
-		n_instructions_default * sizeof(struct instruction_representation);
+		n_instructions * sizeof(struct instruction_representation);
 	struct instruction_representation * instructions =
-		allocate_durable_memory(instructions_array_size);
+		frame_allocate_instructions(pool, n_instructions);
 		
 	if (instructions == NULL) goto cant_allocate_instructions_array;
 	
@@ -603,153 +853,781 @@ struct armv7_text_frame * generate_armv7_text_frame
 			.id = id_generator(),
 			.base_address = 0,
 			.stored_instructions = 0,
-			.max_instructions = n_instructions_default
+			.max_instructions = n_instructions
 		},
-		.instructions = instructions
+		.instructions = instructions,
+		.chunks = NULL,
+		.first_chunk = n_instructions,
+		.references = NULL,
+		.section = NULL,
+		.live_since = 0,
+		.versions = NULL,
+		.kept_chunks = 0,
+		.pool = pool,
+		.code = {0}
 	};
 	
-	text_frame = allocate_durable_memory(sizeof(struct armv7_text_frame));
+	text_frame = (pool == NULL) ?
+		allocate_durable_memory(sizeof(struct armv7_text_frame)) :
+		slabs_allocate(&pool->slabs, sizeof(struct armv7_text_frame));
 	
 	if (text_frame != NULL) {
 		memcpy(text_frame, &frame_data, sizeof(struct armv7_text_frame));
 		memset(instructions, 0, instructions_array_size);
 	}
-	else free_durable_memory(instructions);
+	else frame_release_instructions(pool, instructions, n_instructions);
 
 cant_allocate_instructions_array:
 	return text_frame;
 }
 
-static unsigned int need_more_space_for_instructions_in
-(struct armv7_text_frame * __restrict const frame)
+struct armv7_text_frame * generate_armv7_text_frame
+(uint32_t (*id_generator)())
 {
-	return (frame->metadata.stored_instructions ==
-	        frame->metadata.max_instructions);
+	unsigned int const n_instructions_default = 128;
+	return frame_generate(NULL, id_generator, n_instructions_default);
 }
 
-static unsigned int allocate_more_space_for_instructions_in
-(struct armv7_text_frame * __restrict const frame)
+struct armv7_frames_pool * generate_armv7_frames_pool()
 {
+	uint32_t const n_frames_default = 64;
+	uint32_t const slab_size = 64 * 1024;
+	struct armv7_frames_pool * __restrict pool = NULL;
 
-	unsigned int current_instructions_space =
-		frame->metadata.max_instructions *
-		sizeof(struct instruction_representation);
-	unsigned int new_instructions_space =
-		current_instructions_space * 2;
-	unsigned int delta = 
-		new_instructions_space - current_instructions_space;
-	
-	struct instruction_representation * __restrict const new_addr =
-		reallocate_durable_memory(
-			frame->instructions, new_instructions_space
+	struct armv7_text_frame ** __restrict const frames =
+		allocate_durable_memory(
+			n_frames_default * sizeof(struct armv7_text_frame *)
 		);
-	
-	unsigned int allocated = (new_addr != NULL);
-	
-	if (allocated) {
-		memset(new_addr+current_instructions_space, 0, delta);
-		frame->instructions = new_addr;
-	}
-	
-	return allocated;
+	if (frames == NULL) goto cant_allocate_frames;
+
+	pool = allocate_durable_memory(sizeof(struct armv7_frames_pool));
+	if (pool == NULL) goto cant_allocate_pool;
+
+	slabs_init(&pool->slabs, slab_size);
+	for (unsigned int c = 0; c < ARMV7_FRAMES_POOL_CLASSES; c++)
+		pool->free_arrays[c] = NULL;
+	pool->frames     = frames;
+	pool->n_frames   = 0;
+	pool->max_frames = n_frames_default;
+	goto pool_generated;
+
+cant_allocate_pool:
+	free_durable_memory(frames);
+pool_generated:
+cant_allocate_frames:
+	return pool;
 }
 
-struct armv7_add_instruction_status frame_add_instruction
-(struct armv7_text_frame * __restrict const frame)
+struct armv7_text_frame * generate_pooled_armv7_text_frame
+(struct armv7_frames_pool * __restrict const pool,
+ uint32_t (*id_generator)(),
+ uint32_t const expected_instructions)
 {
-	struct armv7_add_instruction_status status = {
-		.added = 0,
-		.address = NULL
-	};
+	struct armv7_text_frame * __restrict frame = NULL;
 
-	if (need_more_space_for_instructions_in(frame))
-		if (!allocate_more_space_for_instructions_in(frame))
-			goto no_more_space_for_instructions;
+	/* Frames are listed first, since slabs memory cannot be given back */
+	if (pool->n_frames == pool->max_frames) {
+		uint32_t const new_max = pool->max_frames * 2;
+		struct armv7_text_frame ** __restrict const new_frames =
+			reallocate_durable_memory(
+				pool->frames, new_max * sizeof(struct armv7_text_frame *)
+			);
+		if (new_frames == NULL) goto cant_list_frame;
+		pool->frames     = new_frames;
+		pool->max_frames = new_max;
+	}
 
-	unsigned int new_index = frame->metadata.stored_instructions;
-	
-	struct instruction_representation * instruction_addr =
-		frame->instructions+new_index;
-	frame->metadata.stored_instructions += 1;
+	uint32_t n_instructions = ARMV7_FRAMES_POOL_MIN_INSTRUCTIONS;
+	while (n_instructions < expected_instructions) n_instructions *= 2;
 
-	status.added = 1;
-	status.address = instruction_addr;
+	frame = frame_generate(pool, id_generator, n_instructions);
+	if (frame != NULL) {
+		pool->frames[pool->n_frames] = frame;
+		pool->n_frames += 1;
+	}
 
-no_more_space_for_instructions:
-	return status;
+cant_list_frame:
+	return frame;
 }
 
-void instruction_mnemonic_id
-(struct instruction_representation * instruction,
- enum known_instructions mnemonic_id)
+static unsigned int frame_extra_chunks
+(struct armv7_text_frame const * __restrict const frame)
 {
-	if (instruction->mnemonic_id != mnemonic_id)
-		*instruction = instructions_defaults[mnemonic_id];
+	return __builtin_ctz(frame->metadata.max_instructions / frame->first_chunk);
+}
 
+/* Release every chunk of that frame state */
+static void frame_release_chunks
+(struct armv7_text_frame const * __restrict const frame)
+{
+	unsigned int const n_extra_chunks = frame_extra_chunks(frame);
+	frame_release_instructions(
+		frame->pool, frame->instructions, frame->first_chunk
+	);
+	for (unsigned int k = 0; k < n_extra_chunks; k++)
+		frame_release_instructions(
+			frame->pool, frame->chunks[k], frame->first_chunk << k
+		);
+	free_durable_memory(frame->chunks);
 }
 
-void instruction_arg
-(struct instruction_representation * const instruction,
- unsigned int const index,
- enum argument_type argument_type,
- uint32_t const value)
+/* Release the version, with the chunks it owns */
+static void frame_release_version
+(struct armv7_text_frame_version * __restrict const version)
 {
-	instruction->args[index].type = argument_type;
-	instruction->args[index].value = value;
+	struct armv7_text_frame const * __restrict const frame = &version->frame;
+	unsigned int const n_extra_chunks = frame_extra_chunks(frame);
+	uint32_t const owned = version->owned_chunks;
+	if (owned & 1)
+		frame_release_instructions(
+			frame->pool, frame->instructions, frame->first_chunk
+		);
+	for (unsigned int k = 0; k < n_extra_chunks; k++)
+		if (owned & (2u << k))
+			frame_release_instructions(
+				frame->pool, frame->chunks[k], frame->first_chunk << k
+			);
+	free_durable_memory(frame->chunks);
+	free_durable_memory(version);
 }
 
-unsigned int armv7_frame_gen_machine_code
-(struct armv7_text_frame const * __restrict const frame,
- struct armv7_text_section const * __restrict const section,
- struct data_section const * __restrict const data_infos,
- uint32_t * __restrict const result_code)
+/* Keep the current state of the frame for the snapshots showing it,
+ * before modifying it. Returns 0 if it cannot be kept.
+ * Only the metadata are copied. The kept state shares the chunks of
+ * the frame, until frame_keep_instruction_for_snapshots copies them.
+ * Snapshots reading the frame concurrently check live_since before and
+ * after reading the frame, so it is updated before anything else. */
+static unsigned int frame_keep_state_for_snapshots
+(struct armv7_text_frame * __restrict const frame)
 {
-	unsigned int n_instructions = frame->metadata.stored_instructions;
-	struct instruction_representation * __restrict const instructions =
-		frame->instructions;
-
-	for (unsigned int i = 0, pc = frame->metadata.base_address;
-	     i < n_instructions;
-	     i++, pc += 4) {
-		struct args_values values = 
-			get_values(data_infos, section, instructions[i].args, pc);
-		result_code[i] = op_functions[instructions[i].mnemonic_id](
-			values.val0, values.val1, values.val2
+	struct armv7_text_section const * __restrict const section =
+		frame->section;
+	unsigned int kept = 1;
+	if (section == NULL || section->snapshots == NULL) goto no_snapshots;
+	if (frame->live_since > section->snapshots->epoch) goto already_kept;
+
+	struct armv7_text_frame_version * __restrict const version =
+		allocate_durable_memory(sizeof(struct armv7_text_frame_version));
+	struct instruction_representation ** __restrict chunks = NULL;
+
+	kept = (version != NULL);
+	if (!kept) goto cant_keep_state;
+	/* The versions get their own chunks table, since their chunks are
+	 * replaced by copies */
+	if (frame->chunks != NULL) {
+		chunks = allocate_durable_memory(
+			ARMV7_FRAME_MAX_CHUNKS * sizeof(struct instruction_representation *)
+		);
+		kept = (chunks != NULL);
+		if (!kept) goto cant_keep_state;
+		memcpy(
+			chunks, frame->chunks,
+			frame_extra_chunks(frame) * sizeof(struct instruction_representation *)
 		);
 	}
-	return n_instructions * sizeof(uint32_t);
+
+	memcpy(&version->frame, frame, sizeof(struct armv7_text_frame));
+	version->frame.chunks = chunks;
+	version->frame.code.words = NULL;
+	version->frame.code.fixups = NULL;
+	version->frame.code.max_words = 0;
+	version->frame.code.max_fixups = 0;
+	version->frame.code.valid = 0;
+	version->frame.references = NULL;
+	version->frame.versions = NULL;
+	version->since = frame->live_since;
+	version->owned_chunks = 0;
+	version->older = frame->versions;
+
+	__atomic_store_n(&frame->versions, version, __ATOMIC_RELEASE);
+	__atomic_store_n(&frame->live_since, section->epoch, __ATOMIC_RELEASE);
+	/* The live frame is modified after this */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	goto kept_state;
+
+cant_keep_state:
+	free_durable_memory(version);
+kept_state:
+already_kept:
+no_snapshots:
+	return kept;
 }
 
-uint32_t text_section_frame_address
-(struct armv7_text_section const * __restrict const text_section,
- unsigned int const frame_id)
+/* The address of the pointer to the chunk c of the frame, counting the
+ * first chunk as 0 */
+static struct instruction_representation ** frame_chunk_slot
+(struct armv7_text_frame * __restrict const frame,
+ unsigned int const c)
 {
-	uint32_t address = 0;
-	
-	unsigned int n_frames = text_section->n_frames_refs;
-	struct armv7_text_frame const * const * __restrict const frames =
-		text_section->frames_refs;
-	
-	unsigned int f = 0;
-	while(frames[f]->metadata.id != frame_id && f < n_frames) f++;
-	
-	if (f < n_frames) address = frames[f]->metadata.base_address;
-	
-	return address;
+	return (c == 0) ? &frame->instructions : frame->chunks + c - 1;
 }
 
-static unsigned int expand_frame_space_of
+/* Keep the state of the frame for the snapshots showing it, before
+ * modifying the instruction stored at index. The chunk holding that
+ * instruction is copied for the versions still sharing it.
+ * Snapshots reading these versions concurrently check kept_chunks
+ * before and after reading them.
+ * Returns 0 if it cannot be kept. */
+static unsigned int frame_keep_instruction_for_snapshots
+(struct armv7_text_frame * __restrict const frame,
+ uint32_t const index)
+{
+	unsigned int kept = frame_keep_state_for_snapshots(frame);
+	struct armv7_text_frame_version * __restrict const newest =
+		frame->versions;
+	if (!kept || newest == NULL) goto not_shown;
+	/* The instructions only grow, so no version shows the instructions
+	 * added after the newest one */
+	if (index >= newest->frame.metadata.stored_instructions) goto not_shown;
+
+	uint32_t const first_chunk = frame->first_chunk;
+	unsigned int c = 0;
+	uint32_t n_instructions = first_chunk;
+	if (index >= first_chunk) {
+		unsigned int const k =
+			31 - __builtin_clz(index >> __builtin_ctz(first_chunk));
+		c = k + 1;
+		n_instructions = first_chunk << k;
+	}
+	struct instruction_representation * __restrict const live_chunk =
+		*frame_chunk_slot(frame, c);
+	if (*frame_chunk_slot(&newest->frame, c) != live_chunk)
+		goto already_kept;
+
+	struct instruction_representation * __restrict const copy =
+		frame_allocate_instructions(frame->pool, n_instructions);
+	kept = (copy != NULL);
+	if (!kept) goto cant_copy_chunk;
+	memcpy(
+		copy, live_chunk,
+		n_instructions * sizeof(struct instruction_representation)
+	);
+
+	/* The older versions sharing the chunk are the ones right after
+	 * the newest. Smaller versions don't have that chunk. */
+	for (struct armv7_text_frame_version * __restrict version = newest;
+	     version != NULL && c <= frame_extra_chunks(&version->frame);
+	     version = version->older) {
+		struct instruction_representation ** __restrict const slot =
+			frame_chunk_slot(&version->frame, c);
+		if (*slot != live_chunk) break;
+		__atomic_store_n(slot, copy, __ATOMIC_RELAXED);
+	}
+	newest->owned_chunks |= 1u << c;
+
+	__atomic_add_fetch(&frame->kept_chunks, 1, __ATOMIC_RELEASE);
+	/* The live chunk is modified after this */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+cant_copy_chunk:
+already_kept:
+not_shown:
+	return kept;
+}
+
+static unsigned int need_more_space_for_instructions_in
+(struct armv7_text_frame * __restrict const frame)
+{
+	return (frame->metadata.stored_instructions ==
+	        frame->metadata.max_instructions);
+}
+
+/* Add a chunk as big as the previous ones together */
+static unsigned int allocate_more_space_for_instructions_in
+(struct armv7_text_frame * __restrict const frame)
+{
+	uint32_t const max_instructions = frame->metadata.max_instructions;
+	unsigned int const k = frame_extra_chunks(frame);
+	unsigned int allocated = 0;
+	if (k == ARMV7_FRAME_MAX_CHUNKS) goto too_many_chunks;
+
+	if (frame->chunks == NULL) {
+		frame->chunks = allocate_durable_memory(
+			ARMV7_FRAME_MAX_CHUNKS * sizeof(struct instruction_representation *)
+		);
+		if (frame->chunks == NULL) goto cant_allocate_chunk;
+	}
+
+	struct instruction_representation * __restrict const chunk =
+		frame_allocate_instructions(frame->pool, max_instructions);
+	allocated = (chunk != NULL);
+	if (!allocated) goto cant_allocate_chunk;
+
+	memset(chunk, 0, max_instructions * sizeof(struct instruction_representation));
+	frame->chunks[k] = chunk;
+	frame->metadata.max_instructions = max_instructions * 2;
+
+cant_allocate_chunk:
+too_many_chunks:
+	return allocated;
+}
+
+/* Where the frame is stored in the section. Frames sharing their ID
+ * with a previous frame are searched.
+ * n_frames_refs if the section doesn't hold it. */
+static uint32_t text_section_frame_index
+(struct armv7_text_section const * __restrict const section,
+ struct armv7_text_frame const * __restrict const frame)
+{
+	uint32_t const n_frames = section->n_frames_refs;
+	uint32_t f = 0;
+	if (id_index_ready(&section->frames_index)) {
+		struct id_index_result const indexed =
+			id_index_get(&section->frames_index, frame->metadata.id);
+		if (indexed.found) f = indexed.index;
+	}
+	if (f >= n_frames || section->frames_refs[f] != frame) {
+		f = 0;
+		while (f < n_frames && section->frames_refs[f] != frame) f++;
+	}
+	return f;
+}
+
+/* The address of the frame when encoding it for section. The frames of
+ * laid out sections only get their address when the section is
+ * written, so it is computed from the frames sizes meanwhile. */
+static uint32_t frame_address_in
+(struct armv7_text_frame const * __restrict const frame,
+ struct armv7_text_section const * __restrict const section)
+{
+	uint32_t address = frame->metadata.base_address;
+	if (section == NULL || !section->laid_out || frame->section != section)
+		goto not_laid_out;
+
+	uint32_t const f = text_section_frame_index(section, frame);
+	if (f < section->n_frames_refs)
+		address =
+			section->base_address + fenwick_prefix(&section->frames_sizes, f);
+
+not_laid_out:
+	return address;
+}
+
+/* Keep the frames sizes of the section of the frame up to date */
+static void frame_resized
+(struct armv7_text_frame const * __restrict const frame,
+ uint32_t const delta)
+{
+	struct armv7_text_section * __restrict const section = frame->section;
+	if (section == NULL || !fenwick_ready(&section->frames_sizes))
+		goto not_tracked;
+
+	uint32_t const f = text_section_frame_index(section, frame);
+	if (f == section->n_frames_refs) goto not_tracked;
+
+	fenwick_add(&section->frames_sizes, f, delta);
+	/* Every frame after it moved */
+	if (section->laid_out) section->addresses_version += 1;
+
+not_tracked:
+	return;
+}
+
+struct armv7_add_instruction_status frame_add_instruction
+(struct armv7_text_frame * __restrict const frame)
+{
+	struct armv7_add_instruction_status status = {
+		.added = 0,
+		.address = NULL
+	};
+
+	if (!frame_keep_state_for_snapshots(frame))
+		goto no_more_space_for_instructions;
+
+	if (need_more_space_for_instructions_in(frame))
+		if (!allocate_more_space_for_instructions_in(frame))
+			goto no_more_space_for_instructions;
+
+	unsigned int new_index = frame->metadata.stored_instructions;
+	
+	struct instruction_representation * instruction_addr =
+		armv7_frame_instruction(frame, new_index);
+	frame->metadata.stored_instructions += 1;
+	frame->code.valid = 0;
+	frame_resized(frame, sizeof(uint32_t));
+
+	status.added = 1;
+	status.address = instruction_addr;
+
+no_more_space_for_instructions:
+	return status;
+}
+
+static void instruction_update_needs_layout
+(struct instruction_representation * __restrict const instruction)
+{
+	instruction->needs_layout =
+		arguments_resolved[instruction->types[0]] |
+		arguments_resolved[instruction->types[1]] |
+		arguments_resolved[instruction->types[2]];
+}
+
+static void set_instruction_mnemonic_id
+(struct instruction_representation * __restrict const instruction,
+ enum known_instructions mnemonic_id)
+{
+	if (instruction->mnemonic_id != mnemonic_id) {
+		*instruction = instructions_defaults[mnemonic_id];
+		instruction_update_needs_layout(instruction);
+	}
+}
+
+static void set_instruction_arg
+(struct instruction_representation * __restrict const instruction,
+ unsigned int const index,
+ enum argument_type argument_type,
+ uint32_t const value)
+{
+	instruction->types[index] = argument_type;
+	instruction->values[index] = value;
+	instruction_update_needs_layout(instruction);
+}
+
+void instruction_mnemonic_id
+(struct instruction_representation * instruction,
+ enum known_instructions mnemonic_id)
+{
+	set_instruction_mnemonic_id(instruction, mnemonic_id);
+}
+
+void instruction_arg
+(struct instruction_representation * const instruction,
+ unsigned int const index,
+ enum argument_type argument_type,
+ uint32_t const value)
+{
+	set_instruction_arg(instruction, index, argument_type, value);
+}
+
+/* n_reference_targets when the argument doesn't refer to anything */
+static enum reference_target argument_reference_target
+(enum argument_type const argument_type)
+{
+	enum reference_target target = n_reference_targets;
+	switch(argument_type) {
+		case arg_data_symbol_address:
+		case arg_data_symbol_address_top16:
+		case arg_data_symbol_address_bottom16:
+		case arg_data_symbol_size:
+			target = reference_to_data_symbol;
+			break;
+		case arg_frame_address:
+		case arg_frame_address_pc_relative:
+			target = reference_to_frame;
+			break;
+		default:
+			break;
+	}
+	return target;
+}
+
+static void frame_record_arg_reference
+(struct armv7_text_frame const * __restrict const frame,
+ uint32_t const instruction_index,
+ unsigned int const arg_index,
+ unsigned int const recorded)
+{
+	struct references_index * __restrict const references =
+		frame->references;
+	struct instruction_representation const * __restrict const instruction =
+		armv7_frame_instruction(frame, instruction_index);
+	int32_t const value = instruction->values[arg_index];
+	enum reference_target const target =
+		argument_reference_target(instruction->types[arg_index]);
+
+	if (references == NULL || target == n_reference_targets)
+		goto nothing_to_record;
+
+	if (recorded)
+		references_index_add(
+			references, target, value,
+			frame->metadata.id, instruction_index, arg_index
+		);
+	else
+		references_index_remove(
+			references, target, value,
+			frame->metadata.id, instruction_index, arg_index
+		);
+
+nothing_to_record:
+	return;
+}
+
+static void frame_record_instruction_references
+(struct armv7_text_frame const * __restrict const frame,
+ uint32_t const instruction_index,
+ unsigned int const recorded)
+{
+	for (unsigned int a = 0; a < MAX_ARGS; a++)
+		frame_record_arg_reference(frame, instruction_index, a, recorded);
+}
+
+void frame_instruction_mnemonic_id
+(struct armv7_text_frame * __restrict const frame,
+ uint32_t const instruction_index,
+ enum known_instructions mnemonic_id)
+{
+	if (!frame_keep_instruction_for_snapshots(frame, instruction_index))
+		goto cant_keep_state;
+	frame->code.valid = 0;
+	frame_record_instruction_references(frame, instruction_index, 0);
+	set_instruction_mnemonic_id(
+		armv7_frame_instruction(frame, instruction_index), mnemonic_id
+	);
+	frame_record_instruction_references(frame, instruction_index, 1);
+cant_keep_state:
+	return;
+}
+
+void frame_instruction_arg
+(struct armv7_text_frame * __restrict const frame,
+ uint32_t const instruction_index,
+ unsigned int const arg_index,
+ enum argument_type argument_type,
+ uint32_t const value)
+{
+	if (!frame_keep_instruction_for_snapshots(frame, instruction_index))
+		goto cant_keep_state;
+	frame->code.valid = 0;
+	frame_record_arg_reference(frame, instruction_index, arg_index, 0);
+	set_instruction_arg(
+		armv7_frame_instruction(frame, instruction_index), arg_index,
+		argument_type, value
+	);
+	frame_record_arg_reference(frame, instruction_index, arg_index, 1);
+cant_keep_state:
+	return;
+}
+
+void armv7_frame_invalidate_code
+(struct armv7_text_frame * __restrict const frame)
+{
+	frame->code.valid = 0;
+}
+
+void armv7_frame_track_references
+(struct armv7_text_frame * __restrict const frame,
+ struct references_index * __restrict const references)
+{
+	uint32_t const n_instructions = frame->metadata.stored_instructions;
+
+	for (uint32_t i = 0; i < n_instructions; i++)
+		frame_record_instruction_references(frame, i, 0);
+
+	frame->references = references;
+
+	for (uint32_t i = 0; i < n_instructions; i++)
+		frame_record_instruction_references(frame, i, 1);
+}
+
+/* The arguments of up to FRAME_ENCODE_BLOCK instructions are resolved
+ * first, then each run of the same mnemonic is encoded at once */
+#define FRAME_ENCODE_BLOCK 64
+/* Returns 0 if some instruction refers to an unknown data symbol */
+static unsigned int frame_encode_block
+(struct instruction_representation const * __restrict const block,
+ uint32_t const n,
+ struct armv7_text_section const * __restrict const section,
+ struct data_section const * __restrict const data_infos,
+ uint32_t const pc,
+ uint32_t * __restrict const output)
+{
+	uint32_t values[MAX_ARGS][FRAME_ENCODE_BLOCK];
+	unsigned int found = 1;
+	for (uint32_t i = 0; i < n; i++) {
+		struct instruction_representation const * __restrict const
+			instruction = block+i;
+		if (instruction->needs_layout) {
+			for (unsigned int a = 0; a < MAX_ARGS; a++) {
+				struct uint32_result const value = resolve_arg(
+					data_infos, section, instruction, a, pc + i * 4
+				);
+				values[a][i] = value.value;
+				found &= value.found;
+			}
+			continue;
+		}
+		for (unsigned int a = 0; a < MAX_ARGS; a++)
+			values[a][i] =
+				instruction->values[a] & arguments_masks[instruction->types[a]];
+	}
+
+	uint32_t run_start = 0;
+	while (run_start < n) {
+		uint8_t const mnemonic_id = block[run_start].mnemonic_id;
+		uint32_t run_end = run_start + 1;
+		while (run_end < n && block[run_end].mnemonic_id == mnemonic_id)
+			run_end++;
+
+		uint32_t const * const run_values[MAX_ARGS] = {
+			values[0] + run_start, values[1] + run_start, values[2] + run_start
+		};
+		armv7_encode_values_batch(
+			mnemonic_id, run_values, run_end - run_start, output + run_start
+		);
+		run_start = run_end;
+	}
+	return found;
+}
+
+/* Encode the n instructions of the frame starting at first, chunk
+ * after chunk.
+ * Returns 0 if some instruction refers to an unknown data symbol. */
+static unsigned int frame_gen_machine_code_range
+(struct armv7_text_frame const * __restrict const frame,
+ struct armv7_text_section const * __restrict const section,
+ struct data_section const * __restrict const data_infos,
+ uint32_t const first,
+ uint32_t const n,
+ uint32_t * __restrict const result_code)
+{
+	uint32_t const first_chunk = frame->first_chunk;
+	uint32_t const end = first + n;
+	unsigned int pc = frame_address_in(frame, section) + first * 4;
+	unsigned int found = 1;
+
+	for (uint32_t i = first; i < end;) {
+		struct instruction_representation const * __restrict instructions =
+			frame->instructions;
+		uint32_t chunk_start = 0;
+		uint32_t chunk_end = first_chunk;
+		if (i >= first_chunk) {
+			unsigned int const k =
+				31 - __builtin_clz(i >> __builtin_ctz(first_chunk));
+			instructions = frame->chunks[k];
+			chunk_start = first_chunk << k;
+			chunk_end = chunk_start * 2;
+		}
+		if (chunk_end > end) chunk_end = end;
+
+		while (i < chunk_end) {
+			uint32_t const n_block = (chunk_end - i < FRAME_ENCODE_BLOCK) ?
+				chunk_end - i : FRAME_ENCODE_BLOCK;
+			struct instruction_representation const * __restrict const
+				block = instructions + (i - chunk_start);
+			found &= frame_encode_block(
+				block, n_block, section, data_infos, pc,
+				result_code + (i - first)
+			);
+			i += n_block;
+			pc += n_block * 4;
+		}
+	}
+	return found;
+}
+
+unsigned int armv7_frame_gen_machine_code
+(struct armv7_text_frame const * __restrict const frame,
+ struct armv7_text_section const * __restrict const section,
+ struct data_section const * __restrict const data_infos,
+ uint32_t * __restrict const result_code)
+{
+	unsigned int n_instructions = frame->metadata.stored_instructions;
+	unsigned int const found = frame_gen_machine_code_range(
+		frame, section, data_infos, 0, n_instructions, result_code
+	);
+	return found ? n_instructions * sizeof(uint32_t) : 0;
+}
+
+/* The frame stored at index f, as shown by the section.
+ * For snapshots, the frame may have to be copied in view. */
+static struct armv7_text_frame const * text_section_frame_at
+(struct armv7_text_section const * __restrict const text_section,
+ uint32_t const f,
+ struct armv7_text_frame * __restrict const view)
+{
+	struct armv7_text_frame const * __restrict const frame =
+		text_section->frames_refs[f];
+	struct armv7_text_frame const * __restrict shown = frame;
+	uint32_t const epoch = text_section->epoch;
+	if (text_section->snapshot_of == NULL) goto live_section;
+
+	/* live_since only grows, and is updated before the frame */
+	uint32_t since = __atomic_load_n(&frame->live_since, __ATOMIC_ACQUIRE);
+	while (since <= epoch) {
+		memcpy(view, frame, sizeof(struct armv7_text_frame));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		uint32_t const since_after =
+			__atomic_load_n(&frame->live_since, __ATOMIC_RELAXED);
+		if (since_after == since) {
+			shown = view;
+			goto copied_unchanged;
+		}
+		since = since_after;
+	}
+
+	struct armv7_text_frame_version const * __restrict version =
+		__atomic_load_n(&frame->versions, __ATOMIC_ACQUIRE);
+	while (version->since > epoch) version = version->older;
+	shown = &version->frame;
+
+copied_unchanged:
+live_section:
+	return shown;
+}
+
+uint32_t text_section_frame_address
+(struct armv7_text_section const * __restrict const text_section,
+ unsigned int const frame_id)
+{
+	uint32_t address = 0;
+	
+	unsigned int n_frames = text_section->n_frames_refs;
+	struct armv7_text_frame const * const * __restrict const frames =
+		(struct armv7_text_frame const * const *) text_section->frames_refs;
+	
+	unsigned int f = 0;
+	if (id_index_ready(&text_section->frames_index)) {
+		struct id_index_result const indexed =
+			id_index_get(&text_section->frames_index, frame_id);
+		f = (indexed.found) ? indexed.index : n_frames;
+	}
+	else while(f < n_frames && frames[f]->metadata.id != frame_id) f++;
+	
+	if (f < n_frames && text_section->laid_out)
+		address =
+			text_section->base_address +
+			fenwick_prefix(&text_section->frames_sizes, f);
+	else if (f < n_frames) {
+		struct armv7_text_frame view;
+		address =
+			text_section_frame_at(text_section, f, &view)->metadata.base_address;
+	}
+	
+	return address;
+}
+
+static unsigned int expand_frame_space_of
 (struct armv7_text_section * __restrict const text_section)
 {
 	unsigned int current_refs_size = 
 		text_section->max_frames_refs * sizeof(struct armv7_text_frame *);
 	unsigned int new_refs_size = current_refs_size * 2;
+	uint32_t * __restrict const references =
+		text_section->frames_refs_references;
 	
-	struct armv7_text_frame ** const new_refs_addr =
+	/* Snapshots keep reading the current references */
+	unsigned int const shared = (references != NULL) &&
+		(__atomic_load_n(references, __ATOMIC_ACQUIRE) > 1);
+	struct armv7_text_frame ** const new_refs_addr = (shared) ?
+		allocate_durable_memory(new_refs_size) :
 		reallocate_durable_memory(text_section->frames_refs, new_refs_size);
 		
 	unsigned int expanded = (new_refs_addr != NULL);
+	if (!expanded) goto cant_expand;
+
+	if (shared) {
+		memcpy(new_refs_addr, text_section->frames_refs, current_refs_size);
+		if (__atomic_sub_fetch(references, 1, __ATOMIC_ACQ_REL) == 0) {
+			free_durable_memory(text_section->frames_refs);
+			free_durable_memory(references);
+		}
+		text_section->frames_refs_references = NULL;
+	}
+	text_section->frames_refs = new_refs_addr;
+	text_section->max_frames_refs *= 2;
 	
+cant_expand:
 	return expanded;
 }
 
@@ -778,7 +1656,17 @@ struct armv7_text_section * generate_armv7_text_section()
 		.n_frames_refs = 0,
 		.max_frames_refs = n_frames_refs_default,
 		.base_address = 0,
-		.frames_refs = frames_refs
+		.frames_refs = frames_refs,
+		.epoch = 1,
+		.snapshots = NULL,
+		.snapshot_of = NULL,
+		.frames_refs_references = NULL,
+		.frames_index = {0},
+		.frames_index_references = NULL,
+		.frames_pool = NULL,
+		.addresses_version = 0,
+		.frames_sizes = {0},
+		.laid_out = 0
 	};
 	
 	
@@ -786,39 +1674,279 @@ struct armv7_text_section * generate_armv7_text_section()
 		allocate_durable_memory(sizeof(struct armv7_text_section));
 	
 	if (text_section == NULL) free_durable_memory(frames_refs);
-	else memcpy(
-		text_section, &section_infos, sizeof(struct armv7_text_section)
-	);
+	else {
+		memcpy(
+			text_section, &section_infos, sizeof(struct armv7_text_section)
+		);
+		id_index_init(&text_section->frames_index, n_frames_refs_default);
+		fenwick_init(&text_section->frames_sizes, n_frames_refs_default);
+	}
 	
 cant_allocate_frames_refs_space:
 	return text_section;
 }
 
+static void frame_move_to
+(struct armv7_text_frame * __restrict const frame,
+ uint32_t const address)
+{
+	if (frame->metadata.base_address != address &&
+	    frame_keep_state_for_snapshots(frame)) {
+		frame->metadata.base_address = address;
+		if (frame->section != NULL) frame->section->addresses_version += 1;
+	}
+}
+
+/* Store the addresses of the frames of laid out sections in the
+ * frames */
+static void text_section_place_frames
+(struct armv7_text_section const * __restrict const text_section)
+{
+	if (!text_section->laid_out) goto not_laid_out;
+
+	uint32_t address = text_section->base_address;
+	for (uint32_t f = 0; f < text_section->n_frames_refs; f++) {
+		struct armv7_text_frame * __restrict const frame =
+			text_section->frames_refs[f];
+		frame_move_to(frame, address);
+		address += armv7_frame_size(frame);
+	}
+
+not_laid_out:
+	return;
+}
+
+/* The frames addresses are now set one by one */
+static void text_section_stop_laying_out
+(struct armv7_text_section * __restrict const text_section)
+{
+	text_section_place_frames(text_section);
+	text_section->laid_out = 0;
+}
+
 void armv7_frame_set_address
 (struct armv7_text_frame * __restrict const frame,
  uint32_t const address)
 {
-	frame->metadata.base_address = address;
+	if (frame->section != NULL)
+		text_section_stop_laying_out(frame->section);
+	frame_move_to(frame, address);
+}
+
+/* Frames IDs are searched linearly when they cannot be indexed */
+static void text_section_index_frame
+(struct armv7_text_section * __restrict const text_section,
+ uint32_t const frame_id,
+ uint32_t const index)
+{
+	struct id_index * __restrict const frames_index =
+		&text_section->frames_index;
+	uint32_t * __restrict const references =
+		text_section->frames_index_references;
+	if (!id_index_ready(frames_index)) goto not_indexed;
+
+	/* The snapshots keep the current index */
+	if (references != NULL) {
+		struct id_index copy = {0};
+		unsigned int const shared =
+			__atomic_load_n(references, __ATOMIC_ACQUIRE) > 1;
+		if (shared && !id_index_copy(&copy, frames_index))
+			goto cant_copy_index;
+
+		if (__atomic_sub_fetch(references, 1, __ATOMIC_ACQ_REL) == 0) {
+			if (shared) id_index_free(frames_index);
+			free_durable_memory(references);
+		}
+		if (shared) *frames_index = copy;
+		text_section->frames_index_references = NULL;
+	}
+
+	/* Like the linear search, the first frame using an ID wins */
+	if (!id_index_get(frames_index, frame_id).found &&
+	    !id_index_set(frames_index, frame_id, index))
+		id_index_free(frames_index);
+	goto indexed;
+
+cant_copy_index:
+	__atomic_sub_fetch(references, 1, __ATOMIC_ACQ_REL);
+	text_section->frames_index_references = NULL;
+	frames_index->slots = NULL;
+indexed:
+not_indexed:
+	return;
 }
 
 unsigned int armv7_text_section_add_frame
 (struct armv7_text_section * __restrict const text_section,
- struct armv7_text_frame const * __restrict const frame)
+ struct armv7_text_frame * __restrict const frame)
 {
 	unsigned int added = 0;
+	if (text_section->snapshot_of != NULL)
+		goto not_enough_memory_for_new_frame_reference;
+
 	if (not_enough_frame_space_in(text_section))
 		if (!expand_frame_space_of(text_section))
 			goto not_enough_memory_for_new_frame_reference;
 	
 	unsigned int new_index = text_section->n_frames_refs;
+	text_section_index_frame(text_section, frame->metadata.id, new_index);
 	text_section->frames_refs[new_index] = frame;
 	text_section->n_frames_refs = new_index + 1;
+	frame->section = text_section;
+	frame->live_since = text_section->epoch;
+	text_section->addresses_version += 1;
+	if (fenwick_ready(&text_section->frames_sizes) &&
+	    !fenwick_append(&text_section->frames_sizes, armv7_frame_size(frame))) {
+		text_section_stop_laying_out(text_section);
+		fenwick_free(&text_section->frames_sizes);
+	}
 	added = 1;
 	
 not_enough_memory_for_new_frame_reference:
 	return added;
 }
 
+/* Stop sharing frames_refs with the snapshots before modifying the
+ * stored references */
+static unsigned int text_section_own_frames_refs
+(struct armv7_text_section * __restrict const text_section)
+{
+	uint32_t * __restrict const references =
+		text_section->frames_refs_references;
+	unsigned int owned = 1;
+	if (references == NULL) goto already_owned;
+
+	unsigned int const shared =
+		__atomic_load_n(references, __ATOMIC_ACQUIRE) > 1;
+	if (shared) {
+		size_t const refs_size =
+			text_section->max_frames_refs * sizeof(struct armv7_text_frame *);
+		struct armv7_text_frame ** __restrict const copy =
+			allocate_durable_memory(refs_size);
+		owned = (copy != NULL);
+		if (!owned) goto cant_copy;
+		memcpy(copy, text_section->frames_refs, refs_size);
+		text_section->frames_refs = copy;
+	}
+	if (__atomic_sub_fetch(references, 1, __ATOMIC_ACQ_REL) == 0)
+		free_durable_memory(references);
+	text_section->frames_refs_references = NULL;
+
+cant_copy:
+already_owned:
+	return owned;
+}
+
+/* Rebuild the frames index and sizes after the frames from index
+ * first moved in frames_refs.
+ * The frames index is rebuilt entirely, since the frames sharing an ID
+ * are resolved to the first of them. The sizes before first are kept.
+ * Both fall back to searching and summing the frames when they cannot
+ * be rebuilt. */
+static void text_section_reindex_frames
+(struct armv7_text_section * __restrict const text_section,
+ uint32_t const first)
+{
+	uint32_t const n_frames = text_section->n_frames_refs;
+	struct id_index * __restrict const frames_index =
+		&text_section->frames_index;
+	uint32_t * __restrict const references =
+		text_section->frames_index_references;
+
+	/* The snapshots keep the current index */
+	unsigned int const shared = (references != NULL) &&
+		__atomic_sub_fetch(references, 1, __ATOMIC_ACQ_REL) > 0;
+	if (references != NULL && !shared) free_durable_memory(references);
+	if (!shared) id_index_free(frames_index);
+	text_section->frames_index_references = NULL;
+	frames_index->slots = NULL;
+
+	if (id_index_init(frames_index, text_section->max_frames_refs))
+		for (uint32_t f = 0; f < n_frames; f++)
+			text_section_index_frame(
+				text_section, text_section->frames_refs[f]->metadata.id, f
+			);
+
+	struct fenwick * __restrict const frames_sizes =
+		&text_section->frames_sizes;
+	if (!fenwick_ready(frames_sizes)) goto sizes_not_tracked;
+	fenwick_truncate(frames_sizes, first);
+	for (uint32_t f = first; f < n_frames; f++) {
+		if (fenwick_append(
+		      frames_sizes, armv7_frame_size(text_section->frames_refs[f])))
+			continue;
+		fenwick_free(frames_sizes);
+		text_section->laid_out = 0;
+		break;
+	}
+
+sizes_not_tracked:
+	/* The frames after the modified ones moved */
+	text_section->addresses_version += 1;
+}
+
+unsigned int armv7_text_section_insert_frame
+(struct armv7_text_section * __restrict const text_section,
+ struct armv7_text_frame * __restrict const frame,
+ uint32_t const index)
+{
+	unsigned int inserted = 0;
+	uint32_t const n_frames = text_section->n_frames_refs;
+	if (index >= n_frames) {
+		inserted = armv7_text_section_add_frame(text_section, frame);
+		goto added_at_the_end;
+	}
+	if (text_section->snapshot_of != NULL) goto snapshots_cant_be_modified;
+
+	if (not_enough_frame_space_in(text_section) &&
+	    !expand_frame_space_of(text_section))
+		goto cant_insert;
+	if (!text_section_own_frames_refs(text_section)) goto cant_insert;
+
+	struct armv7_text_frame ** __restrict const frames =
+		text_section->frames_refs;
+	memmove(
+		frames+index+1, frames+index,
+		(n_frames - index) * sizeof(struct armv7_text_frame *)
+	);
+	frames[index] = frame;
+	text_section->n_frames_refs = n_frames + 1;
+	frame->section = text_section;
+	frame->live_since = text_section->epoch;
+	text_section_reindex_frames(text_section, index);
+	inserted = 1;
+
+cant_insert:
+snapshots_cant_be_modified:
+added_at_the_end:
+	return inserted;
+}
+
+struct armv7_text_frame * armv7_text_section_remove_frame
+(struct armv7_text_section * __restrict const text_section,
+ uint32_t const index)
+{
+	struct armv7_text_frame * __restrict removed = NULL;
+	uint32_t const n_frames = text_section->n_frames_refs;
+	if (text_section->snapshot_of != NULL || index >= n_frames)
+		goto cant_remove;
+	if (!text_section_own_frames_refs(text_section)) goto cant_remove;
+
+	struct armv7_text_frame ** __restrict const frames =
+		text_section->frames_refs;
+	removed = frames[index];
+	memmove(
+		frames+index, frames+index+1,
+		(n_frames - index - 1) * sizeof(struct armv7_text_frame *)
+	);
+	text_section->n_frames_refs = n_frames - 1;
+	removed->section = NULL;
+	text_section_reindex_frames(text_section, index);
+
+cant_remove:
+	return removed;
+}
+
 unsigned int armv7_frame_size
 (struct armv7_text_frame const * __restrict const frame)
 {
@@ -829,10 +1957,16 @@ unsigned int armv7_text_section_size
 (struct armv7_text_section const * __restrict const text_section)
 {
 	unsigned int size = 0;
+	if (fenwick_ready(&text_section->frames_sizes)) {
+		size = fenwick_total(&text_section->frames_sizes);
+		goto tracked_size;
+	}
 	
+	struct armv7_text_frame view;
 	for (unsigned int f = 0; f < text_section->n_frames_refs; f++)
-		size += armv7_frame_size(text_section->frames_refs[f]);
+		size += armv7_frame_size(text_section_frame_at(text_section, f, &view));
 	
+tracked_size:
 	return size;
 }
 
@@ -840,34 +1974,685 @@ void armv7_text_section_rebase_at
 (struct armv7_text_section * __restrict const text_section,
  uint32_t const base)
 {	
+	if (text_section->snapshot_of != NULL) goto snapshots_cant_be_modified;
+
 	text_section->base_address = base;
+	if (fenwick_ready(&text_section->frames_sizes)) {
+		text_section->laid_out = 1;
+		text_section->addresses_version += 1;
+		goto laid_out;
+	}
 
 	unsigned int addr = base;
 	for (unsigned int f = 0; f < text_section->n_frames_refs; f++) {
 		struct armv7_text_frame * __restrict const current_frame =
 			text_section->frames_refs[f];
-		armv7_frame_set_address(current_frame, addr);
+		frame_move_to(current_frame, addr);
 		addr += armv7_frame_size(current_frame);
 	}
+
+laid_out:
+snapshots_cant_be_modified:
+	return;
 }
 
-void armv7_text_section_write_at
+/* The bits of the argument a in the instruction, when it isn't the
+ * signed argument */
+static inline uint32_t armv7_encode_arg_fields
+(struct armv7_encoding const * __restrict const encoding,
+ unsigned int const a,
+ uint32_t const value)
+{
+	uint32_t code = 0;
+	for (unsigned int f = 0; f < ARMV7_ENCODING_FIELDS; f++) {
+		struct armv7_encoding_field const field = encoding->fields[f];
+		if (field.arg == a)
+			code |= ((value >> field.right_shift) & field.mask)
+				<< field.left_shift;
+	}
+	return code;
+}
+
+/* First pass : encode the instructions that don't refer to anything,
+ * and the others with their referring arguments left to 0, and list
+ * these as fixups.
+ * Returns 0 when the fixups list couldn't grow. */
+static unsigned int frame_encode_with_fixups
+(struct armv7_text_frame const * __restrict const frame,
+ struct armv7_frame_code_cache * __restrict const code)
+{
+	unsigned int encoded = 0;
+	uint32_t const n_words = frame->metadata.stored_instructions;
+	uint32_t * __restrict const words = code->words;
+	code->n_fixups = 0;
+	code->uses_frames = 0;
+	code->uses_data = 0;
+
+	for (uint32_t i = 0; i < n_words; i++) {
+		struct instruction_representation const * __restrict const
+			instruction = armv7_frame_instruction(frame, i);
+		/* The arguments referring to something are masked to 0 */
+		uint32_t values[MAX_ARGS];
+		for (unsigned int a = 0; a < MAX_ARGS; a++)
+			values[a] =
+				instruction->values[a] & arguments_masks[instruction->types[a]];
+		words[i] = armv7_encode_values(instruction->mnemonic_id, values);
+		if (!instruction->needs_layout) continue;
+
+		uint8_t kinds = 0;
+		unsigned int n_referring = 0;
+		unsigned int arg = 0;
+		for (unsigned int a = 0; a < MAX_ARGS; a++) {
+			enum reference_target const target =
+				argument_reference_target(instruction->types[a]);
+			if (target == n_reference_targets) continue;
+			kinds |= (target == reference_to_frame) ?
+				ARMV7_FIXUP_FRAMES : ARMV7_FIXUP_DATA;
+			n_referring++;
+			arg = a;
+		}
+		if (kinds == 0) continue;
+
+		struct armv7_encoding const * __restrict const encoding =
+			armv7_encodings + instruction->mnemonic_id;
+		if (n_referring > 1 ||
+		    (encoding->is_signed && encoding->signed_arg == arg))
+			arg = ARMV7_FIXUP_WHOLE_INSTRUCTION;
+
+		if (code->n_fixups == code->max_fixups) {
+			uint32_t const max_fixups =
+				(code->max_fixups != 0) ? code->max_fixups * 2 : 16;
+			struct armv7_fixup * __restrict const fixups =
+				reallocate_durable_memory(
+					code->fixups, max_fixups * sizeof(struct armv7_fixup)
+				);
+			if (fixups == NULL) goto cant_list_fixups;
+			code->fixups = fixups;
+			code->max_fixups = max_fixups;
+		}
+		unsigned int const value_arg =
+			(arg == ARMV7_FIXUP_WHOLE_INSTRUCTION) ? 0 : arg;
+		code->fixups[code->n_fixups++] = (struct armv7_fixup) {
+			.instruction = i,
+			.base        = words[i],
+			.target      = instruction->values[value_arg],
+			.mnemonic_id = instruction->mnemonic_id,
+			.type        = instruction->types[value_arg],
+			.arg         = arg,
+			.kinds       = kinds
+		};
+		code->uses_frames |= (kinds & ARMV7_FIXUP_FRAMES) != 0;
+		code->uses_data |= (kinds & ARMV7_FIXUP_DATA) != 0;
+	}
+	encoded = 1;
+
+cant_list_fixups:
+	return encoded;
+}
+
+/* Second pass : patch the instructions of the fixups referring to the
+ * given kinds of targets, with the current addresses.
+ * Returns 0 if some of them refer to an unknown data symbol. */
+static unsigned int frame_apply_fixups
+(struct armv7_text_frame const * __restrict const frame,
+ struct armv7_text_section const * __restrict const text_section,
+ struct data_section const * __restrict const data_section,
+ struct armv7_frame_code_cache * __restrict const code,
+ uint8_t const kinds)
+{
+	uint32_t const base_address = frame->metadata.base_address;
+	struct armv7_fixup const * __restrict const fixups = code->fixups;
+	uint32_t * __restrict const words = code->words;
+	unsigned int found = 1;
+
+	for (uint32_t f = 0; f < code->n_fixups; f++) {
+		struct armv7_fixup const fixup = fixups[f];
+		if ((fixup.kinds & kinds) == 0) continue;
+		uint32_t const i = fixup.instruction;
+		uint32_t const pc = base_address + i * 4;
+		struct uint32_result word;
+		if (fixup.arg == ARMV7_FIXUP_WHOLE_INSTRUCTION)
+			word = armv7_encode_instruction_resolved(
+				data_section, text_section,
+				armv7_frame_instruction(frame, i), pc
+			);
+		else {
+			word = get_value(
+				data_section, text_section, fixup.type, fixup.target, pc
+			);
+			word.value = fixup.base | armv7_encode_arg_fields(
+				armv7_encodings + fixup.mnemonic_id, fixup.arg, word.value
+			);
+		}
+		words[i] = word.value;
+		found &= word.found;
+	}
+	return found;
+}
+
+/* Copy the code of the frame, encoding it again only if it changed.
+ * When only the addresses it refers to moved, only its fixups are
+ * applied again.
+ * Frames whose code cannot be kept are encoded directly in output.
+ * Returns 0 if some instruction refers to an unknown data symbol, in
+ * which case the code is not kept. */
+static unsigned int frame_write_code
+(struct armv7_text_frame * __restrict const frame,
+ struct armv7_text_section const * __restrict const text_section,
+ struct data_section const * __restrict const data_section,
+ uint32_t * __restrict const output)
+{
+	struct armv7_frame_code_cache * __restrict const code = &frame->code;
+	uint32_t const n_words = frame->metadata.stored_instructions;
+	uint8_t moved = ARMV7_FIXUP_FRAMES | ARMV7_FIXUP_DATA;
+	unsigned int found = 1;
+
+	if (code->valid &&
+	    code->n_words == n_words &&
+	    code->text_section == text_section &&
+	    code->data_section == data_section) {
+		moved = 0;
+		if (code->uses_frames &&
+		    (code->address != frame->metadata.base_address ||
+		     code->frames_version != text_section->addresses_version))
+			moved |= ARMV7_FIXUP_FRAMES;
+		if (code->uses_data &&
+		    (data_section == NULL ||
+		     code->data_version == DATA_SECTION_UNTRACKED_ADDRESSES ||
+		     code->data_version != data_section_addresses_version(data_section)))
+			moved |= ARMV7_FIXUP_DATA;
+		if (moved == 0) goto copy_code;
+		goto apply_fixups;
+	}
+
+	code->valid = 0;
+	if (code->max_words < n_words) {
+		uint32_t * __restrict const words = reallocate_durable_memory(
+			code->words, n_words * sizeof(uint32_t)
+		);
+		if (words == NULL) goto cant_keep_code;
+		code->words = words;
+		code->max_words = n_words;
+	}
+	if (!frame_encode_with_fixups(frame, code)) goto cant_keep_code;
+	code->n_words = n_words;
+	code->text_section = text_section;
+	code->data_section = data_section;
+
+apply_fixups:
+	/* Resolving data addresses can move the zero-filled symbols, so
+	 * the versions are read afterwards */
+	found = frame_apply_fixups(frame, text_section, data_section, code, moved);
+	code->frames_version = text_section->addresses_version;
+	code->data_version = (data_section != NULL) ?
+		data_section_addresses_version(data_section) :
+		DATA_SECTION_UNTRACKED_ADDRESSES;
+	code->address = frame->metadata.base_address;
+	code->valid = found;
+
+copy_code:
+	/* Empty frames may have no words at all */
+	if (n_words != 0)
+		memcpy(output, code->words, n_words * sizeof(uint32_t));
+	return found;
+
+cant_keep_code:
+	return frame_gen_machine_code_range(
+		frame, text_section, data_section, 0, n_words, output
+	);
+}
+
+/* Encode n instructions, from first, of the frame stored at index f in
+ * the snapshot. The frame can be modified in place while being read,
+ * either when the snapshot shows the live frame, or when the version
+ * shown shares the chunk modified : the instructions are then encoded
+ * again, from the state kept for the snapshot. */
+static unsigned int snapshot_frame_gen_machine_code_range
+(struct armv7_text_section const * __restrict const snapshot,
+ uint32_t const f,
+ struct data_section const * __restrict const data_section,
+ uint32_t const first,
+ uint32_t const n,
+ uint32_t * __restrict const output)
+{
+	struct armv7_text_frame const * __restrict const frame =
+		snapshot->frames_refs[f];
+	struct armv7_text_frame view;
+	uint32_t since;
+	uint32_t kept_chunks;
+	unsigned int found;
+	do {
+		since = __atomic_load_n(&frame->live_since, __ATOMIC_ACQUIRE);
+		kept_chunks = __atomic_load_n(&frame->kept_chunks, __ATOMIC_ACQUIRE);
+		found = frame_gen_machine_code_range(
+			text_section_frame_at(snapshot, f, &view), snapshot,
+			data_section, first, n, output
+		);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((since <= snapshot->epoch &&
+	          __atomic_load_n(&frame->live_since, __ATOMIC_RELAXED) != since) ||
+	         __atomic_load_n(&frame->kept_chunks, __ATOMIC_RELAXED) != kept_chunks);
+	return found;
+}
+
+unsigned int armv7_text_section_write_at
 (struct armv7_text_section const * __restrict const text_section,
  struct data_section const * __restrict const data_section,
  uint8_t * __restrict const output)
 {
 	unsigned int const base_address = text_section->base_address;
 	unsigned int output_cursor = 0;
+	unsigned int found = 1;
+	text_section_place_frames(text_section);
 	
+	struct armv7_text_frame view;
 	for (unsigned int f = 0; f < text_section->n_frames_refs; f++) {
-		struct armv7_text_frame * __restrict const current_frame =
-			text_section->frames_refs[f];
+		struct armv7_text_frame const * __restrict const current_frame =
+			text_section_frame_at(text_section, f, &view);
 		uint32_t const frame_address = current_frame->metadata.base_address;
 		output_cursor = frame_address - base_address;
-		armv7_frame_gen_machine_code(
-			current_frame, text_section,
-			data_section, (uint32_t *) (output+output_cursor)
+		if (text_section->snapshot_of == NULL)
+			found &= frame_write_code(
+				text_section->frames_refs[f], text_section,
+				data_section, (uint32_t *) (output+output_cursor)
+			);
+		else found &= snapshot_frame_gen_machine_code_range(
+			text_section, f, data_section,
+			0, current_frame->metadata.stored_instructions,
+			(uint32_t *) (output+output_cursor)
 		);
 	}
 	
+	return found;
+}
+
+/* Consecutive frames, or a range of instructions in a big frame */
+#define TEXT_SECTION_WRITE_TASK_INSTRUCTIONS 4096
+#define TEXT_SECTION_WRITE_WHOLE_FRAMES 0xffffffff
+
+struct text_section_write_task {
+	uint32_t first_frame;
+	uint32_t end_frame;
+	uint32_t first_instruction;
+	uint32_t n_instructions;
+};
+
+/* Each worker takes the tasks of its own queue first, then the tasks
+ * left in the others */
+struct text_section_write_queue {
+	uint32_t next;
+	uint32_t end;
+} __attribute__((aligned(64)));
+
+struct text_section_writer {
+	struct armv7_text_section const * text_section;
+	struct data_section const * data_section;
+	uint8_t * output;
+	struct text_section_write_task const * tasks;
+	struct text_section_write_queue * queues;
+	unsigned int n_queues;
+	/* Cleared by the tasks meeting unknown data symbols */
+	unsigned int * found;
+};
+
+struct text_section_write_worker {
+	struct text_section_writer const * writer;
+	unsigned int queue;
+	pthread_t thread;
+};
+
+static void text_section_write_task
+(struct text_section_writer const * __restrict const writer,
+ struct text_section_write_task const * __restrict const task)
+{
+	struct armv7_text_section const * __restrict const text_section =
+		writer->text_section;
+	struct armv7_text_frame view;
+	for (uint32_t f = task->first_frame; f < task->end_frame; f++) {
+		struct armv7_text_frame const * __restrict const frame =
+			text_section_frame_at(text_section, f, &view);
+		uint32_t const n_instructions =
+			(task->n_instructions == TEXT_SECTION_WRITE_WHOLE_FRAMES) ?
+			frame->metadata.stored_instructions : task->n_instructions;
+		uint32_t const output_cursor =
+			frame->metadata.base_address - text_section->base_address +
+			task->first_instruction * 4;
+		uint32_t * __restrict const frame_output =
+			(uint32_t *) (writer->output+output_cursor);
+		unsigned int found;
+		if (task->n_instructions == TEXT_SECTION_WRITE_WHOLE_FRAMES &&
+		    text_section->snapshot_of == NULL)
+			found = frame_write_code(
+				text_section->frames_refs[f], text_section,
+				writer->data_section, frame_output
+			);
+		else if (text_section->snapshot_of != NULL)
+			found = snapshot_frame_gen_machine_code_range(
+				text_section, f, writer->data_section,
+				task->first_instruction, n_instructions, frame_output
+			);
+		else found = frame_gen_machine_code_range(
+			frame, text_section, writer->data_section,
+			task->first_instruction, n_instructions, frame_output
+		);
+		if (!found) __atomic_store_n(writer->found, 0, __ATOMIC_RELAXED);
+	}
+}
+
+static void * text_section_write_worker
+(void * worker_infos)
+{
+	struct text_section_write_worker const * __restrict const worker =
+		worker_infos;
+	struct text_section_writer const * __restrict const writer =
+		worker->writer;
+	unsigned int const n_queues = writer->n_queues;
+
+	for (unsigned int q = 0; q < n_queues; q++) {
+		struct text_section_write_queue * __restrict const queue =
+			writer->queues + (worker->queue + q) % n_queues;
+		uint32_t t;
+		while ((t = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED))
+		       < queue->end)
+			text_section_write_task(writer, writer->tasks+t);
+	}
+	return NULL;
+}
+
+/* Group the small frames until they hold enough instructions, and
+ * split the big ones. Returns the number of tasks stored. */
+static uint32_t text_section_write_tasks
+(struct armv7_text_section const * __restrict const text_section,
+ struct text_section_write_task * __restrict const tasks)
+{
+	uint32_t const per_task = TEXT_SECTION_WRITE_TASK_INSTRUCTIONS;
+	uint32_t const n_frames = text_section->n_frames_refs;
+	uint32_t n_tasks = 0;
+	uint32_t group_start = 0;
+	uint32_t grouped = 0;
+
+	struct armv7_text_frame view;
+	for (uint32_t f = 0; f < n_frames; f++) {
+		uint32_t const n_instructions =
+			text_section_frame_at(text_section, f, &view)->
+			metadata.stored_instructions;
+		if (n_instructions <= per_task) {
+			grouped += n_instructions;
+			if (grouped < per_task) continue;
+		}
+		else {
+			if (group_start < f) {
+				struct text_section_write_task const group = {
+					group_start, f, 0, TEXT_SECTION_WRITE_WHOLE_FRAMES
+				};
+				tasks[n_tasks++] = group;
+			}
+			for (uint32_t i = 0; i < n_instructions; i += per_task) {
+				struct text_section_write_task const range = {
+					f, f+1, i,
+					(n_instructions - i < per_task) ? n_instructions - i : per_task
+				};
+				tasks[n_tasks++] = range;
+			}
+			group_start = f+1;
+			grouped = 0;
+			continue;
+		}
+		struct text_section_write_task const group = {
+			group_start, f+1, 0, TEXT_SECTION_WRITE_WHOLE_FRAMES
+		};
+		tasks[n_tasks++] = group;
+		group_start = f+1;
+		grouped = 0;
+	}
+	if (group_start < n_frames) {
+		struct text_section_write_task const group = {
+			group_start, n_frames, 0, TEXT_SECTION_WRITE_WHOLE_FRAMES
+		};
+		tasks[n_tasks++] = group;
+	}
+
+	return n_tasks;
+}
+
+unsigned int armv7_text_section_write_at_in_parallel
+(struct armv7_text_section const * __restrict const text_section,
+ struct data_section const * __restrict const data_section,
+ uint8_t * __restrict const output,
+ unsigned int const n_threads)
+{
+	unsigned int found = 1;
+	uint32_t const n_frames = text_section->n_frames_refs;
+	uint32_t const max_tasks =
+		2 * n_frames + 1 +
+		armv7_text_section_size(text_section) /
+		(4 * TEXT_SECTION_WRITE_TASK_INSTRUCTIONS);
+
+	struct text_section_write_task * __restrict const tasks =
+		allocate_temporary_memory(
+			max_tasks * sizeof(struct text_section_write_task)
+		);
+	struct text_section_write_queue * __restrict const queues =
+		allocate_temporary_memory(
+			n_threads * sizeof(struct text_section_write_queue)
+		);
+	struct text_section_write_worker * __restrict const workers =
+		allocate_temporary_memory(
+			n_threads * sizeof(struct text_section_write_worker)
+		);
+	if (n_threads <= 1 || tasks == NULL || queues == NULL || workers == NULL)
+		goto write_serially;
+
+	/* get_values only reads the sections from now on */
+	text_section_place_frames(text_section);
+	if (data_section != NULL) data_section_compute_addresses(data_section);
+
+	uint32_t const n_tasks = text_section_write_tasks(text_section, tasks);
+	struct text_section_writer const writer = {
+		.text_section = text_section,
+		.data_section = data_section,
+		.output       = output,
+		.tasks        = tasks,
+		.queues       = queues,
+		.n_queues     = n_threads,
+		.found        = &found
+	};
+	for (unsigned int q = 0; q < n_threads; q++) {
+		queues[q].next = (uint64_t) n_tasks * q / n_threads;
+		queues[q].end  = (uint64_t) n_tasks * (q+1) / n_threads;
+		workers[q].writer = &writer;
+		workers[q].queue  = q;
+	}
+
+	/* The calling thread is the first worker. The tasks of the workers
+	 * that cannot be started are stolen by the others. */
+	unsigned int started = 1;
+	while (started < n_threads &&
+	       pthread_create(
+	         &workers[started].thread, NULL,
+	         text_section_write_worker, workers+started
+	       ) == 0)
+		started++;
+	text_section_write_worker(workers);
+	for (unsigned int w = 1; w < started; w++)
+		pthread_join(workers[w].thread, NULL);
+	goto written;
+
+write_serially:
+	found = armv7_text_section_write_at(text_section, data_section, output);
+written:
+	free_temporary_memory(tasks);
+	free_temporary_memory(queues);
+	free_temporary_memory(workers);
+	return found;
+}
+
+struct armv7_text_section * armv7_text_section_snapshot
+(struct armv7_text_section * __restrict const text_section)
+{
+	struct armv7_text_section * __restrict snapshot = NULL;
+	if (text_section->snapshot_of != NULL) goto not_a_live_section;
+
+	if (text_section->frames_refs_references == NULL) {
+		uint32_t * __restrict const references =
+			allocate_durable_memory(sizeof(uint32_t));
+		if (references == NULL) goto cant_share_frames_refs;
+		*references = 1;
+		text_section->frames_refs_references = references;
+	}
+	if (text_section->frames_index_references == NULL &&
+	    id_index_ready(&text_section->frames_index)) {
+		uint32_t * __restrict const references =
+			allocate_durable_memory(sizeof(uint32_t));
+		if (references == NULL) goto cant_share_frames_refs;
+		*references = 1;
+		text_section->frames_index_references = references;
+	}
+
+	snapshot = allocate_durable_memory(sizeof(struct armv7_text_section));
+	if (snapshot == NULL) goto cant_allocate_snapshot;
+
+	/* Snapshots only read the addresses stored in the frames */
+	text_section_place_frames(text_section);
+	*snapshot = *text_section;
+	snapshot->laid_out = 0;
+	snapshot->frames_sizes.nodes = NULL;
+	snapshot->frames_sizes.n = 0;
+	snapshot->frames_sizes.max = 0;
+	snapshot->snapshots = text_section->snapshots;
+	snapshot->snapshot_of = text_section;
+	__atomic_add_fetch(
+		text_section->frames_refs_references, 1, __ATOMIC_ACQ_REL
+	);
+	if (text_section->frames_index_references != NULL)
+		__atomic_add_fetch(
+			text_section->frames_index_references, 1, __ATOMIC_ACQ_REL
+		);
+
+	/* Frames modified from now on are kept for the snapshot */
+	text_section->snapshots = snapshot;
+	text_section->epoch += 1;
+
+cant_allocate_snapshot:
+cant_share_frames_refs:
+not_a_live_section:
+	return snapshot;
+}
+
+/* Free the states of the frame that no snapshot can reach anymore.
+ * Snapshots walk the versions from the newest one, and stop at the
+ * first one they show. Everything older than what the oldest snapshot
+ * shows is never walked. */
+static void frame_forget_versions_older_than
+(struct armv7_text_frame * __restrict const frame,
+ uint32_t const oldest_epoch)
+{
+	struct armv7_text_frame_version * __restrict * __restrict cut =
+		&frame->versions;
+	if (frame->live_since > oldest_epoch) {
+		while (*cut != NULL && (*cut)->since > oldest_epoch)
+			cut = &(*cut)->older;
+		if (*cut != NULL) cut = &(*cut)->older;
+	}
+
+	struct armv7_text_frame_version * __restrict version = *cut;
+	*cut = NULL;
+	while (version != NULL) {
+		struct armv7_text_frame_version * __restrict const older =
+			version->older;
+		frame_release_version(version);
+		version = older;
+	}
+}
+
+void free_armv7_text_section_snapshot
+(struct armv7_text_section * __restrict const snapshot)
+{
+	struct armv7_text_section * __restrict const live =
+		snapshot->snapshot_of;
+	if (live == NULL) goto not_a_snapshot;
+
+	struct armv7_text_section * __restrict * __restrict link =
+		&live->snapshots;
+	while (*link != snapshot) link = &(*link)->snapshots;
+	*link = snapshot->snapshots;
+
+	/* Without snapshots, every previous state can go */
+	uint32_t oldest_epoch = live->epoch;
+	for (struct armv7_text_section const * __restrict other = live->snapshots;
+	     other != NULL;
+	     other = other->snapshots)
+		oldest_epoch = other->epoch;
+
+	for (uint32_t f = 0; f < live->n_frames_refs; f++)
+		frame_forget_versions_older_than(live->frames_refs[f], oldest_epoch);
+
+	uint32_t * __restrict const references = snapshot->frames_refs_references;
+	if (__atomic_sub_fetch(references, 1, __ATOMIC_ACQ_REL) == 0) {
+		free_durable_memory(snapshot->frames_refs);
+		free_durable_memory(references);
+	}
+
+	uint32_t * __restrict const index_references =
+		snapshot->frames_index_references;
+	if (index_references != NULL &&
+	    __atomic_sub_fetch(index_references, 1, __ATOMIC_ACQ_REL) == 0) {
+		id_index_free(&snapshot->frames_index);
+		free_durable_memory(index_references);
+	}
+	free_durable_memory(snapshot);
+
+not_a_snapshot:
+	return;
+}
+
+struct armv7_frames_pool * armv7_text_section_frames_pool
+(struct armv7_text_section * __restrict const text_section)
+{
+	if (text_section->frames_pool == NULL)
+		text_section->frames_pool = generate_armv7_frames_pool();
+	return text_section->frames_pool;
+}
+
+void free_armv7_frames_pool
+(struct armv7_frames_pool * __restrict const pool)
+{
+	for (uint32_t f = 0; f < pool->n_frames; f++) {
+		struct armv7_text_frame * __restrict const frame = pool->frames[f];
+		struct armv7_text_frame_version * __restrict version =
+			frame->versions;
+		while (version != NULL) {
+			struct armv7_text_frame_version * __restrict const older =
+				version->older;
+			frame_release_version(version);
+			version = older;
+		}
+		frame_release_chunks(frame);
+		free_durable_memory(frame->code.words);
+		free_durable_memory(frame->code.fixups);
+	}
+
+	slabs_free(&pool->slabs);
+	free_durable_memory(pool->frames);
+	free_durable_memory(pool);
+}
+
+void free_armv7_text_section
+(struct armv7_text_section * __restrict const text_section)
+{
+	if (text_section->snapshot_of != NULL || text_section->snapshots != NULL)
+		goto has_snapshots;
+
+	/* Without snapshots, nothing is shared anymore */
+	free_durable_memory(text_section->frames_refs);
+	free_durable_memory(text_section->frames_refs_references);
+	id_index_free(&text_section->frames_index);
+	free_durable_memory(text_section->frames_index_references);
+	fenwick_free(&text_section->frames_sizes);
+	if (text_section->frames_pool != NULL)
+		free_armv7_frames_pool(text_section->frames_pool);
+	free_durable_memory(text_section);
+
+has_snapshots:
+	return;
 }
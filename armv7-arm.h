@@ -4,6 +4,9 @@
 #include <stdint.h>
 #include <sections/data.h>
 #include <sections/text.h>
+#include <sections/references.h>
+#include <helpers/slabs.h>
+#include <helpers/fenwick.h>
 
 enum arm_register {
 	r0, r1, r2, r3, r4, r5, r6, r7, r8, r9, r10, r11, r12, r13, r14, r15,
@@ -55,15 +58,25 @@ struct parameters {
 
 #define MAX_ARGS 3
 
-struct instruction_args_infos {
-	enum argument_type type;
-	int32_t value;
-};
-
+/* Instructions fit in 16 bytes, instead of 28 with the enums stored
+ * as-is. The mnemonic and the arguments types are stored on one byte,
+ * after the values, so that every field stays naturally aligned.
+ * The values are kept on 32 bits, since they can be data symbols or
+ * frames IDs.
+ * needs_layout is set when one of the arguments is resolved from the
+ * data or text layout. It is maintained by instruction_mnemonic_id and
+ * instruction_arg : the frames encode the other instructions without
+ * resolving anything, once, and keep their code across writes. */
 struct instruction_representation {
-	enum known_instructions mnemonic_id;
-	struct instruction_args_infos args[MAX_ARGS];
+	int32_t values[MAX_ARGS];
+	uint8_t types[MAX_ARGS]; // enum argument_type
+	uint8_t mnemonic_id:7; // enum known_instructions
+	uint8_t needs_layout:1;
 };
+_Static_assert(
+	sizeof(struct instruction_representation) == 16,
+	"Instructions are expected to fit in 16 bytes"
+);
 
 struct instructions {
 	unsigned int n;
@@ -74,9 +87,114 @@ typedef unsigned int address;
 typedef int32_t relative_address;
 typedef int32_t immediate;
 
+struct armv7_text_section;
+struct armv7_text_frame_version;
+struct armv7_frames_pool;
+
+/* Frames instructions are stored in chunks that never move.
+ * The first chunk holds first_chunk instructions, and each chunk added
+ * when the frame grows holds as many instructions as all the previous
+ * ones : chunks[k] holds first_chunk << k instructions. */
+#define ARMV7_FRAME_MAX_CHUNKS 24
+
+/* The instructions referring to frames or data symbols, in the code
+ * of a frame. When the addresses they refer to move, only the fields
+ * of the argument referring to them are patched : base is the
+ * instruction encoded with that argument set to 0, and the argument
+ * fields are ORed to it.
+ * Instructions with several such arguments, or whose argument can flip
+ * the instruction when negative, are encoded again as a whole. arg is
+ * ARMV7_FIXUP_WHOLE_INSTRUCTION then, and kinds may have both bits. */
+#define ARMV7_FIXUP_FRAMES 1
+#define ARMV7_FIXUP_DATA 2
+#define ARMV7_FIXUP_WHOLE_INSTRUCTION 0xff
+struct armv7_fixup {
+	uint32_t instruction;
+	uint32_t base;
+	/* The frame or data symbol ID */
+	int32_t target;
+	uint8_t mnemonic_id; // enum known_instructions
+	uint8_t type; // enum argument_type
+	uint8_t arg;
+	uint8_t kinds;
+};
+
+/* The machine code of a frame, as encoded the last time its section
+ * was written, and what it depended on at that time */
+struct armv7_frame_code_cache {
+	uint32_t * words;
+	uint32_t n_words;
+	uint32_t max_words;
+	struct armv7_fixup * fixups;
+	uint32_t n_fixups;
+	uint32_t max_fixups;
+	uint32_t address;
+	/* The addresses versions of the sections used for the encoding */
+	uint32_t frames_version;
+	uint32_t data_version;
+	struct armv7_text_section const * text_section;
+	struct data_section const * data_section;
+	uint8_t valid;
+	uint8_t uses_frames;
+	uint8_t uses_data;
+};
+
 struct armv7_text_frame {
 	struct text_frame_metadata metadata;
+	/* The first chunk */
 	struct instruction_representation * instructions;
+	/* The next chunks. NULL until the frame grows. */
+	struct instruction_representation ** chunks;
+	uint32_t first_chunk;
+	/* When set, the arguments referring to data symbols or frames,
+	 * modified through the frame_instruction_* functions, are
+	 * recorded there */
+	struct references_index * references;
+	/* The section the frame was added to. The frame is in its current
+	 * state since the epoch live_since of that section. Its previous
+	 * states still shown by snapshots are kept in versions, newest
+	 * first. */
+	struct armv7_text_section * section;
+	uint32_t live_since;
+	struct armv7_text_frame_version * versions;
+	/* Counts the chunks copied for the versions, before modifying
+	 * them in the frame */
+	uint32_t kept_chunks;
+	/* The pool the frame was carved from. NULL for frames allocated
+	 * on their own. */
+	struct armv7_frames_pool * pool;
+	/* Reused by armv7_text_section_write_at while the frame, and the
+	 * addresses it refers to, don't change. */
+	struct armv7_frame_code_cache code;
+};
+
+/* The versions share the chunks of the frame until the frame modifies
+ * them. The chunks copied then belong to the newest version sharing
+ * them, and are shared by the older ones.
+ * Bit 0 of owned_chunks stands for the first chunk, bit k+1 for
+ * chunks[k]. */
+struct armv7_text_frame_version {
+	struct armv7_text_frame frame;
+	uint32_t since;
+	uint32_t owned_chunks;
+	struct armv7_text_frame_version * older;
+};
+
+/* Frames, and their instructions arrays, carved out of slabs.
+ * Instructions chunks come in size classes, from 8 to 128 instructions,
+ * and the chunks of the states pruned from snapshots are reused through
+ * a free list per class. Bigger chunks use the durable memory.
+ * Everything is released at once by free_armv7_frames_pool. */
+#define ARMV7_FRAMES_POOL_MIN_INSTRUCTIONS 8
+#define ARMV7_FRAMES_POOL_MAX_INSTRUCTIONS 128
+#define ARMV7_FRAMES_POOL_CLASSES 5
+
+struct armv7_frames_pool {
+	struct slabs slabs;
+	struct instruction_representation * free_arrays[ARMV7_FRAMES_POOL_CLASSES];
+	struct armv7_text_frame ** frames;
+	uint32_t n_frames;
+	uint32_t max_frames;
 };
 
 struct armv7_text_frames {
@@ -91,6 +209,35 @@ struct armv7_text_section {
 	uint32_t max_frames_refs;
 	uint32_t base_address;
 	struct armv7_text_frame ** frames_refs;
+	/* Live section : increased by each snapshot.
+	 * Snapshot : the epoch of the live section it shows. */
+	uint32_t epoch;
+	/* Live section : its snapshots, newest first.
+	 * Snapshot : the next older snapshot. */
+	struct armv7_text_section * snapshots;
+	/* The live section of a snapshot. NULL for the live section. */
+	struct armv7_text_section * snapshot_of;
+	/* When set, frames_refs is shared between the live section and
+	 * its snapshots, and this counts them. */
+	uint32_t * frames_refs_references;
+	/* Frame ID -> index in frames_refs. Searched linearly when not
+	 * ready. Shared with the snapshots like frames_refs, and copied
+	 * before the next frame addition. */
+	struct id_index frames_index;
+	uint32_t * frames_index_references;
+	/* Generated on demand, and released with the section */
+	struct armv7_frames_pool * frames_pool;
+	/* Increased every time a frame moves or is added */
+	uint32_t addresses_version;
+	/* The frames sizes, in bytes. Not ready for snapshots. */
+	struct fenwick frames_sizes;
+	/* Set by armv7_text_section_rebase_at : the frames are placed one
+	 * after the other from base_address, their addresses being
+	 * computed from frames_sizes. Their base_address is only updated
+	 * when needed : before writing the section, taking a snapshot, or
+	 * moving one of the frames by hand, which clears this. Frames
+	 * encoded meanwhile compute their address from frames_sizes. */
+	unsigned int laid_out;
 };
 
 uint32_t op_add_immediate
@@ -114,6 +261,73 @@ uint32_t op_sub_immediate
 (enum arm_register dest, enum arm_register op1, immediate op2);
 uint32_t op_svc_immediate(immediate value);
 
+extern uint32_t (*op_functions[n_known_instructions])();
+
+struct args_values { unsigned int val0, val1, val2; };
+
+struct args_values get_values
+(struct data_section const * __restrict const symbols,
+ struct armv7_text_section const * __restrict const text_section,
+ struct instruction_representation const * __restrict const instruction,
+ unsigned int const pc);
+
+/* How each mnemonic is encoded, from its arguments values.
+ * Each field is ((value >> right_shift) & mask) << left_shift, unused
+ * fields having a 0 mask.
+ * When signed, a negative signed_arg value is complemented, or negated,
+ * and the negative_flip bits are flipped in the fixed bits : mov
+ * becomes mvn and add becomes sub, like the op_ functions do. */
+#define ARMV7_ENCODING_FIELDS 3
+struct armv7_encoding_field {
+	uint32_t mask;
+	uint8_t arg;
+	uint8_t right_shift;
+	uint8_t left_shift;
+};
+
+struct armv7_encoding {
+	uint32_t fixed;
+	uint32_t negative_flip;
+	uint8_t is_signed;
+	uint8_t signed_arg;
+	uint8_t negate;
+	struct armv7_encoding_field fields[ARMV7_ENCODING_FIELDS];
+};
+
+extern struct armv7_encoding const armv7_encodings[n_known_instructions];
+
+/* Same result as op_functions[mnemonic_id](values[0], ...) */
+uint32_t armv7_encode_values
+(enum known_instructions const mnemonic_id,
+ uint32_t const * __restrict const values);
+
+/* Encode n instructions of the same mnemonic, from their arguments
+ * values stored one array per argument : values[a][i] is the value
+ * of the argument a of the instruction i.
+ * Vectorized with SSE2, or AVX2 when the CPU running the code has it. */
+void armv7_encode_values_batch
+(enum known_instructions const mnemonic_id,
+ uint32_t const * __restrict const * __restrict const values,
+ uint32_t const n,
+ uint32_t * __restrict const output);
+
+/* Encode the instruction, resolving its symbols addresses like
+ * get_values does, pc being the address of the instruction */
+uint32_t armv7_encode_instruction
+(struct data_section const * __restrict const data_section,
+ struct armv7_text_section const * __restrict const text_section,
+ struct instruction_representation const * __restrict const instruction,
+ uint32_t const pc);
+
+/* Same as armv7_encode_instruction. Not found if the instruction refers
+ * to a data symbol that the section doesn't hold, like a deleted one,
+ * even if its ID slot has been reused since. */
+struct uint32_result armv7_encode_instruction_resolved
+(struct data_section const * __restrict const data_section,
+ struct armv7_text_section const * __restrict const text_section,
+ struct instruction_representation const * __restrict const instruction,
+ uint32_t const pc);
+
 uint32_t add_instruction
 (struct instructions * __restrict const instructions,
  enum known_instructions id, uint32_t const val0, uint32_t const val1,
@@ -130,6 +344,39 @@ uint32_t assemble_code
 struct armv7_text_frame * generate_armv7_text_frame
 (uint32_t (*id_generator)());
 
+struct armv7_frames_pool * generate_armv7_frames_pool();
+
+/* Release the pool, its frames and all their instructions, including
+ * the states kept for snapshots. */
+void free_armv7_frames_pool
+(struct armv7_frames_pool * __restrict const pool);
+
+/* Same as generate_armv7_text_frame, with room for
+ * expected_instructions, rounded up to the next size class.
+ * NULL if the frame cannot be allocated. */
+struct armv7_text_frame * generate_pooled_armv7_text_frame
+(struct armv7_frames_pool * __restrict const pool,
+ uint32_t (*id_generator)(),
+ uint32_t const expected_instructions);
+
+/* The address of the instruction stored at index in the frame.
+ * It stays the same when the frame grows, or is modified after a
+ * snapshot. */
+static inline struct instruction_representation * armv7_frame_instruction
+(struct armv7_text_frame const * __restrict const frame,
+ uint32_t const index)
+{
+	uint32_t const first = frame->first_chunk;
+	struct instruction_representation * __restrict instruction;
+	if (index < first) instruction = frame->instructions+index;
+	else {
+		unsigned int const k =
+			31 - __builtin_clz(index >> __builtin_ctz(first));
+		instruction = frame->chunks[k] + (index - (first << k));
+	}
+	return instruction;
+}
+
 struct armv7_add_instruction_status {
 	unsigned int added;
 	struct instruction_representation * address;
@@ -138,6 +385,10 @@ struct armv7_add_instruction_status {
 struct armv7_add_instruction_status frame_add_instruction
 (struct armv7_text_frame * __restrict const frame);
 
+/* These only get the instruction, not the frame holding it. The
+ * instructions of frames are modified through frame_instruction_* once
+ * the frame has been written, so that only the code of that frame is
+ * encoded again. */
 void instruction_mnemonic_id
 (struct instruction_representation * const instruction,
  enum known_instructions mnemonic_id);
@@ -148,6 +399,37 @@ void instruction_arg
  enum argument_type argument_type,
  uint32_t const value);
 
+/* Same as instruction_mnemonic_id and instruction_arg, for the
+ * instruction stored at instruction_index in the frame, keeping the
+ * frame references index up to date. */
+void frame_instruction_mnemonic_id
+(struct armv7_text_frame * __restrict const frame,
+ uint32_t const instruction_index,
+ enum known_instructions mnemonic_id);
+
+void frame_instruction_arg
+(struct armv7_text_frame * __restrict const frame,
+ uint32_t const instruction_index,
+ unsigned int const arg_index,
+ enum argument_type argument_type,
+ uint32_t const value);
+
+/* Encode the frame again the next time it is written.
+ * Modifications done through the frame_ functions already do this.
+ * Instructions of a written frame modified through their address need
+ * it. */
+void armv7_frame_invalidate_code
+(struct armv7_text_frame * __restrict const frame);
+
+/* Record every reference from the frame instructions in references,
+ * and keep recording them from now on.
+ * Passing NULL stops the recording. */
+void armv7_frame_track_references
+(struct armv7_text_frame * __restrict const frame,
+ struct references_index * __restrict const references);
+
+/* Returns the size of the code written, in bytes, or 0 if some
+ * instruction refers to a data symbol that the section doesn't hold */
 unsigned int armv7_frame_gen_machine_code
 (struct armv7_text_frame const * __restrict const frame,
  struct armv7_text_section const * __restrict const section,
@@ -157,9 +439,57 @@ unsigned int armv7_frame_gen_machine_code
 
 struct armv7_text_section * generate_armv7_text_section();
 
+/* The frames pool of the section, generated on the first call.
+ * Its frames are released with the section.
+ * NULL if the pool cannot be allocated. */
+struct armv7_frames_pool * armv7_text_section_frames_pool
+(struct armv7_text_section * __restrict const text_section);
+
+/* Release the section and its frames pool.
+ * Frames that were not generated from that pool are left untouched.
+ * Sections with snapshots, and snapshots, are not released. */
+void free_armv7_text_section
+(struct armv7_text_section * __restrict const text_section);
+
 unsigned int armv7_text_section_add_frame
 (struct armv7_text_section * __restrict const text_section,
- struct armv7_text_frame const * __restrict const frame);
+ struct armv7_text_frame * __restrict const frame);
+
+/* Insert the frame before the one stored at index, or at the end if
+ * there's none. Returns 0 if the frame cannot be inserted.
+ * Like removing frames, this costs O(n) in the number of frames : the
+ * following frames are shifted, and the frames index is rebuilt. Only
+ * the sizes of the following frames are summed again. */
+unsigned int armv7_text_section_insert_frame
+(struct armv7_text_section * __restrict const text_section,
+ struct armv7_text_frame * __restrict const frame,
+ uint32_t const index);
+
+/* Remove the frame stored at index from the section, without freeing
+ * it. Frames removed while snapshots show them must not be modified
+ * until these snapshots are freed.
+ * NULL if there's no frame at index. */
+struct armv7_text_frame * armv7_text_section_remove_frame
+(struct armv7_text_section * __restrict const text_section,
+ uint32_t const index);
+
+/* Take a snapshot of the section, showing its frames as they are now.
+ * The frames added later are not shown, and the instructions and
+ * addresses of the frames are kept as they are, for the snapshot,
+ * when they are modified later. Only the modified frames are kept,
+ * and only the chunks of instructions modified in place are copied.
+ * For this to work, the frames must be modified through the frame_*
+ * and armv7_frame_* functions, or through the address returned by
+ * frame_add_instruction, right after adding the instruction.
+ * Snapshots can be written from another thread while the section is
+ * modified, but must be taken and freed from the thread modifying the
+ * section. They cannot be modified.
+ * NULL if the snapshot cannot be allocated. */
+struct armv7_text_section * armv7_text_section_snapshot
+(struct armv7_text_section * __restrict const text_section);
+
+void free_armv7_text_section_snapshot
+(struct armv7_text_section * __restrict const snapshot);
 
 void armv7_frame_set_address
 (struct armv7_text_frame * __restrict const frame,
@@ -179,9 +509,26 @@ uint32_t text_section_frame_address
 (struct armv7_text_section const * __restrict const text_section,
  unsigned int const frame_id);
 
-void armv7_text_section_write_at
+/* The code of the frames of live sections is kept, and only encoded
+ * again when the frames change, or when the addresses they refer to
+ * move.
+ * Returns 0 if some instruction refers to a data symbol that the
+ * section doesn't hold. Everything is written anyway, with the
+ * addresses of such symbols set to 0. */
+unsigned int armv7_text_section_write_at
 (struct armv7_text_section const * __restrict const text_section,
  struct data_section const * __restrict const data_section,
  uint8_t * __restrict const output);
 
+/* Same as armv7_text_section_write_at, with the frames encoded by
+ * n_threads threads, including the calling one.
+ * Small frames are encoded in groups, and big frames in instructions
+ * ranges. The addresses of the data section are computed beforehand,
+ * and the sections must not be modified until it returns. */
+unsigned int armv7_text_section_write_at_in_parallel
+(struct armv7_text_section const * __restrict const text_section,
+ struct data_section const * __restrict const data_section,
+ uint8_t * __restrict const output,
+ unsigned int const n_threads);
+
 #endif
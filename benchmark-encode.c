@@ -0,0 +1,130 @@
+#include <armv7-arm.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Encoding through op_functions and get_values, compared to encoding
+ * through the armv7_encodings table, and to batches of the same
+ * mnemonic encoded with armv7_encode_values_batch.
+ * Usage : EncodeBenchmark [n_instructions] */
+
+static double now() {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static void fill_instructions(
+	struct instruction_representation * __restrict const instructions,
+	unsigned int const n_instructions)
+{
+	uint32_t seed = 12345;
+	for (unsigned int i = 0; i < n_instructions; i++) {
+		seed = seed * 1103515245 + 12345;
+		unsigned int const mnemonic_id = (seed >> 16) % n_known_instructions;
+		struct instruction_representation * __restrict const inst =
+			instructions+i;
+		inst->mnemonic_id = n_known_instructions;
+		instruction_mnemonic_id(inst, mnemonic_id);
+		for (unsigned int a = 0; a < MAX_ARGS; a++) {
+			seed = seed * 1103515245 + 12345;
+			/* Leave the symbols out : only the encoding is measured */
+			if (inst->types[a] != arg_condition &&
+			    inst->types[a] != arg_register &&
+			    inst->types[a] != arg_regmask)
+				inst->types[a] = arg_immediate;
+			inst->values[a] = (int32_t) seed >> (seed & 15);
+			/* op_add_immediate can't negate it */
+			if (inst->values[a] == INT32_MIN) inst->values[a] = 0;
+		}
+	}
+}
+
+int main(int argc, char ** argv) {
+	unsigned int const n_instructions =
+		(argc > 1) ? atoi(argv[1]) : 4000000;
+	unsigned int const repeats = 5;
+
+	struct instruction_representation * __restrict const instructions =
+		malloc(n_instructions * sizeof(struct instruction_representation));
+	uint32_t * __restrict const functions_code =
+		malloc(n_instructions * sizeof(uint32_t));
+	uint32_t * __restrict const table_code =
+		malloc(n_instructions * sizeof(uint32_t));
+	fill_instructions(instructions, n_instructions);
+
+	double start = now();
+	for (unsigned int r = 0; r < repeats; r++)
+		for (unsigned int i = 0; i < n_instructions; i++) {
+			struct args_values values =
+				get_values(NULL, NULL, instructions+i, 0);
+			functions_code[i] = op_functions[instructions[i].mnemonic_id](
+				values.val0, values.val1, values.val2
+			);
+		}
+	double const functions_time = (now() - start) / repeats;
+
+	start = now();
+	for (unsigned int r = 0; r < repeats; r++)
+		for (unsigned int i = 0; i < n_instructions; i++)
+			table_code[i] =
+				armv7_encode_instruction(NULL, NULL, instructions+i, 0);
+	double const table_time = (now() - start) / repeats;
+
+	int identical = (memcmp(
+		functions_code, table_code, n_instructions * sizeof(uint32_t)
+	) == 0);
+	printf("%u instructions\n", n_instructions);
+	printf("op_functions : %8.3f ms\n", functions_time * 1e3);
+	printf(
+		"table        : %8.3f ms, x%.2f\n",
+		table_time * 1e3, functions_time / table_time
+	);
+
+	/* The same values, all encoded as movw */
+	uint32_t * __restrict const columns_values =
+		malloc(MAX_ARGS * n_instructions * sizeof(uint32_t));
+	uint32_t const * columns[MAX_ARGS];
+	for (unsigned int a = 0; a < MAX_ARGS; a++) {
+		uint32_t * __restrict const column =
+			columns_values + a * n_instructions;
+		for (unsigned int i = 0; i < n_instructions; i++)
+			column[i] = instructions[i].values[a];
+		columns[a] = column;
+	}
+
+	start = now();
+	for (unsigned int r = 0; r < repeats; r++)
+		for (unsigned int i = 0; i < n_instructions; i++) {
+			uint32_t const values[MAX_ARGS] =
+				{columns[0][i], columns[1][i], columns[2][i]};
+			table_code[i] = armv7_encode_values(inst_movw_immediate, values);
+		}
+	double const run_time = (now() - start) / repeats;
+
+	start = now();
+	for (unsigned int r = 0; r < repeats; r++)
+		armv7_encode_values_batch(
+			inst_movw_immediate, columns, n_instructions, functions_code
+		);
+	double const batch_time = (now() - start) / repeats;
+
+	identical &= (memcmp(
+		functions_code, table_code, n_instructions * sizeof(uint32_t)
+	) == 0);
+	printf("movw run, table : %8.3f ms\n", run_time * 1e3);
+	printf(
+		"movw run, batch : %8.3f ms, x%.2f\n",
+		batch_time * 1e3, run_time / batch_time
+	);
+
+	free(columns_values);
+
+	free(instructions);
+	free(functions_code);
+	free(table_code);
+	if (!identical) printf("Encodings differ !\n");
+	return !identical;
+}
@@ -0,0 +1,122 @@
+#include <armv7-arm.h>
+#include <sections/data.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h> // sysconf
+
+/* Scaling of armv7_text_section_write_at_in_parallel, from 1 thread
+ * to every online core.
+ * Usage : WriteBenchmark [n_frames] [instructions_per_frame] */
+
+uint32_t id = 0;
+uint32_t id_generator() {
+	return id++;
+}
+
+static double now() {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static void fill_section(
+	struct armv7_text_section * __restrict const text_section,
+	struct data_section * __restrict const data_section,
+	unsigned int const n_frames,
+	unsigned int const n_instructions)
+{
+	uint8_t const word[4] = {1, 2, 3, 4};
+	uint32_t symbols[64];
+	for (unsigned int d = 0; d < 64; d++)
+		symbols[d] = data_section_add(
+			data_section, 4, sizeof(word), NULL, word
+		).id;
+
+	struct armv7_text_frame ** __restrict const frames =
+		malloc(n_frames * sizeof(struct armv7_text_frame *));
+	for (unsigned int f = 0; f < n_frames; f++) {
+		frames[f] = generate_armv7_text_frame(id_generator);
+		armv7_text_section_add_frame(text_section, frames[f]);
+	}
+
+	for (unsigned int f = 0; f < n_frames; f++) {
+		for (unsigned int i = 0; i < n_instructions; i++) {
+			struct instruction_representation * __restrict const inst =
+				frame_add_instruction(frames[f]).address;
+			switch (i % 3) {
+				case 0:
+					instruction_mnemonic_id(inst, inst_bl_address);
+					instruction_arg(inst, 0, arg_condition, cond_al);
+					instruction_arg(
+						inst, 1, arg_frame_address_pc_relative,
+						frames[(f * 7 + i) % n_frames]->metadata.id
+					);
+					break;
+				case 1:
+					instruction_mnemonic_id(inst, inst_movw_immediate);
+					instruction_arg(inst, 0, arg_register, r1);
+					instruction_arg(
+						inst, 1, arg_data_symbol_address_bottom16, symbols[i % 64]
+					);
+					break;
+				default:
+					instruction_mnemonic_id(inst, inst_add_immediate);
+					instruction_arg(inst, 0, arg_register, r0);
+					instruction_arg(inst, 1, arg_register, r0);
+					instruction_arg(inst, 2, arg_immediate, i & 0xff);
+			}
+		}
+	}
+	free(frames);
+
+	armv7_text_section_rebase_at(text_section, 0x10000);
+	data_section_set_base_address(data_section, 0x10000000);
+}
+
+int main(int argc, char ** argv) {
+	unsigned int const n_frames = (argc > 1) ? atoi(argv[1]) : 20000;
+	unsigned int const n_instructions = (argc > 2) ? atoi(argv[2]) : 100;
+	unsigned int const repeats = 5;
+	long const n_cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+	struct armv7_text_section * __restrict const text_section =
+		generate_armv7_text_section();
+	struct data_section * __restrict const data_section =
+		generate_data_section();
+	fill_section(text_section, data_section, n_frames, n_instructions);
+
+	uint32_t const size = armv7_text_section_size(text_section);
+	uint8_t * __restrict const serial = malloc(size);
+	uint8_t * __restrict const parallel = malloc(size);
+
+	double start = now();
+	for (unsigned int r = 0; r < repeats; r++)
+		armv7_text_section_write_at(text_section, data_section, serial);
+	double const serial_time = (now() - start) / repeats;
+	printf("%u frames, %u bytes\n", n_frames, size);
+	printf("serial      : %8.3f ms\n", serial_time * 1e3);
+
+	int identical = 1;
+	for (long threads = 1; threads <= n_cores; threads++) {
+		memset(parallel, 0, size);
+		start = now();
+		for (unsigned int r = 0; r < repeats; r++)
+			armv7_text_section_write_at_in_parallel(
+				text_section, data_section, parallel, threads
+			);
+		double const parallel_time = (now() - start) / repeats;
+		identical &= (memcmp(serial, parallel, size) == 0);
+		printf(
+			"%2ld thread(s) : %8.3f ms, x%.2f\n",
+			threads, parallel_time * 1e3, serial_time / parallel_time
+		);
+	}
+
+	free(serial);
+	free(parallel);
+	if (!identical) printf("Parallel output differs from serial output !\n");
+	return !identical;
+}
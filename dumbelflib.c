@@ -2,6 +2,8 @@
 // Own headers
 #include <dumbelflib.h>
 
+#include <helpers/numeric.h>
+
 // Standard libraries
 #include <elf.h>
 #include <stdint.h>
@@ -24,10 +26,13 @@ enum program_elements {
 	element_text_phdr,
 	element_data_phdr,
 	element_text_data,
+	element_rodata_data,
 	element_data_data,
 	element_empty_shdr,
 	element_text_shdr,
+	element_rodata_shdr,
 	element_data_shdr,
+	element_bss_shdr,
 	element_shstrtab_shdr,
 	element_shstrtab_data,
 	n_elements,
@@ -37,7 +42,7 @@ enum program_elements {
 	element_start_shdrs = element_empty_shdr
 };
 
-Elf32_Ehdr program_header = {
+static Elf32_Ehdr program_header = {
 	.e_ident     = {127, 69, 76, 70, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0},
 	.e_type      = ET_EXEC,
 	.e_machine   = EM_ARM,
@@ -50,11 +55,11 @@ Elf32_Ehdr program_header = {
 	.e_phentsize = sizeof(Elf32_Phdr),
 	.e_phnum     = 2,
 	.e_shentsize = sizeof(Elf32_Shdr),
-	.e_shnum     = 4,
-	.e_shstrndx  = 3,
+	.e_shnum     = 6,
+	.e_shstrndx  = 5,
 };
 
-Elf32_Phdr text_header = {
+static Elf32_Phdr text_header = {
 	.p_type   = PT_LOAD,
 	.p_offset = 0,
 	.p_vaddr  = 0,
@@ -65,7 +70,7 @@ Elf32_Phdr text_header = {
 	.p_align  = 0x1000
 };
 
-Elf32_Phdr data_header = {
+static Elf32_Phdr data_header = {
 	.p_type   = PT_LOAD,
 	.p_offset = 0,
 	.p_vaddr  = 0,
@@ -76,8 +81,8 @@ Elf32_Phdr data_header = {
 	.p_align  = 0x1000
 };
 
-Elf32_Shdr empty_section = {0};
-Elf32_Shdr text_shdr = {
+static Elf32_Shdr empty_section = {0};
+static Elf32_Shdr text_shdr = {
 	.sh_name  = 1,
 	.sh_type  = SHT_PROGBITS,
 	.sh_flags = SHF_ALLOC | SHF_EXECINSTR,
@@ -88,7 +93,18 @@ Elf32_Shdr text_shdr = {
 	.sh_addralign = 4,
 	.sh_entsize = 0
 };
-Elf32_Shdr data_shdr = {
+static Elf32_Shdr rodata_shdr = {
+	.sh_name      = 28,
+	.sh_type      = SHT_PROGBITS,
+	.sh_flags     = SHF_ALLOC,
+	.sh_addr      = 0,
+	.sh_offset    = 0,
+	.sh_size      = 0,
+	.sh_info      = 0,
+	.sh_addralign = 1,
+	.sh_entsize   = 0
+};
+static Elf32_Shdr data_shdr = {
 	.sh_name      = 7,
 	.sh_type      = SHT_PROGBITS,
 	.sh_flags     = SHF_ALLOC | SHF_WRITE,
@@ -99,7 +115,18 @@ Elf32_Shdr data_shdr = {
 	.sh_addralign = 1,
 	.sh_entsize   = 0
 };
-Elf32_Shdr shstrtab_section = {
+static Elf32_Shdr bss_shdr = {
+	.sh_name      = 23,
+	.sh_type      = SHT_NOBITS,
+	.sh_flags     = SHF_ALLOC | SHF_WRITE,
+	.sh_addr      = 0,
+	.sh_offset    = 0,
+	.sh_size      = 0,
+	.sh_info      = 0,
+	.sh_addralign = 1,
+	.sh_entsize   = 0
+};
+static Elf32_Shdr shstrtab_section = {
 	.sh_name = 13,
 	.sh_type = SHT_STRTAB,
 	.sh_addralign = 1,
@@ -108,10 +135,10 @@ Elf32_Shdr shstrtab_section = {
 typedef uint32_t offset;
 
 static uint8_t scratch_space[10000];
-uint8_t section_names[] = { "\0.text\0.data\0.shstrtab\0" };
-offset glbl_offsets[n_elements] = {0};
+static uint8_t section_names[] = { "\0.text\0.data\0.shstrtab\0.bss\0.rodata\0" };
+static offset glbl_offsets[n_elements] = {0};
 
-uint32_t write_data
+static uint32_t write_data
 (uint8_t * __restrict const storage,
  uint32_t storage_offset,
  void const * __restrict const data,
@@ -133,6 +160,16 @@ static uint32_t add_binary_data
 	);
 }
 
+/* Zeros up to the next multiple of alignment */
+static uint32_t pad_binary_data
+(uint32_t storage_offset,
+ uint32_t const alignment)
+{
+	uint32_t const padded_offset = round_to(storage_offset, alignment);
+	memset(scratch_space+storage_offset, 0, padded_offset - storage_offset);
+	return padded_offset;
+}
+
 static uint32_t prepare_machine_code_section
 (enum program_elements element,
  uint32_t storage_offset,
@@ -156,6 +193,18 @@ static uint32_t write_data_section
 	return storage_offset+bytes_written;
 }
 
+static uint32_t write_rodata_section
+(enum program_elements element,
+ uint32_t storage_offset,
+ struct data_section const * __restrict const data_section)
+{
+	glbl_offsets[element] = storage_offset;
+	uint32_t bytes_written = write_data_section_read_only_content(
+		data_section, scratch_space+storage_offset
+	);
+	return storage_offset+bytes_written;
+}
+
 static void setup_text_sections
 (uint8_t * __restrict const elf_binary_data,
  offset const * __restrict const offsets,
@@ -197,6 +246,31 @@ static void setup_text_sections
 	armv7_text_section_rebase_at(text_section, virtual_text_offset);
 }
 
+/* The read-only data follow the code, in the same segment, so that
+ * they're shared between processes and don't need their own mapping */
+static void setup_rodata_sections
+(uint8_t * __restrict const elf_binary_data,
+ offset const * __restrict const offsets,
+ uint32_t const text_base_addr,
+ struct data_section * __restrict const data_infos)
+{
+	uint32_t const rodata_size = data_section_read_only_size(data_infos);
+	offset const physical_rodata_offset = offsets[element_rodata_data];
+	offset const rodata_end_offset = physical_rodata_offset+rodata_size;
+
+	Elf32_Phdr * text_phdr =
+		(Elf32_Phdr *) (elf_binary_data+offsets[element_text_phdr]);
+	text_phdr->p_memsz  = rodata_end_offset;
+	text_phdr->p_filesz = rodata_end_offset;
+
+	Elf32_Shdr * rodata_shdr =
+		(Elf32_Shdr *) (elf_binary_data+offsets[element_rodata_shdr]);
+	rodata_shdr->sh_addr   = text_base_addr + physical_rodata_offset;
+	rodata_shdr->sh_offset = physical_rodata_offset;
+	rodata_shdr->sh_size   = rodata_size;
+	rodata_shdr->sh_addralign = data_section_read_only_align(data_infos);
+}
+
 static void setup_data_sections
 (uint8_t * __restrict const elf_binary_data,
  offset const * __restrict const offsets,
@@ -206,22 +280,39 @@ static void setup_data_sections
 	offset const physical_data_offset = offsets[element_data_data];
 	offset const virtual_data_offset =
 		data_base_addr+physical_data_offset;
+	data_section_set_base_address(data_infos, virtual_data_offset);
 	uint32_t data_size = data_section_size(data_infos);
-	data_infos->base_address = virtual_data_offset;
+	/* Zero-filled symbols are only reserved in memory, after the
+	 * written data, from their largest alignment */
+	uint32_t bss_size = data_section_zero_fill_size(data_infos);
+	uint32_t const bss_align = data_section_zero_fill_align(data_infos);
+	uint32_t const bss_padding =
+		round_to(virtual_data_offset + data_size, bss_align) -
+		(virtual_data_offset + data_size);
 	
 	Elf32_Phdr * dh =
 		(Elf32_Phdr *) (elf_binary_data+offsets[element_data_phdr]);
 	dh->p_offset = physical_data_offset;
 	dh->p_vaddr  = virtual_data_offset;
 	dh->p_paddr  = virtual_data_offset;
-	dh->p_memsz  = data_size;
+	dh->p_memsz  = data_size + bss_size;
 	dh->p_filesz = data_size;
+	// Nothing writable. No need to map anything.
+	if (data_size + bss_size == 0) dh->p_type = PT_NULL;
 	
 	Elf32_Shdr * dsh =
 		(Elf32_Shdr *) (elf_binary_data+offsets[element_data_shdr]);
 	dsh->sh_offset = physical_data_offset;
 	dsh->sh_addr   = virtual_data_offset;
 	dsh->sh_size = data_size;
+	dsh->sh_addralign = data_section_align(data_infos);
+
+	Elf32_Shdr * bsh =
+		(Elf32_Shdr *) (elf_binary_data+offsets[element_bss_shdr]);
+	bsh->sh_offset = physical_data_offset + data_size + bss_padding;
+	bsh->sh_addr   = virtual_data_offset + data_size + bss_padding;
+	bsh->sh_size   = bss_size - bss_padding;
+	bsh->sh_addralign = bss_align;
 }
 
 void dumbelflib_build_armv7_program
@@ -247,9 +338,26 @@ void dumbelflib_build_armv7_program
 	bytes_written = prepare_machine_code_section(
 		element_text_data, bytes_written, text_section
 	);
+	bytes_written = pad_binary_data(
+		bytes_written, data_section_read_only_align(data_section)
+	);
+	data_section_set_read_only_base_address(
+		data_section, CODE_BASE_ADDR+bytes_written
+	);
+	bytes_written = write_rodata_section(
+		element_rodata_data, bytes_written, data_section
+	);
+	bytes_written = pad_binary_data(
+		bytes_written, data_section_align(data_section)
+	);
+	/* The padding between symbols depends on the base address */
+	data_section_set_base_address(
+		data_section, DATA_BASE_ADDR+bytes_written
+	);
 	bytes_written = write_data_section(
 		element_data_data, bytes_written, data_section
 	);
+	bytes_written = pad_binary_data(bytes_written, 4);
 	bytes_written = add_binary_data(
 		element_empty_shdr, bytes_written,
 		&empty_section, sizeof(empty_section)
@@ -258,10 +366,18 @@ void dumbelflib_build_armv7_program
 		element_text_shdr, bytes_written,
 		&text_shdr, sizeof(text_shdr)
 	);
+	bytes_written = add_binary_data(
+		element_rodata_shdr, bytes_written,
+		&rodata_shdr, sizeof(rodata_shdr)
+	);
 	bytes_written = add_binary_data(
 		element_data_shdr, bytes_written,
 		&data_shdr, sizeof(data_shdr)
 	);
+	bytes_written = add_binary_data(
+		element_bss_shdr, bytes_written,
+		&bss_shdr, sizeof(bss_shdr)
+	);
 	bytes_written = add_binary_data(
 		element_shstrtab_shdr, bytes_written,
 		&shstrtab_section, sizeof(shstrtab_section)
@@ -279,6 +395,9 @@ void dumbelflib_build_armv7_program
 		scratch_space, glbl_offsets,
 		CODE_BASE_ADDR, text_section
 	);
+	setup_rodata_sections(
+		scratch_space, glbl_offsets, CODE_BASE_ADDR, data_section
+	);
 	setup_data_sections(
 		scratch_space, glbl_offsets, DATA_BASE_ADDR, data_section
 	);
@@ -2,6 +2,7 @@
 #include <elf.h>
 #include <armv7-arm.h>
 #include <sections/data.h>
+#include <dumbelflib.h>
 
 #include <string.h>
 
@@ -349,8 +350,8 @@ static void setup_data_sections
 	offset const physical_data_offset = offsets[element_data_data];
 	offset const virtual_data_offset =
 		data_base_addr+physical_data_offset;
+	data_section_set_base_address(data_infos, virtual_data_offset);
 	uint32_t data_size = data_section_size(data_infos);
-	data_infos->base_address = virtual_data_offset;
 	
 	Elf32_Phdr * dh =
 		(Elf32_Phdr *) (elf_binary_data+offsets[element_data_phdr]);
@@ -443,6 +444,145 @@ void build_program
 	}
 }
 
+static uint8_t built_program[20000];
+
+static Elf32_Shdr built_section_header
+(uint8_t const * __restrict const program,
+ char const * __restrict const name)
+{
+	Elf32_Ehdr header;
+	Elf32_Shdr section, names_section;
+	memcpy(&header, program, sizeof(header));
+	memcpy(
+		&names_section,
+		program + header.e_shoff + header.e_shstrndx * sizeof(Elf32_Shdr),
+		sizeof(names_section)
+	);
+	for (unsigned int s = 0; s < header.e_shnum; s++) {
+		memcpy(
+			&section, program + header.e_shoff + s * sizeof(Elf32_Shdr),
+			sizeof(section)
+		);
+		char const * __restrict const section_name = (char const *)
+			(program + names_section.sh_offset + section.sh_name);
+		if (strcmp(section_name, name) == 0) return section;
+	}
+	assert(0);
+	return section;
+}
+
+static Elf32_Phdr built_program_header
+(uint8_t const * __restrict const program,
+ uint32_t const flags)
+{
+	Elf32_Ehdr header;
+	Elf32_Phdr segment;
+	memcpy(&header, program, sizeof(header));
+	for (unsigned int p = 0; p < header.e_phnum; p++) {
+		memcpy(
+			&segment, program + header.e_phoff + p * sizeof(Elf32_Phdr),
+			sizeof(segment)
+		);
+		if (segment.p_flags == flags) return segment;
+	}
+	assert(0);
+	return segment;
+}
+
+static void build_dumbelflib_program
+(struct data_section * __restrict const data_section,
+ struct armv7_text_section * __restrict const text_section)
+{
+	dumbelflib_build_armv7_program(
+		data_section, text_section, "dumbelflib-executable"
+	);
+	int fd = open("dumbelflib-executable", O_RDONLY);
+	assert(fd != -1);
+	ssize_t const program_size =
+		read(fd, built_program, sizeof(built_program));
+	close(fd);
+	assert(program_size > 0 && program_size < (ssize_t) sizeof(built_program));
+}
+
+/* The zero-filled symbols are written as a NOBITS .bss, taking memory
+ * after the data, but no space in the file */
+void test_dumbelflib_zero_fill() {
+	struct data_section * const data_section = generate_data_section();
+	struct armv7_text_section * const text_section =
+		generate_armv7_text_section();
+	prepare_test_code_and_data(data_section, text_section);
+	uint8_t name[] = "bss";
+	uint32_t const buffer =
+		data_section_add_zero_fill(data_section, 16, 64 << 20, name).id;
+	assert(data_section_add_zero_fill(data_section, 4, 10, name).added);
+
+	build_dumbelflib_program(data_section, text_section);
+
+	Elf32_Shdr const data = built_section_header(built_program, ".data");
+	Elf32_Shdr const bss = built_section_header(built_program, ".bss");
+	Elf32_Phdr const segment = built_program_header(built_program, PF_W | PF_R);
+	assert(bss.sh_type == SHT_NOBITS);
+	assert(bss.sh_addralign == 16);
+	assert(bss.sh_addr % 16 == 0);
+	assert(bss.sh_size >= (64 << 20) + 10);
+	assert(data_address(data_section, buffer) == bss.sh_addr);
+
+	/* Only the data are in the file */
+	assert(segment.p_filesz == data.sh_size);
+	assert(segment.p_offset + segment.p_filesz == data.sh_offset + data.sh_size);
+	assert(segment.p_memsz - segment.p_filesz ==
+	       data_section_zero_fill_size(data_section));
+	assert(bss.sh_addr + bss.sh_size == segment.p_vaddr + segment.p_memsz);
+}
+
+/* The read-only symbols are written in a .rodata, mapped with the code
+ * by the R+X segment */
+void test_dumbelflib_read_only() {
+	struct data_section * const data_section = generate_data_section();
+	struct armv7_text_section * const text_section =
+		generate_armv7_text_section();
+	prepare_test_code_and_data(data_section, text_section);
+	uint8_t name[] = "rodata";
+	uint8_t message[] = "read only\n";
+	uint8_t const table[16] = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+	assert(data_section_add_read_only(
+		data_section, 1, sizeof(message), name, message
+	).added);
+	uint32_t const table_id = data_section_add_read_only(
+		data_section, 16, sizeof(table), name, table
+	).id;
+
+	build_dumbelflib_program(data_section, text_section);
+
+	Elf32_Shdr const text = built_section_header(built_program, ".text");
+	Elf32_Shdr const rodata = built_section_header(built_program, ".rodata");
+	Elf32_Shdr const data = built_section_header(built_program, ".data");
+	Elf32_Phdr const segment = built_program_header(built_program, PF_X | PF_R);
+	assert(rodata.sh_type == SHT_PROGBITS);
+	assert(rodata.sh_flags == SHF_ALLOC);
+	assert(rodata.sh_addralign == 16);
+	assert(rodata.sh_addr % 16 == 0);
+	assert(rodata.sh_addr >= text.sh_addr + text.sh_size);
+	assert(rodata.sh_size == data_section_read_only_size(data_section));
+	assert(data.sh_addralign == 4);
+	assert(data.sh_addr % 4 == 0);
+
+	/* Inside the code segment, in the memory and in the file */
+	assert(rodata.sh_addr >= segment.p_vaddr);
+	assert(rodata.sh_addr + rodata.sh_size <= segment.p_vaddr + segment.p_memsz);
+	assert(rodata.sh_offset + rodata.sh_size <= segment.p_offset + segment.p_filesz);
+	assert(rodata.sh_addr - segment.p_vaddr == rodata.sh_offset - segment.p_offset);
+
+	uint32_t const table_address = data_address(data_section, table_id);
+	assert(table_address % 16 == 0);
+	assert(
+		memcmp(
+			built_program + rodata.sh_offset + (table_address - rodata.sh_addr),
+			table, sizeof(table)
+		) == 0
+	);
+}
+
 int main() {
 	struct data_section * const data_section =
 		generate_data_section();
@@ -455,5 +595,7 @@ int main() {
 	     element < n_elements; element++) {
 		printf("%x\n", glbl_offsets[element]);
 	}
+	test_dumbelflib_zero_fill();
+	test_dumbelflib_read_only();
 	return 0;
 }
@@ -0,0 +1,23 @@
+#ifndef MYY_HELPERS_CPU_H
+#define MYY_HELPERS_CPU_H 1
+
+/* x86 builds compile the AVX2 kernels in any case, with this attribute
+ * on the functions using them, and pick them at runtime when the CPU
+ * supports them. The SSE2 kernels are part of the x86-64 baseline. */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CPU_AVX2_KERNELS 1
+#define CPU_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+static inline unsigned int cpu_supports_avx2()
+{
+#if defined(__AVX2__)
+	return 1;
+#elif defined(CPU_AVX2_KERNELS)
+	return __builtin_cpu_supports("avx2");
+#else
+	return 0;
+#endif
+}
+
+#endif
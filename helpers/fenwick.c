@@ -0,0 +1,75 @@
+#include <helpers/fenwick.h>
+#include <helpers/memory.h>
+
+static inline uint32_t lowbit(uint32_t const i)
+{
+	return i & -i;
+}
+
+unsigned int fenwick_init
+(struct fenwick * __restrict const fenwick,
+ uint32_t const expected_values)
+{
+	uint32_t const max = (expected_values > 0) ? expected_values : 1;
+	fenwick->nodes = allocate_durable_memory(max * sizeof(uint32_t));
+	fenwick->n     = 0;
+	fenwick->max   = (fenwick->nodes != NULL) ? max : 0;
+	return fenwick->nodes != NULL;
+}
+
+void fenwick_free
+(struct fenwick * __restrict const fenwick)
+{
+	free_durable_memory(fenwick->nodes);
+	fenwick->nodes = NULL;
+	fenwick->n     = 0;
+	fenwick->max   = 0;
+}
+
+uint32_t fenwick_prefix
+(struct fenwick const * __restrict const fenwick,
+ uint32_t const end)
+{
+	uint32_t const * __restrict const nodes = fenwick->nodes;
+	uint32_t sum = 0;
+	for (uint32_t i = end; i > 0; i -= lowbit(i)) sum += nodes[i-1];
+	return sum;
+}
+
+unsigned int fenwick_append
+(struct fenwick * __restrict const fenwick,
+ uint32_t const value)
+{
+	unsigned int appended = 1;
+	if (fenwick->n == fenwick->max) {
+		uint32_t const new_max = fenwick->max * 2;
+		uint32_t * __restrict const new_nodes = reallocate_durable_memory(
+			fenwick->nodes, new_max * sizeof(uint32_t)
+		);
+		appended = (new_nodes != NULL);
+		if (!appended) goto cant_grow;
+		fenwick->nodes = new_nodes;
+		fenwick->max   = new_max;
+	}
+
+	/* The new node also covers the values before it, down to its
+	 * lowest bit */
+	uint32_t const i = fenwick->n + 1;
+	fenwick->nodes[i-1] =
+		value +
+		fenwick_prefix(fenwick, i-1) - fenwick_prefix(fenwick, i - lowbit(i));
+	fenwick->n = i;
+
+cant_grow:
+	return appended;
+}
+
+void fenwick_add
+(struct fenwick * __restrict const fenwick,
+ uint32_t const index,
+ uint32_t const delta)
+{
+	uint32_t * __restrict const nodes = fenwick->nodes;
+	for (uint32_t i = index + 1; i <= fenwick->n; i += lowbit(i))
+		nodes[i-1] += delta;
+}
@@ -0,0 +1,74 @@
+#ifndef MYY_HELPERS_FENWICK_H
+#define MYY_HELPERS_FENWICK_H 1
+
+#include <stdint.h>
+#include <stddef.h> // NULL
+
+/* Fenwick tree of 32 bits values : each value can be modified, and the
+ * sum of the first values computed, in O(log n).
+ * Values can only be added at the end. Inserting or removing values
+ * elsewhere means truncating the tree there and appending the values
+ * that follow again.
+ * Sums wrap around like any uint32_t, so values can be lowered by
+ * adding their opposite.
+ * Like the id_index, a tree with no nodes allocated is considered
+ * "not ready", and users are expected to compute the sums themselves
+ * in that case. */
+
+struct fenwick {
+	/* nodes[i] is the sum of the values ]i+1 - lowbit(i+1), i] */
+	uint32_t * nodes;
+	uint32_t n;
+	uint32_t max;
+};
+
+unsigned int fenwick_init
+(struct fenwick * __restrict const fenwick,
+ uint32_t const expected_values);
+
+void fenwick_free
+(struct fenwick * __restrict const fenwick);
+
+static inline unsigned int fenwick_ready
+(struct fenwick const * __restrict const fenwick)
+{
+	return fenwick->nodes != NULL;
+}
+
+static inline void fenwick_clear
+(struct fenwick * __restrict const fenwick)
+{
+	fenwick->n = 0;
+}
+
+/* Drop the values from n on. The nodes of the values kept only cover
+ * values before them, so they stay as they are. */
+static inline void fenwick_truncate
+(struct fenwick * __restrict const fenwick,
+ uint32_t const n)
+{
+	if (n < fenwick->n) fenwick->n = n;
+}
+
+/* Returns 0 if the tree cannot grow */
+unsigned int fenwick_append
+(struct fenwick * __restrict const fenwick,
+ uint32_t const value);
+
+void fenwick_add
+(struct fenwick * __restrict const fenwick,
+ uint32_t const index,
+ uint32_t const delta);
+
+/* Sum of the values [0, end[ */
+uint32_t fenwick_prefix
+(struct fenwick const * __restrict const fenwick,
+ uint32_t const end);
+
+static inline uint32_t fenwick_total
+(struct fenwick const * __restrict const fenwick)
+{
+	return fenwick_prefix(fenwick, fenwick->n);
+}
+
+#endif
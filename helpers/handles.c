@@ -0,0 +1,185 @@
+#include <helpers/handles.h>
+#include <helpers/memory.h>
+
+/* Free slots indices hold the next free slot, with this bit set */
+#define HANDLES_FREE 0x80000000
+#define HANDLES_NO_FREE_SLOT HANDLES_SLOT_MASK
+
+static unsigned int handles_resolvable_index(uint32_t const index)
+{
+	return (index & HANDLES_FREE) == 0;
+}
+
+static unsigned int handles_free_entry(uint32_t const index)
+{
+	return (index & ~HANDLES_SLOT_MASK) == HANDLES_FREE;
+}
+
+unsigned int handles_init
+(struct handles * __restrict const handles,
+ uint32_t const expected_slots)
+{
+	uint32_t max_slots = 16;
+	while (max_slots < expected_slots) max_slots *= 2;
+
+	uint32_t * __restrict const indices =
+		allocate_durable_memory(max_slots * sizeof(uint32_t));
+	uint8_t * __restrict const generations =
+		allocate_durable_memory(max_slots * sizeof(uint8_t));
+
+	unsigned int const initialised = (indices != NULL && generations != NULL);
+	if (!initialised) goto cant_allocate_slots;
+
+	handles->indices     = indices;
+	handles->generations = generations;
+	handles->used        = 0;
+	handles->max_slots   = max_slots;
+	handles->free_slots  = HANDLES_NO_FREE_SLOT;
+	goto initialised;
+
+cant_allocate_slots:
+	free_durable_memory(indices);
+	free_durable_memory(generations);
+initialised:
+	return initialised;
+}
+
+void handles_free
+(struct handles * __restrict const handles)
+{
+	free_durable_memory(handles->indices);
+	free_durable_memory(handles->generations);
+	handles->indices     = NULL;
+	handles->generations = NULL;
+	handles->used        = 0;
+	handles->max_slots   = 0;
+	handles->free_slots  = HANDLES_NO_FREE_SLOT;
+}
+
+/* Make the slots [0, n_slots[ usable. The new ones are not here. */
+static unsigned int handles_use_up_to
+(struct handles * __restrict const handles,
+ uint32_t const n_slots)
+{
+	unsigned int usable = (n_slots <= HANDLES_MAX_SLOTS);
+	if (!usable) goto too_many_slots;
+	if (n_slots <= handles->used) goto already_usable;
+
+	if (n_slots > handles->max_slots) {
+		uint32_t new_max = handles->max_slots * 2;
+		while (new_max < n_slots) new_max *= 2;
+
+		uint32_t * __restrict const new_indices = reallocate_durable_memory(
+			handles->indices, new_max * sizeof(uint32_t)
+		);
+		usable = (new_indices != NULL);
+		if (!usable) goto cant_expand_slots;
+		handles->indices = new_indices;
+
+		uint8_t * __restrict const new_generations = reallocate_durable_memory(
+			handles->generations, new_max * sizeof(uint8_t)
+		);
+		usable = (new_generations != NULL);
+		if (!usable) goto cant_expand_slots;
+		handles->generations = new_generations;
+
+		handles->max_slots = new_max;
+	}
+
+	for (uint32_t s = handles->used; s < n_slots; s++) {
+		handles->indices[s] = HANDLES_NOT_HERE;
+		handles->generations[s] = 0;
+	}
+	handles->used = n_slots;
+
+cant_expand_slots:
+already_usable:
+too_many_slots:
+	return usable;
+}
+
+struct handle_created handles_create
+(struct handles * __restrict const handles,
+ uint32_t const index)
+{
+	struct handle_created handle = {
+		.created = 0,
+		.id = 0
+	};
+
+	uint32_t slot = handles->free_slots;
+	if (slot != HANDLES_NO_FREE_SLOT)
+		handles->free_slots = handles->indices[slot] & HANDLES_SLOT_MASK;
+	else {
+		slot = handles->used;
+		if (!handles_use_up_to(handles, slot + 1)) goto cant_add_slot;
+	}
+
+	handles->indices[slot] = index;
+	handle.created = 1;
+	handle.id = slot | (handles->generations[slot] << HANDLES_SLOT_BITS);
+
+cant_add_slot:
+	return handle;
+}
+
+unsigned int handles_adopt
+(struct handles * __restrict const handles,
+ uint32_t const id,
+ uint32_t const index)
+{
+	uint32_t const slot = handle_slot(id);
+	unsigned int const adopted = handles_use_up_to(handles, slot + 1);
+	if (adopted) {
+		handles->indices[slot] = index;
+		handles->generations[slot] = handle_generation(id);
+	}
+	return adopted;
+}
+
+struct handles_result handles_get
+(struct handles const * __restrict const handles,
+ uint32_t const id)
+{
+	uint32_t const slot = handle_slot(id);
+	struct handles_result result = {
+		.found = 0,
+		.index = HANDLES_NOT_HERE
+	};
+
+	if (slot < handles->used &&
+	    handles->generations[slot] == handle_generation(id) &&
+	    handles_resolvable_index(handles->indices[slot])) {
+		result.found = 1;
+		result.index = handles->indices[slot];
+	}
+
+	return result;
+}
+
+void handles_forget
+(struct handles * __restrict const handles,
+ uint32_t const id)
+{
+	if (handles_get(handles, id).found)
+		handles->indices[handle_slot(id)] = HANDLES_NOT_HERE;
+}
+
+void handles_release
+(struct handles * __restrict const handles,
+ uint32_t const id)
+{
+	uint32_t const slot = handle_slot(id);
+	if (slot >= handles->used ||
+	    handles->generations[slot] != handle_generation(id) ||
+	    handles_free_entry(handles->indices[slot]))
+		goto not_handed_out;
+
+	handles->generations[slot] =
+		(handles->generations[slot] + 1) & HANDLES_GENERATION_MASK;
+	handles->indices[slot] = HANDLES_FREE | handles->free_slots;
+	handles->free_slots = slot;
+
+not_handed_out:
+	return;
+}
@@ -0,0 +1,108 @@
+#ifndef MYY_HELPERS_HANDLES_H
+#define MYY_HELPERS_HANDLES_H 1
+
+#include <stdint.h>
+#include <stddef.h> // NULL
+
+/* Handle-style IDs : the low bits of an ID are a slot, the high bits
+ * are the generation of that slot when the ID was handed out.
+ * Each slot holds the index of the element it designates, so an ID is
+ * resolved with a bounds check and two array loads.
+ * Released slots are reused, after bumping their generation. IDs
+ * handed out before the release then stop resolving, until the
+ * generation wraps around.
+ *
+ * Slots can also be adopted : registering an ID handed out by another
+ * handles table. Sections sharing their IDs with subsections use this.
+ *
+ * Like the id_index, a table with no slots allocated is considered
+ * "not ready", and users are expected to fall back to a linear search.
+ */
+
+#define HANDLES_SLOT_BITS 24
+#define HANDLES_SLOT_MASK ((1u << HANDLES_SLOT_BITS) - 1)
+#define HANDLES_GENERATION_MASK 0xff
+/* The last slot is never handed out and ends the free list */
+#define HANDLES_MAX_SLOTS HANDLES_SLOT_MASK
+/* Index of the slots that are in use, but not by this table */
+#define HANDLES_NOT_HERE 0xffffffff
+
+struct handles {
+	uint32_t * indices;
+	uint8_t * generations;
+	uint32_t used;
+	uint32_t max_slots;
+	uint32_t free_slots;
+};
+
+struct handles_result {
+	unsigned int found;
+	uint32_t index;
+};
+
+struct handle_created {
+	unsigned int created;
+	uint32_t id;
+};
+
+static inline uint32_t handle_slot(uint32_t const id)
+{
+	return id & HANDLES_SLOT_MASK;
+}
+
+static inline uint32_t handle_generation(uint32_t const id)
+{
+	return id >> HANDLES_SLOT_BITS;
+}
+
+unsigned int handles_init
+(struct handles * __restrict const handles,
+ uint32_t const expected_slots);
+
+void handles_free
+(struct handles * __restrict const handles);
+
+static inline unsigned int handles_ready
+(struct handles const * __restrict const handles)
+{
+	return handles->indices != NULL;
+}
+
+/* Hand out a new ID designating index.
+ * Pass HANDLES_NOT_HERE to only reserve the ID. */
+struct handle_created handles_create
+(struct handles * __restrict const handles,
+ uint32_t const index);
+
+/* Make id designate index, whichever table handed it out.
+ * Returns 0 if the slots cannot be expanded. */
+unsigned int handles_adopt
+(struct handles * __restrict const handles,
+ uint32_t const id,
+ uint32_t const index);
+
+/* id must be resolvable */
+static inline void handles_set
+(struct handles * __restrict const handles,
+ uint32_t const id,
+ uint32_t const index)
+{
+	handles->indices[handle_slot(id)] = index;
+}
+
+struct handles_result handles_get
+(struct handles const * __restrict const handles,
+ uint32_t const id);
+
+/* Stop resolving id here, without reusing its slot.
+ * For adopted IDs. */
+void handles_forget
+(struct handles * __restrict const handles,
+ uint32_t const id);
+
+/* Stop resolving id and reuse its slot for the next IDs */
+void handles_release
+(struct handles * __restrict const handles,
+ uint32_t const id);
+
+#endif
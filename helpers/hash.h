@@ -0,0 +1,49 @@
+#ifndef MYY_HELPERS_HASH_H
+#define MYY_HELPERS_HASH_H 1
+
+#include <stdint.h>
+#include <string.h> // memcpy
+
+/* Non-cryptographic hash of a block of bytes.
+ * Reads 8 bytes at a time, multiplying and folding the 128 bits
+ * product, which is enough to spread similar contents across a hash
+ * table. */
+
+static inline uint64_t hash_mix(uint64_t const a, uint64_t const b)
+{
+	__uint128_t const product = (__uint128_t) a * b;
+	return (uint64_t) product ^ (uint64_t) (product >> 64);
+}
+
+static inline uint64_t hash_bytes
+(uint8_t const * __restrict const bytes,
+ uint32_t const size,
+ uint64_t const seed)
+{
+	uint64_t const k0 = 0xa0761d6478bd642fULL;
+	uint64_t const k1 = 0xe7037ed1a0b428dbULL;
+	uint64_t hash = seed ^ hash_mix(seed ^ k0, size ^ k1);
+
+	uint32_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t word;
+		memcpy(&word, bytes+i, 8);
+		hash = hash_mix(hash ^ word, k1);
+	}
+
+	if (i < size) {
+		uint64_t word = 0;
+		memcpy(&word, bytes+i, size - i);
+		hash = hash_mix(hash ^ word, k0);
+	}
+
+	return hash_mix(hash ^ (hash >> 29), k0 ^ size);
+}
+
+/* Fold a 64 bits hash into 32 bits, for 32 bits keyed tables */
+static inline uint32_t hash_fold32(uint64_t const hash)
+{
+	return (uint32_t) (hash ^ (hash >> 32));
+}
+
+#endif
@@ -0,0 +1,185 @@
+#include <helpers/id_index.h>
+#include <helpers/memory.h>
+
+#include <string.h> // memcpy
+
+static inline uint32_t id_index_hash(uint32_t const id)
+{
+	// Fibonacci hashing, since IDs are generally sequential
+	uint32_t hash = id * 0x9e3779b1;
+	return hash ^ (hash >> 16);
+}
+
+static void id_index_clean_slots
+(struct id_index_slot * __restrict const slots,
+ uint32_t const n_slots)
+{
+	for (uint32_t s = 0; s < n_slots; s++) {
+		slots[s].id    = 0;
+		slots[s].index = ID_INDEX_EMPTY_SLOT;
+	}
+}
+
+static uint32_t id_index_slot_of
+(struct id_index const * __restrict const id_index,
+ uint32_t const id)
+{
+	uint32_t const mask = id_index->mask;
+	struct id_index_slot const * __restrict const slots = id_index->slots;
+
+	uint32_t s = id_index_hash(id) & mask;
+	while (slots[s].index != ID_INDEX_EMPTY_SLOT && slots[s].id != id)
+		s = (s + 1) & mask;
+
+	return s;
+}
+
+unsigned int id_index_init
+(struct id_index * __restrict const id_index,
+ uint32_t const expected_ids)
+{
+	uint32_t n_slots = 16;
+	while (n_slots < expected_ids * 2) n_slots *= 2;
+
+	struct id_index_slot * __restrict const slots =
+		allocate_durable_memory(n_slots * sizeof(struct id_index_slot));
+
+	unsigned int initialised = (slots != NULL);
+	if (initialised) {
+		id_index_clean_slots(slots, n_slots);
+		id_index->slots = slots;
+		id_index->mask  = n_slots - 1;
+		id_index->used  = 0;
+	}
+
+	return initialised;
+}
+
+void id_index_free
+(struct id_index * __restrict const id_index)
+{
+	free_durable_memory(id_index->slots);
+	id_index->slots = NULL;
+	id_index->mask  = 0;
+	id_index->used  = 0;
+}
+
+unsigned int id_index_copy
+(struct id_index * __restrict const copy,
+ struct id_index const * __restrict const id_index)
+{
+	uint32_t const slots_size =
+		(id_index->mask + 1) * sizeof(struct id_index_slot);
+	struct id_index_slot * __restrict const slots =
+		allocate_durable_memory(slots_size);
+
+	unsigned int const copied = (slots != NULL);
+	if (copied) {
+		memcpy(slots, id_index->slots, slots_size);
+		copy->slots = slots;
+		copy->mask  = id_index->mask;
+		copy->used  = id_index->used;
+	}
+
+	return copied;
+}
+
+static unsigned int id_index_grow
+(struct id_index * __restrict const id_index)
+{
+	uint32_t const old_n_slots = id_index->mask + 1;
+	struct id_index_slot * __restrict const old_slots = id_index->slots;
+
+	uint32_t const new_n_slots = old_n_slots * 2;
+	struct id_index_slot * __restrict const new_slots =
+		allocate_durable_memory(new_n_slots * sizeof(struct id_index_slot));
+
+	if (new_slots == NULL) goto cant_allocate_new_slots;
+
+	id_index_clean_slots(new_slots, new_n_slots);
+	id_index->slots = new_slots;
+	id_index->mask  = new_n_slots - 1;
+
+	for (uint32_t s = 0; s < old_n_slots; s++) {
+		if (old_slots[s].index != ID_INDEX_EMPTY_SLOT)
+			new_slots[id_index_slot_of(id_index, old_slots[s].id)] =
+				old_slots[s];
+	}
+
+	free_durable_memory(old_slots);
+
+cant_allocate_new_slots:
+	return (new_slots != NULL);
+}
+
+unsigned int id_index_set
+(struct id_index * __restrict const id_index,
+ uint32_t const id,
+ uint32_t const index)
+{
+	unsigned int set = 0;
+
+	uint32_t s = id_index_slot_of(id_index, id);
+	if (id_index->slots[s].index == ID_INDEX_EMPTY_SLOT) {
+		if ((id_index->used + 1) * 2 > id_index->mask + 1) {
+			if (!id_index_grow(id_index)) goto cant_grow_index;
+			s = id_index_slot_of(id_index, id);
+		}
+		id_index->used += 1;
+	}
+
+	id_index->slots[s].id    = id;
+	id_index->slots[s].index = index;
+	set = 1;
+
+cant_grow_index:
+	return set;
+}
+
+struct id_index_result id_index_get
+(struct id_index const * __restrict const id_index,
+ uint32_t const id)
+{
+	uint32_t const index =
+		id_index->slots[id_index_slot_of(id_index, id)].index;
+
+	struct id_index_result const result = {
+		.found = (index != ID_INDEX_EMPTY_SLOT),
+		.index = index
+	};
+
+	return result;
+}
+
+void id_index_remove
+(struct id_index * __restrict const id_index,
+ uint32_t const id)
+{
+	uint32_t const mask = id_index->mask;
+	struct id_index_slot * __restrict const slots = id_index->slots;
+
+	uint32_t hole = id_index_slot_of(id_index, id);
+	if (slots[hole].index == ID_INDEX_EMPTY_SLOT) goto id_not_indexed;
+
+	/* Backward shift deletion : Move back every following entry that
+	 * could have been stored in the hole, so that no tombstone is
+	 * needed. */
+	uint32_t s = hole;
+	while (1) {
+		s = (s + 1) & mask;
+		if (slots[s].index == ID_INDEX_EMPTY_SLOT) break;
+
+		uint32_t const ideal = id_index_hash(slots[s].id) & mask;
+		if (((s - ideal) & mask) >= ((s - hole) & mask)) {
+			slots[hole] = slots[s];
+			hole = s;
+		}
+	}
+
+	slots[hole].id    = 0;
+	slots[hole].index = ID_INDEX_EMPTY_SLOT;
+	id_index->used -= 1;
+
+id_not_indexed:
+	return;
+}
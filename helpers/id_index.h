@@ -0,0 +1,64 @@
+#ifndef MYY_HELPERS_ID_INDEX_H
+#define MYY_HELPERS_ID_INDEX_H 1
+
+#include <stdint.h>
+#include <stddef.h> // NULL
+
+/* Open addressing hash map, from 32 bits IDs to 32 bits indices.
+ * Collisions are resolved by linear probing and the table is kept, at
+ * most, half full.
+ * An index with no slots allocated is considered "not ready". Users of
+ * this structure are expected to fall back to a linear search in that
+ * case. */
+
+#define ID_INDEX_EMPTY_SLOT 0xffffffff
+
+struct id_index_slot {
+	uint32_t id;
+	uint32_t index;
+};
+
+struct id_index {
+	struct id_index_slot * slots;
+	uint32_t mask;
+	uint32_t used;
+};
+
+struct id_index_result {
+	unsigned int found;
+	uint32_t index;
+};
+
+unsigned int id_index_init
+(struct id_index * __restrict const id_index,
+ uint32_t const expected_ids);
+
+void id_index_free
+(struct id_index * __restrict const id_index);
+
+/* Make copy an independent copy of id_index.
+ * Returns 0 if the copy cannot be allocated. */
+unsigned int id_index_copy
+(struct id_index * __restrict const copy,
+ struct id_index const * __restrict const id_index);
+
+static inline unsigned int id_index_ready
+(struct id_index const * __restrict const id_index)
+{
+	return id_index->slots != NULL;
+}
+
+unsigned int id_index_set
+(struct id_index * __restrict const id_index,
+ uint32_t const id,
+ uint32_t const index);
+
+struct id_index_result id_index_get
+(struct id_index const * __restrict const id_index,
+ uint32_t const id);
+
+void id_index_remove
+(struct id_index * __restrict const id_index,
+ uint32_t const id);
+
+#endif
@@ -0,0 +1,178 @@
+#include <helpers/layout.h>
+#include <helpers/numeric.h>
+#include <helpers/cpu.h>
+
+#if defined(CPU_AVX2_KERNELS) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+static uint32_t layout_one_by_one
+(uint32_t const * __restrict const aligns,
+ uint32_t const * __restrict const sizes,
+ uint32_t const n,
+ uint32_t cursor,
+ uint32_t * __restrict const addresses)
+{
+	for (uint32_t e = 0; e < n; e++) {
+		cursor = round_to(cursor, aligns[e]);
+		addresses[e] = cursor;
+		cursor += sizes[e];
+	}
+	return cursor;
+}
+
+#if defined(CPU_AVX2_KERNELS)
+
+static inline CPU_TARGET_AVX2 uint32_t or_lanes_avx2(__m256i v)
+{
+	__m128i v128 = _mm_or_si128(
+		_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)
+	);
+	v128 = _mm_or_si128(v128, _mm_shuffle_epi32(v128, 0x4e));
+	v128 = _mm_or_si128(v128, _mm_shuffle_epi32(v128, 0xb1));
+	return _mm_cvtsi128_si32(v128);
+}
+
+/* Returns 0, without storing anything, if some padding is needed */
+static inline CPU_TARGET_AVX2 unsigned int layout_block_avx2
+(uint32_t const * __restrict const aligns,
+ uint32_t const * __restrict const sizes,
+ uint32_t * __restrict const cursor,
+ uint32_t * __restrict const addresses)
+{
+	__m256i const zero = _mm256_setzero_si256();
+	__m256i const align = _mm256_loadu_si256((__m256i const *) aligns);
+	__m256i const size  = _mm256_loadu_si256((__m256i const *) sizes);
+	__m256i const align_mask =
+		_mm256_sub_epi32(align, _mm256_set1_epi32(1));
+
+	__m256i const not_power_of_2 = _mm256_cmpeq_epi32(
+		_mm256_and_si256(align, align_mask), zero
+	);
+	unsigned int const no_padding =
+		_mm256_movemask_epi8(not_power_of_2) == -1 &&
+		((*cursor | or_lanes_avx2(size)) & or_lanes_avx2(align_mask)) == 0;
+	if (!no_padding) goto padding_needed;
+
+	/* Inclusive prefix sum in each 128 bits lane, then carry the
+	 * low lane total to the high lane */
+	__m256i sum = _mm256_add_epi32(size, _mm256_slli_si256(size, 4));
+	sum = _mm256_add_epi32(sum, _mm256_slli_si256(sum, 8));
+	__m256i const carry = _mm256_blend_epi32(
+		zero,
+		_mm256_permutevar8x32_epi32(sum, _mm256_set1_epi32(3)),
+		0xf0
+	);
+	sum = _mm256_add_epi32(sum, carry);
+
+	__m256i const placed = _mm256_add_epi32(
+		_mm256_sub_epi32(sum, size), _mm256_set1_epi32(*cursor)
+	);
+	_mm256_storeu_si256((__m256i *) addresses, placed);
+	*cursor += _mm256_extract_epi32(sum, 7);
+
+padding_needed:
+	return no_padding;
+}
+
+/* Returns the number of elements placed, by blocks of 8 */
+static CPU_TARGET_AVX2 uint32_t layout_blocks_avx2
+(uint32_t const * __restrict const aligns,
+ uint32_t const * __restrict const sizes,
+ uint32_t const n,
+ uint32_t * __restrict const cursor,
+ uint32_t * __restrict const addresses)
+{
+	uint32_t e = 0;
+	for (; e + 8 <= n; e += 8) {
+		if (!layout_block_avx2(aligns+e, sizes+e, cursor, addresses+e))
+			*cursor = layout_one_by_one(
+				aligns+e, sizes+e, 8, *cursor, addresses+e
+			);
+	}
+	return e;
+}
+
+#endif
+
+#if defined(__SSE2__)
+
+static inline uint32_t or_lanes_sse2(__m128i v)
+{
+	v = _mm_or_si128(v, _mm_shuffle_epi32(v, 0x4e));
+	v = _mm_or_si128(v, _mm_shuffle_epi32(v, 0xb1));
+	return _mm_cvtsi128_si32(v);
+}
+
+/* Returns 0, without storing anything, if some padding is needed */
+static inline unsigned int layout_block_sse2
+(uint32_t const * __restrict const aligns,
+ uint32_t const * __restrict const sizes,
+ uint32_t * __restrict const cursor,
+ uint32_t * __restrict const addresses)
+{
+	__m128i const zero = _mm_setzero_si128();
+	__m128i const align = _mm_loadu_si128((__m128i const *) aligns);
+	__m128i const size  = _mm_loadu_si128((__m128i const *) sizes);
+	__m128i const align_mask = _mm_sub_epi32(align, _mm_set1_epi32(1));
+
+	__m128i const not_power_of_2 = _mm_cmpeq_epi32(
+		_mm_and_si128(align, align_mask), zero
+	);
+	unsigned int const no_padding =
+		_mm_movemask_epi8(not_power_of_2) == 0xffff &&
+		((*cursor | or_lanes_sse2(size)) & or_lanes_sse2(align_mask)) == 0;
+	if (!no_padding) goto padding_needed;
+
+	__m128i sum = _mm_add_epi32(size, _mm_slli_si128(size, 4));
+	sum = _mm_add_epi32(sum, _mm_slli_si128(sum, 8));
+
+	__m128i const placed = _mm_add_epi32(
+		_mm_sub_epi32(sum, size), _mm_set1_epi32(*cursor)
+	);
+	_mm_storeu_si128((__m128i *) addresses, placed);
+	*cursor += _mm_cvtsi128_si32(_mm_shuffle_epi32(sum, 0xff));
+
+padding_needed:
+	return no_padding;
+}
+
+/* Returns the number of elements placed, by blocks of 4 */
+static uint32_t layout_blocks_sse2
+(uint32_t const * __restrict const aligns,
+ uint32_t const * __restrict const sizes,
+ uint32_t const n,
+ uint32_t * __restrict const cursor,
+ uint32_t * __restrict const addresses)
+{
+	uint32_t e = 0;
+	for (; e + 4 <= n; e += 4) {
+		if (!layout_block_sse2(aligns+e, sizes+e, cursor, addresses+e))
+			*cursor = layout_one_by_one(
+				aligns+e, sizes+e, 4, *cursor, addresses+e
+			);
+	}
+	return e;
+}
+
+#endif
+
+uint32_t layout_aligned_addresses
+(uint32_t const * __restrict const aligns,
+ uint32_t const * __restrict const sizes,
+ uint32_t const n,
+ uint32_t cursor,
+ uint32_t * __restrict const addresses)
+{
+	uint32_t e = 0;
+
+#if defined(CPU_AVX2_KERNELS)
+	if (cpu_supports_avx2())
+		e = layout_blocks_avx2(aligns, sizes, n, &cursor, addresses);
+#endif
+#if defined(__SSE2__)
+	e += layout_blocks_sse2(aligns+e, sizes+e, n - e, &cursor, addresses+e);
+#endif
+
+	return layout_one_by_one(aligns+e, sizes+e, n - e, cursor, addresses+e);
+}
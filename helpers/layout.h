@@ -0,0 +1,22 @@
+#ifndef MYY_HELPERS_LAYOUT_H
+#define MYY_HELPERS_LAYOUT_H 1
+
+#include <stdint.h>
+
+/* Place n elements one after the other, starting at cursor, each one
+ * aligned on aligns[e], and store their addresses.
+ * Returns the cursor after the last element.
+ *
+ * Blocks of elements that need no padding at all are placed with
+ * a vectorized prefix sum, with SSE2, or AVX2 when the CPU running
+ * the code has it.
+ * That is : blocks where every alignment is a power of 2 dividing the
+ * cursor and every size. Everything else is placed one by one. */
+uint32_t layout_aligned_addresses
+(uint32_t const * __restrict const aligns,
+ uint32_t const * __restrict const sizes,
+ uint32_t const n,
+ uint32_t cursor,
+ uint32_t * __restrict const addresses);
+
+#endif
@@ -0,0 +1,289 @@
+#include <helpers/names_table.h>
+#include <helpers/memory.h>
+#include <helpers/hash.h>
+
+#include <stddef.h> // NULL
+#include <string.h>
+
+#define NAMES_TABLE_EMPTY_SLOT 0xffffffff
+
+static void names_table_clean_slots
+(uint32_t * __restrict const slots,
+ uint32_t const n_slots)
+{
+	for (uint32_t s = 0; s < n_slots; s++)
+		slots[s] = NAMES_TABLE_EMPTY_SLOT;
+}
+
+struct names_table * generate_names_table()
+{
+	uint32_t const default_n_entries = 64;
+	uint32_t const default_n_slots = default_n_entries * 2;
+	uint32_t const default_block_size = 4096;
+
+	struct names_table * __restrict names_table = NULL;
+
+	struct names_table_entry * __restrict const entries =
+		allocate_durable_memory(
+			default_n_entries * sizeof(struct names_table_entry)
+		);
+	uint32_t * __restrict const slots =
+		allocate_durable_memory(default_n_slots * sizeof(uint32_t));
+	uint8_t * __restrict const block =
+		allocate_durable_memory(default_block_size);
+
+	if (entries == NULL || slots == NULL || block == NULL)
+		goto cant_allocate_names_table;
+
+	names_table = allocate_durable_memory(sizeof(struct names_table));
+	if (names_table == NULL) goto cant_allocate_names_table;
+
+	names_table_clean_slots(slots, default_n_slots);
+
+	struct names_table const table = {
+		.entries     = entries,
+		.n_entries   = 0,
+		.max_entries = default_n_entries,
+		.slots       = slots,
+		.mask        = default_n_slots - 1,
+		.block       = block,
+		.block_used  = 0,
+		.block_size  = default_block_size
+	};
+	*names_table = table;
+	goto names_table_generated;
+
+cant_allocate_names_table:
+	free_durable_memory(entries);
+	free_durable_memory(slots);
+	free_durable_memory(block);
+
+names_table_generated:
+	return names_table;
+}
+
+static uint32_t names_table_slot_of
+(struct names_table const * __restrict const names_table,
+ uint8_t const * __restrict const name,
+ uint32_t const length,
+ uint32_t const hash)
+{
+	uint32_t const mask = names_table->mask;
+	uint32_t const * __restrict const slots = names_table->slots;
+	struct names_table_entry const * __restrict const entries =
+		names_table->entries;
+
+	uint32_t s = hash & mask;
+	while (slots[s] != NAMES_TABLE_EMPTY_SLOT) {
+		struct names_table_entry const * __restrict const entry =
+			entries+slots[s];
+		if (entry->hash == hash && entry->length == length &&
+		    memcmp(entry->name, name, length) == 0)
+			break;
+		s = (s + 1) & mask;
+	}
+
+	return s;
+}
+
+static unsigned int names_table_grow_slots
+(struct names_table * __restrict const names_table)
+{
+	uint32_t const new_n_slots = (names_table->mask + 1) * 2;
+	uint32_t * __restrict const new_slots =
+		allocate_durable_memory(new_n_slots * sizeof(uint32_t));
+
+	unsigned int const grown = (new_slots != NULL);
+	if (!grown) goto cant_allocate_new_slots;
+
+	names_table_clean_slots(new_slots, new_n_slots);
+	free_durable_memory(names_table->slots);
+	names_table->slots = new_slots;
+	names_table->mask  = new_n_slots - 1;
+
+	// Every name is unique, so only the hash matters here
+	for (uint32_t e = 0; e < names_table->n_entries; e++) {
+		uint32_t s = names_table->entries[e].hash & names_table->mask;
+		while (new_slots[s] != NAMES_TABLE_EMPTY_SLOT)
+			s = (s + 1) & names_table->mask;
+		new_slots[s] = e;
+	}
+
+cant_allocate_new_slots:
+	return grown;
+}
+
+/* Copy the name in the current block, or a new one if it's full.
+ * Filled blocks are kept as-is, so interned names never move. */
+static uint8_t const * names_table_store
+(struct names_table * __restrict const names_table,
+ uint8_t const * __restrict const name,
+ uint32_t const length)
+{
+	uint32_t const needed = length + 1;
+	uint8_t * __restrict stored = NULL;
+
+	if (names_table->block_used + needed > names_table->block_size) {
+		uint32_t const default_block_size = 4096;
+		uint32_t const new_block_size =
+			(needed > default_block_size) ? needed : default_block_size;
+		uint8_t * __restrict const new_block =
+			allocate_durable_memory(new_block_size);
+		if (new_block == NULL) goto cant_allocate_new_block;
+		names_table->block = new_block;
+		names_table->block_used = 0;
+		names_table->block_size = new_block_size;
+	}
+
+	stored = names_table->block + names_table->block_used;
+	memcpy(stored, name, length);
+	stored[length] = 0;
+	names_table->block_used += needed;
+
+cant_allocate_new_block:
+	return stored;
+}
+
+/* Find the entry of name, creating it if needed.
+ * NULL if the entry could not be created. */
+static struct names_table_entry * names_table_entry_of
+(struct names_table * __restrict const names_table,
+ uint8_t const * __restrict const name)
+{
+	struct names_table_entry * __restrict entry = NULL;
+	uint32_t const length = strlen((char const *) name);
+	uint32_t const hash = hash_fold32(hash_bytes(name, length, 0));
+
+	uint32_t s = names_table_slot_of(names_table, name, length, hash);
+	if (names_table->slots[s] != NAMES_TABLE_EMPTY_SLOT) {
+		entry = names_table->entries+names_table->slots[s];
+		goto found;
+	}
+
+	if ((names_table->n_entries + 1) * 2 > names_table->mask + 1) {
+		if (!names_table_grow_slots(names_table)) goto cant_add_entry;
+		s = names_table_slot_of(names_table, name, length, hash);
+	}
+
+	if (names_table->n_entries == names_table->max_entries) {
+		uint32_t const new_max = names_table->max_entries * 2;
+		struct names_table_entry * __restrict const new_entries =
+			reallocate_durable_memory(
+				names_table->entries,
+				new_max * sizeof(struct names_table_entry)
+			);
+		if (new_entries == NULL) goto cant_add_entry;
+		names_table->entries = new_entries;
+		names_table->max_entries = new_max;
+	}
+
+	uint8_t const * __restrict const interned =
+		names_table_store(names_table, name, length);
+	if (interned == NULL) goto cant_add_entry;
+
+	uint32_t const e = names_table->n_entries;
+	entry = names_table->entries+e;
+	entry->name     = interned;
+	entry->length   = length;
+	entry->hash     = hash;
+	entry->data_id  = NAMES_TABLE_NO_ID;
+	entry->frame_id = NAMES_TABLE_NO_ID;
+	names_table->slots[s] = e;
+	names_table->n_entries += 1;
+
+cant_add_entry:
+found:
+	return entry;
+}
+
+static struct names_table_entry * names_table_find
+(struct names_table const * __restrict const names_table,
+ uint8_t const * __restrict const name)
+{
+	uint32_t const length = strlen((char const *) name);
+	uint32_t const hash = hash_fold32(hash_bytes(name, length, 0));
+	uint32_t const s = names_table_slot_of(names_table, name, length, hash);
+
+	return (names_table->slots[s] != NAMES_TABLE_EMPTY_SLOT) ?
+		names_table->entries+names_table->slots[s] :
+		NULL;
+}
+
+uint8_t const * names_table_intern
+(struct names_table * __restrict const names_table,
+ uint8_t const * __restrict const name)
+{
+	struct names_table_entry const * __restrict const entry =
+		names_table_entry_of(names_table, name);
+	return (entry != NULL) ? entry->name : NULL;
+}
+
+uint8_t const * names_table_bind_data_symbol
+(struct names_table * __restrict const names_table,
+ uint8_t const * __restrict const name,
+ uint32_t const data_id)
+{
+	struct names_table_entry * __restrict const entry =
+		names_table_entry_of(names_table, name);
+	if (entry != NULL) entry->data_id = data_id;
+	return (entry != NULL) ? entry->name : NULL;
+}
+
+uint8_t const * names_table_bind_frame
+(struct names_table * __restrict const names_table,
+ uint8_t const * __restrict const name,
+ uint32_t const frame_id)
+{
+	struct names_table_entry * __restrict const entry =
+		names_table_entry_of(names_table, name);
+	if (entry != NULL) entry->frame_id = frame_id;
+	return (entry != NULL) ? entry->name : NULL;
+}
+
+void names_table_unbind_data_symbol
+(struct names_table * __restrict const names_table,
+ uint8_t const * __restrict const name,
+ uint32_t const data_id)
+{
+	struct names_table_entry * __restrict const entry =
+		names_table_find(names_table, name);
+	if (entry != NULL && entry->data_id == data_id)
+		entry->data_id = NAMES_TABLE_NO_ID;
+}
+
+void names_table_unbind_frame
+(struct names_table * __restrict const names_table,
+ uint8_t const * __restrict const name,
+ uint32_t const frame_id)
+{
+	struct names_table_entry * __restrict const entry =
+		names_table_find(names_table, name);
+	if (entry != NULL && entry->frame_id == frame_id)
+		entry->frame_id = NAMES_TABLE_NO_ID;
+}
+
+struct names_table_result names_table_data_symbol
+(struct names_table const * __restrict const names_table,
+ uint8_t const * __restrict const name)
+{
+	struct names_table_entry const * __restrict const entry =
+		names_table_find(names_table, name);
+	struct names_table_result const result = {
+		.found = (entry != NULL && entry->data_id != NAMES_TABLE_NO_ID),
+		.id    = (entry != NULL) ? entry->data_id : NAMES_TABLE_NO_ID
+	};
+	return result;
+}
+
+struct names_table_result names_table_frame
+(struct names_table const * __restrict const names_table,
+ uint8_t const * __restrict const name)
+{
+	struct names_table_entry const * __restrict const entry =
+		names_table_find(names_table, name);
+	struct names_table_result const result = {
+		.found = (entry != NULL && entry->frame_id != NAMES_TABLE_NO_ID),
+		.id    = (entry != NULL) ? entry->frame_id : NAMES_TABLE_NO_ID
+	};
+	return result;
+}
@@ -0,0 +1,80 @@
+#ifndef MYY_HELPERS_NAMES_TABLE_H
+#define MYY_HELPERS_NAMES_TABLE_H 1
+
+#include <stdint.h>
+
+/* Interned names, each one associated with, at most, one data symbol
+ * ID and one frame ID.
+ * Interned names are stored once, NUL-terminated, and never move, so
+ * their addresses can be stored and compared directly.
+ * Names are found through an open addressing hash table, using linear
+ * probing, kept at most half full. */
+
+#define NAMES_TABLE_NO_ID 0xffffffff
+
+struct names_table_entry {
+	uint8_t const * name;
+	uint32_t length;
+	uint32_t hash;
+	uint32_t data_id;
+	uint32_t frame_id;
+};
+
+struct names_table {
+	struct names_table_entry * entries;
+	uint32_t n_entries;
+	uint32_t max_entries;
+	/* Index of the entries, by name hash */
+	uint32_t * slots;
+	uint32_t mask;
+	/* Interned names storage. Filled blocks are never reallocated. */
+	uint8_t * block;
+	uint32_t block_used;
+	uint32_t block_size;
+};
+
+struct names_table_result {
+	unsigned int found;
+	uint32_t id;
+};
+
+struct names_table * generate_names_table();
+
+/* Returns the interned copy of name, storing it if needed.
+ * NULL if the name could not be stored. */
+uint8_t const * names_table_intern
+(struct names_table * __restrict const names_table,
+ uint8_t const * __restrict const name);
+
+/* Make name refer to the data symbol ID, or the frame ID.
+ * Returns the interned name. NULL if the name could not be stored. */
+uint8_t const * names_table_bind_data_symbol
+(struct names_table * __restrict const names_table,
+ uint8_t const * __restrict const name,
+ uint32_t const data_id);
+
+uint8_t const * names_table_bind_frame
+(struct names_table * __restrict const names_table,
+ uint8_t const * __restrict const name,
+ uint32_t const frame_id);
+
+/* Forget the binding, if name still refers to that ID */
+void names_table_unbind_data_symbol
+(struct names_table * __restrict const names_table,
+ uint8_t const * __restrict const name,
+ uint32_t const data_id);
+
+void names_table_unbind_frame
+(struct names_table * __restrict const names_table,
+ uint8_t const * __restrict const name,
+ uint32_t const frame_id);
+
+struct names_table_result names_table_data_symbol
+(struct names_table const * __restrict const names_table,
+ uint8_t const * __restrict const name);
+
+struct names_table_result names_table_frame
+(struct names_table const * __restrict const names_table,
+ uint8_t const * __restrict const name);
+
+#endif
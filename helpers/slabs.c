@@ -0,0 +1,62 @@
+#include <helpers/slabs.h>
+#include <helpers/memory.h>
+#include <helpers/numeric.h>
+
+#define SLABS_HEADER_SIZE 16
+
+void slabs_init
+(struct slabs * __restrict const slabs,
+ uint32_t const slab_size)
+{
+	slabs->slab      = NULL;
+	slabs->used      = 0;
+	slabs->slab_size = slab_size;
+}
+
+static unsigned int slabs_new_slab
+(struct slabs * __restrict const slabs)
+{
+	uint8_t * __restrict const slab =
+		allocate_durable_memory(slabs->slab_size);
+	unsigned int const allocated = (slab != NULL);
+	if (!allocated) goto cant_allocate_slab;
+
+	*((uint8_t **) slab) = slabs->slab;
+	slabs->slab = slab;
+	slabs->used = SLABS_HEADER_SIZE;
+
+cant_allocate_slab:
+	return allocated;
+}
+
+void * slabs_allocate
+(struct slabs * __restrict const slabs,
+ uint32_t const size)
+{
+	void * __restrict allocated = NULL;
+	uint32_t const needed = round_to(size, 16);
+	if (needed > slabs->slab_size - SLABS_HEADER_SIZE) goto too_big;
+
+	if (slabs->slab == NULL || slabs->used + needed > slabs->slab_size)
+		if (!slabs_new_slab(slabs)) goto cant_allocate_slab;
+
+	allocated = slabs->slab + slabs->used;
+	slabs->used += needed;
+
+cant_allocate_slab:
+too_big:
+	return allocated;
+}
+
+void slabs_free
+(struct slabs * __restrict const slabs)
+{
+	uint8_t * __restrict slab = slabs->slab;
+	while (slab != NULL) {
+		uint8_t * __restrict const previous = *((uint8_t **) slab);
+		free_durable_memory(slab);
+		slab = previous;
+	}
+	slabs->slab = NULL;
+	slabs->used = 0;
+}
@@ -0,0 +1,34 @@
+#ifndef MYY_HELPERS_SLABS_H
+#define MYY_HELPERS_SLABS_H 1
+
+#include <stdint.h>
+#include <stddef.h> // NULL
+
+/* Bump allocator carving small allocations out of large slabs.
+ * Allocations cannot be freed one by one : every slab is released at
+ * once by slabs_free. Users wanting to reuse some allocations are
+ * expected to keep their own free lists. */
+
+struct slabs {
+	/* The current slab. Each slab starts with a pointer to the
+	 * previous one. */
+	uint8_t * slab;
+	uint32_t used;
+	uint32_t slab_size;
+};
+
+void slabs_init
+(struct slabs * __restrict const slabs,
+ uint32_t const slab_size);
+
+/* The allocations are 16 bytes aligned.
+ * NULL if no slab can be allocated, or if size is too big to fit in
+ * a slab. */
+void * slabs_allocate
+(struct slabs * __restrict const slabs,
+ uint32_t const size);
+
+void slabs_free
+(struct slabs * __restrict const slabs);
+
+#endif
@@ -65,33 +65,33 @@ instruction_params[n_known_instructions] = {
 #define tostring_func_sig char const * __restrict const format,\
  char * __restrict const string,\
  size_t const max_length,\
- struct instruction_args_infos const * __restrict const args
+ int32_t const * __restrict const values
 
 size_t one_reg_one_immediate(tostring_func_sig)
 {
 	return snprintf(
 		string, max_length, format,
-		register_names[args[0].value], args[1].value
+		register_names[values[0]], values[1]
 	);
 }
 
 size_t two_regs_one_immediate(tostring_func_sig) {
 	return snprintf(
 		string, max_length, format,
-		register_names[args[0].value], register_names[args[1].value],
-		args[2].value
+		register_names[values[0]], register_names[values[1]],
+		values[2]
 	);
 }
 
 size_t two_regs(tostring_func_sig) {
 	return snprintf(
 		string, max_length, format,
-		register_names[args[0].value], register_names[args[1].value]
+		register_names[values[0]], register_names[values[1]]
 	);
 }
 
 size_t one_immediate(tostring_func_sig) {
-	return snprintf(string, max_length, format, args[0].value);
+	return snprintf(string, max_length, format, values[0]);
 }
 
 struct instruction_to_string {
@@ -130,7 +130,7 @@ size_t instructions_to_string
 			to_string_infos.format,
 			output+stored_chars,
 			output_max_size - stored_chars,
-			current_instruction.args
+			current_instruction.values
 		);
 	}
 	return stored_chars;
@@ -171,12 +171,12 @@ void test_instructions_to_string() {
 		test_data_string_name
 	);
 	
-	converted[1].args[1].type = arg_data_symbol_address_bottom16;
-	converted[1].args[1].value = data_index;
-	converted[2].args[1].type = arg_data_symbol_address_top16;
-	converted[2].args[1].value = data_index;
-	converted[3].args[1].type = arg_data_symbol_size;
-	converted[3].args[1].value = data_index;
+	converted[1].types[1] = arg_data_symbol_address_bottom16;
+	converted[1].values[1] = data_index;
+	converted[2].types[1] = arg_data_symbol_address_top16;
+	converted[2].values[1] = data_index;
+	converted[3].types[1] = arg_data_symbol_size;
+	converted[3].values[1] = data_index;
 	
 	char string[200];
 	memset(string, 0, 200);
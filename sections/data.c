@@ -8,38 +8,518 @@
 
 #include <helpers/numeric.h>
 #include <helpers/memory.h>
+#include <helpers/hash.h>
+#include <helpers/layout.h>
 
-struct data_section * generate_data_section()
+static inline unsigned int is_alias
+(struct data_symbol const * __restrict const symbol)
+{
+	return (symbol->flags & DATA_SYMBOL_ALIAS) != 0;
+}
+
+/* The number of bytes the symbol content takes in the section.
+ * Aliases reuse the content of another symbol. */
+static inline uint32_t symbol_footprint
+(struct data_symbol const * __restrict const symbol)
+{
+	return is_alias(symbol) ? 0 : symbol->size;
+}
+
+static void free_data_section_layout
+(struct data_section_layout * __restrict const layout)
+{
+	free_durable_memory(layout->addresses);
+	free_durable_memory(layout->aligns);
+	free_durable_memory(layout->footprints);
+	free_durable_memory(layout);
+}
+
+static struct data_section_layout * generate_data_section_layout
+(uint32_t const n_addresses)
+{
+	struct data_section_layout * __restrict layout = NULL;
+
+	size_t const arrays_size = n_addresses * sizeof(uint32_t);
+	uint32_t * __restrict const addresses =
+		allocate_durable_memory(arrays_size);
+	uint32_t * __restrict const aligns =
+		allocate_durable_memory(arrays_size);
+	uint32_t * __restrict const footprints =
+		allocate_durable_memory(arrays_size);
+
+	if (addresses == NULL || aligns == NULL || footprints == NULL)
+		goto cant_allocate_arrays;
+
+	layout = allocate_durable_memory(sizeof(struct data_section_layout));
+	if (layout == NULL) goto cant_allocate_arrays;
+
+	layout->addresses = addresses;
+	layout->aligns = aligns;
+	layout->footprints = footprints;
+	layout->valid = 0;
+	layout->mirrored = 0;
+	layout->max_addresses = n_addresses;
+	layout->version = 0;
+	goto layout_generated;
+
+cant_allocate_arrays:
+	free_durable_memory(addresses);
+	free_durable_memory(aligns);
+	free_durable_memory(footprints);
+layout_generated:
+	return layout;
+}
+
+/* The symbols metadata changed from index */
+static void invalidate_layout_from
+(struct data_section const * __restrict const data_section,
+ uint32_t const index)
+{
+	struct data_section_layout * __restrict const layout =
+		data_section->layout;
+	if (layout == NULL) goto no_layout;
+	if (layout->valid > index) layout->valid = index;
+	if (layout->mirrored > index) layout->mirrored = index;
+	layout->version += 1;
+no_layout:
+	return;
+}
+
+/* Only the addresses moved, the symbols themselves didn't change */
+static void invalidate_addresses_from
+(struct data_section const * __restrict const data_section,
+ uint32_t const index)
+{
+	struct data_section_layout * __restrict const layout =
+		data_section->layout;
+	if (layout == NULL) goto no_layout;
+	if (layout->valid > index) layout->valid = index;
+	layout->version += 1;
+no_layout:
+	return;
+}
+
+static unsigned int expand_layout_arrays
+(struct data_section_layout * __restrict const layout,
+ uint32_t const new_max)
+{
+	size_t const arrays_size = new_max * sizeof(uint32_t);
+	unsigned int expanded = 0;
+
+	uint32_t * __restrict const new_addresses =
+		reallocate_durable_memory(layout->addresses, arrays_size);
+	if (new_addresses == NULL) goto cant_expand;
+	layout->addresses = new_addresses;
+
+	uint32_t * __restrict const new_aligns =
+		reallocate_durable_memory(layout->aligns, arrays_size);
+	if (new_aligns == NULL) goto cant_expand;
+	layout->aligns = new_aligns;
+
+	uint32_t * __restrict const new_footprints =
+		reallocate_durable_memory(layout->footprints, arrays_size);
+	if (new_footprints == NULL) goto cant_expand;
+	layout->footprints = new_footprints;
+
+	layout->max_addresses = new_max;
+	expanded = 1;
+
+cant_expand:
+	return expanded;
+}
+
+/* Make the addresses of the symbols [0, n_symbols[ valid.
+ * Aliases don't take any space. Their address in the layout is just
+ * the current cursor, and is never used as-is.
+ * Returns 0 if the addresses cannot be stored. */
+static unsigned int compute_layout_up_to
+(struct data_section const * __restrict const data_section,
+ uint32_t const n_symbols)
+{
+	struct data_section_layout * __restrict const layout =
+		data_section->layout;
+	unsigned int computed = (layout != NULL);
+	if (!computed) goto no_layout;
+
+	uint32_t const s = layout->valid;
+	if (s >= n_symbols) goto already_computed;
+
+	if (layout->max_addresses < data_section->max_symbols_before_realloc) {
+		computed = expand_layout_arrays(
+			layout, data_section->max_symbols_before_realloc
+		);
+		if (!computed) goto cant_expand_addresses;
+	}
+
+	struct data_symbol const * __restrict const symbols =
+		data_section->symbols;
+	uint32_t * __restrict const addresses = layout->addresses;
+	uint32_t * __restrict const aligns = layout->aligns;
+	uint32_t * __restrict const footprints = layout->footprints;
+
+	/* Aliases are placed at the cursor, without any padding */
+	for (uint32_t m = layout->mirrored; m < n_symbols; m++) {
+		aligns[m] = is_alias(symbols+m) ? 1 : symbols[m].align;
+		footprints[m] = symbol_footprint(symbols+m);
+	}
+	if (layout->mirrored < n_symbols) layout->mirrored = n_symbols;
+
+	uint32_t cursor = data_section->base_address;
+	if (s > 0) cursor = addresses[s-1] + footprints[s-1];
+
+	layout_aligned_addresses(
+		aligns+s, footprints+s, n_symbols - s, cursor, addresses+s
+	);
+
+	layout->valid = n_symbols;
+
+cant_expand_addresses:
+already_computed:
+no_layout:
+	return computed;
+}
+
+struct data_section * generate_data_section_with_storage
+(enum data_section_storage const storage)
 {
 	uint32_t const default_n_symbols = 128;
+	uint32_t const default_image_size = 4096;
 	
 	struct data_section * __restrict data_section = NULL;
+	uint8_t * __restrict image = NULL;
+	struct data_section_layout * __restrict layout = NULL;
 	
 	struct data_symbol * __restrict const symbols =
 		allocate_durable_memory(sizeof(struct data_symbol)*default_n_symbols);
 		
 	if (symbols == NULL) goto cant_allocate_data_section_symbols;
+
+	/* Not being able to allocate the index or the layout is not
+	 * fatal when only borrowing pointers. We'll just search and walk
+	 * the symbols linearly.
+	 * The image cannot be maintained without the layout, though. */
+	layout = generate_data_section_layout(default_n_symbols);
+	if (storage == data_storage_contiguous_image) {
+		image = allocate_durable_memory(default_image_size);
+		if (image == NULL || layout == NULL) goto cant_allocate_image;
+	}
 	
-	struct data_section const section = {
+	struct data_section section = {
 		.symbols = symbols,
 		.stored  = 0,
 		.next_id = 0,
 		.base_address = 0,
-		.max_symbols_before_realloc = default_n_symbols
+		.max_align = 1,
+		.max_symbols_before_realloc = default_n_symbols,
+		.handles = {0},
+		.layout = layout,
+		.storage = storage,
+		.image = image,
+		.image_size = 0,
+		.max_image_size = (image != NULL) ? default_image_size : 0,
+		.deduplicate = 0,
+		.content_index = {0},
+		.zero_fill = NULL,
+		.read_only = NULL,
+		.read_only_base_address = 0,
+		.names = NULL,
+		.batches_next_slot = 0,
+		.shared_arrays_references = NULL
 	};
 	
 	data_section = allocate_durable_memory(sizeof(struct data_section));
 	
-	if (data_section != NULL) *data_section = section;
-	else free_durable_memory(symbols);
+	if (data_section != NULL) {
+		handles_init(&section.handles, default_n_symbols);
+		*data_section = section;
+		goto data_section_generated;
+	}
+
+cant_allocate_image:
+	free_durable_memory(image);
+	if (layout != NULL) free_data_section_layout(layout);
+	free_durable_memory(symbols);
 
+data_section_generated:
 cant_allocate_data_section_symbols:
 	return data_section;
 }
 
+struct data_section * generate_data_section()
+{
+	return generate_data_section_with_storage(data_storage_borrowed_pointers);
+}
+
+static unsigned int uses_contiguous_image
+(struct data_section const * __restrict const data_section)
+{
+	return data_section->storage == data_storage_contiguous_image;
+}
+
+static unsigned int reserve_image_space
+(struct data_section * __restrict const data_section,
+ uint32_t const needed_size)
+{
+	unsigned int reserved = (needed_size <= data_section->max_image_size);
+	if (reserved) goto enough_space;
+
+	uint32_t new_size = data_section->max_image_size * 2;
+	if (new_size < needed_size) new_size = needed_size;
+
+	uint8_t * __restrict const new_image =
+		reallocate_durable_memory(data_section->image, new_size);
+
+	reserved = (new_image != NULL);
+	if (reserved) {
+		data_section->image = new_image;
+		data_section->max_image_size = new_size;
+	}
+
+enough_space:
+	return reserved;
+}
+
+/* Move the content of the symbols [first_index, stored[ from their
+ * current offset, to the offset defined by the current layout, and clean
+ * the padding between them.
+ * The content of skipped_index, if it's in the range, is not moved.
+ * Its new content is expected to be written afterwards.
+ * Aliases have no content of their own, and are skipped too.
+ *
+ * When every symbol moves in the same direction, the content is moved
+ * in place. Otherwise (the order changed or the alignment padding
+ * shifted in both directions), the content goes through the free space
+ * at the end of the image.
+ *
+ * Returns 0, without touching the image, if the layout could not be
+ * computed or the image could not be expanded. */
+static unsigned int relayout_image_from
+(struct data_section * __restrict const data_section,
+ uint32_t const first_index,
+ uint32_t const skipped_index)
+{
+	uint32_t const n_symbols = data_section->stored;
+	uint32_t const base_address = data_section->base_address;
+	struct data_symbol * __restrict const symbols = data_section->symbols;
+
+	unsigned int relaid = compute_layout_up_to(data_section, n_symbols);
+	if (!relaid) goto cant_compute_layout;
+
+	uint32_t const * __restrict const addresses =
+		data_section->layout->addresses;
+
+	uint32_t const old_end = data_section->image_size;
+	uint32_t const new_end = (n_symbols > 0) ?
+		addresses[n_symbols-1] + symbol_footprint(symbols+n_symbols-1) -
+		base_address :
+		0;
+
+	unsigned int moving_forward = 0, moving_backward = 0, in_order = 1;
+	uint32_t moved_bytes = 0;
+	uint32_t previous_offset = 0;
+	for (uint32_t s = first_index; s < n_symbols; s++) {
+		if (s == skipped_index || is_alias(symbols+s)) continue;
+		uint32_t const new_offset = addresses[s] - base_address;
+		uint32_t const old_offset = symbols[s].offset;
+		moving_forward  |= (new_offset > old_offset);
+		moving_backward |= (new_offset < old_offset);
+		in_order &= (old_offset >= previous_offset);
+		previous_offset = old_offset;
+		moved_bytes += symbols[s].size;
+	}
+
+	unsigned int const through_free_space =
+		!in_order || (moving_forward && moving_backward);
+	uint32_t const free_space_offset =
+		round_to((old_end > new_end) ? old_end : new_end, 8);
+	uint32_t const needed_size = (through_free_space) ?
+		free_space_offset + moved_bytes :
+		((old_end > new_end) ? old_end : new_end);
+
+	relaid = reserve_image_space(data_section, needed_size);
+	if (!relaid) goto cant_expand_image;
+
+	uint8_t * __restrict const image = data_section->image;
+
+	if (through_free_space) {
+		uint32_t cursor = free_space_offset;
+		for (uint32_t s = first_index; s < n_symbols; s++) {
+			if (s == skipped_index || is_alias(symbols+s)) continue;
+			memcpy(image+cursor, image+symbols[s].offset, symbols[s].size);
+			cursor += symbols[s].size;
+		}
+		cursor = free_space_offset;
+		for (uint32_t s = first_index; s < n_symbols; s++) {
+			if (s == skipped_index || is_alias(symbols+s)) continue;
+			memcpy(image+addresses[s]-base_address, image+cursor, symbols[s].size);
+			cursor += symbols[s].size;
+		}
+	}
+	else if (moving_forward) {
+		for (uint32_t s = n_symbols; s-- > first_index;) {
+			if (s == skipped_index || is_alias(symbols+s)) continue;
+			memmove(
+				image+addresses[s]-base_address, image+symbols[s].offset,
+				symbols[s].size
+			);
+		}
+	}
+	else if (moving_backward) {
+		for (uint32_t s = first_index; s < n_symbols; s++) {
+			if (s == skipped_index || is_alias(symbols+s)) continue;
+			memmove(
+				image+addresses[s]-base_address, image+symbols[s].offset,
+				symbols[s].size
+			);
+		}
+	}
+
+	uint32_t previous_end = (first_index > 0) ?
+		addresses[first_index-1] + symbol_footprint(symbols+first_index-1) -
+		base_address :
+		0;
+	for (uint32_t s = first_index; s < n_symbols; s++) {
+		if (is_alias(symbols+s)) continue;
+		uint32_t const new_offset = addresses[s] - base_address;
+		memset(image+previous_end, 0, new_offset - previous_end);
+		symbols[s].offset = new_offset;
+		previous_end = new_offset + symbols[s].size;
+	}
+
+	data_section->image_size = new_end;
+
+cant_expand_image:
+cant_compute_layout:
+	return relaid;
+}
+
+/* Whether the current layout moves some symbols of the image from
+ * their offset. Also when the layout cannot be computed. */
+static unsigned int image_offsets_change
+(struct data_section * __restrict const data_section)
+{
+	uint32_t const n_symbols = data_section->stored;
+	uint32_t const base_address = data_section->base_address;
+	struct data_symbol const * __restrict const symbols =
+		data_section->symbols;
+	unsigned int changed = !compute_layout_up_to(data_section, n_symbols);
+	if (changed) goto cant_compute_layout;
+
+	uint32_t const * __restrict const addresses =
+		data_section->layout->addresses;
+	for (uint32_t s = 0; s < n_symbols && !changed; s++)
+		changed = !is_alias(symbols+s) &&
+			(addresses[s] - base_address != symbols[s].offset);
+
+cant_compute_layout:
+	return changed;
+}
+
+static void copy_symbol_content
+(uint8_t * __restrict const dest,
+ uint8_t const * __restrict const content,
+ uint32_t const size)
+{
+	if (content != NULL) memcpy(dest, content, size);
+	else memset(dest, 0, size);
+}
+
+static void free_data_section_arrays
+(struct data_section * __restrict const data_section)
+{
+	free_durable_memory(data_section->symbols);
+	free_durable_memory(data_section->image);
+	handles_free(&data_section->handles);
+}
+
+/* An array of size bytes, starting with the used bytes of array */
+static void * copy_of
+(void const * __restrict const array,
+ uint32_t const size,
+ uint32_t const used)
+{
+	void * __restrict copy = NULL;
+	if (array == NULL) goto nothing_to_copy;
+	copy = allocate_durable_memory(size);
+	if (copy != NULL) memcpy(copy, array, used);
+nothing_to_copy:
+	return copy;
+}
+
+/* Get arrays that are not shared with any snapshot, before modifying
+ * them. Returns 0 if they cannot be copied. */
+static unsigned int data_section_own_arrays
+(struct data_section * __restrict const data_section)
+{
+	uint32_t * __restrict const references =
+		data_section->shared_arrays_references;
+	unsigned int owned = 1;
+	if (references == NULL) goto not_shared;
+
+	/* Every snapshot is gone */
+	if (__atomic_load_n(references, __ATOMIC_ACQUIRE) == 1)
+		goto not_shared_anymore;
+
+	struct handles const * __restrict const handles = &data_section->handles;
+	struct data_symbol * __restrict const symbols = copy_of(
+		data_section->symbols,
+		data_section->max_symbols_before_realloc * sizeof(struct data_symbol),
+		data_section->stored * sizeof(struct data_symbol)
+	);
+	uint8_t * __restrict const image = copy_of(
+		data_section->image, data_section->max_image_size,
+		data_section->image_size
+	);
+	uint32_t * __restrict const indices = copy_of(
+		handles->indices, handles->max_slots * sizeof(uint32_t),
+		handles->max_slots * sizeof(uint32_t)
+	);
+	uint8_t * __restrict const generations = copy_of(
+		handles->generations, handles->max_slots * sizeof(uint8_t),
+		handles->max_slots * sizeof(uint8_t)
+	);
+
+	owned =
+		(symbols != NULL) &&
+		(image != NULL || data_section->image == NULL) &&
+		(indices != NULL || handles->indices == NULL) &&
+		(generations != NULL || handles->generations == NULL);
+	if (!owned) goto cant_copy_arrays;
+
+	/* The last snapshot may have been freed in the meantime */
+	if (__atomic_sub_fetch(references, 1, __ATOMIC_ACQ_REL) == 0) {
+		free_data_section_arrays(data_section);
+		free_durable_memory(references);
+	}
+
+	data_section->symbols = symbols;
+	data_section->image = image;
+	data_section->handles.indices = indices;
+	data_section->handles.generations = generations;
+	data_section->shared_arrays_references = NULL;
+	goto owned;
+
+cant_copy_arrays:
+	free_durable_memory(symbols);
+	free_durable_memory(image);
+	free_durable_memory(indices);
+	free_durable_memory(generations);
+	goto owned;
+
+not_shared_anymore:
+	free_durable_memory(references);
+	data_section->shared_arrays_references = NULL;
+owned:
+not_shared:
+	return owned;
+}
+
 unsigned int expand_data_symbols_storage_in
 (struct data_section * __restrict const data_section)
 {
+	unsigned int expanded = data_section_own_arrays(data_section);
+	if (!expanded) goto cant_own_symbols;
+
 	unsigned int current_symbols_max =
 		data_section->max_symbols_before_realloc;
 	unsigned int new_symbols_max = current_symbols_max * 2;
@@ -50,7 +530,7 @@ unsigned int expand_data_symbols_storage_in
 	struct data_symbol * __restrict const new_symbols_address =
 		reallocate_durable_memory(data_section->symbols, reallocated_memory);
 
-	unsigned int expanded = (new_symbols_address != NULL);
+	expanded = (new_symbols_address != NULL);
 	if (expanded) {
 		memset(
 			new_symbols_address+current_symbols_max, 0,
@@ -61,13 +541,79 @@ unsigned int expand_data_symbols_storage_in
 		data_section->max_symbols_before_realloc = new_symbols_max;
 	}
 	
+cant_own_symbols:
 	return expanded;
 }
 
+/* Handles are only tracked from the first symbol added. If they can't
+ * be allocated then, the IDs will be searched linearly for the whole
+ * life of the section. */
+static unsigned int data_section_track_handles
+(struct data_section * __restrict const data_section)
+{
+	struct handles * __restrict const handles = &data_section->handles;
+	if (!handles_ready(handles) &&
+	    data_section->stored == 0 && data_section->next_id == 0)
+		handles_init(handles, data_section->max_symbols_before_realloc);
+	return handles_ready(handles);
+}
+
+/* Reserve a new ID, resolving to nothing in this section yet */
+static struct handle_created data_section_new_id
+(struct data_section * __restrict const data_section)
+{
+	struct handle_created id = {
+		.created = 0,
+		.id = data_section->next_id
+	};
+	if (!data_section_own_arrays(data_section)) goto cant_own_handles;
+
+	id.created = 1;
+	if (data_section_track_handles(data_section))
+		id = handles_create(&data_section->handles, HANDLES_NOT_HERE);
+	else data_section->next_id += 1;
+
+cant_own_handles:
+	return id;
+}
+
+/* The ID won't be used anymore.
+ * IDs are never reused when searched linearly. */
+static void data_section_drop_id
+(struct data_section * __restrict const data_section,
+ uint32_t const id)
+{
+	if (handles_ready(&data_section->handles) &&
+	    data_section_own_arrays(data_section))
+		handles_release(&data_section->handles, id);
+}
+
+static void data_section_reindex_from
+(struct data_section * __restrict const data_section,
+ uint32_t const from_index)
+{
+	struct handles * __restrict const handles = &data_section->handles;
+	struct data_symbol const * __restrict const symbols =
+		data_section->symbols;
+
+	for (uint32_t s = from_index; s < data_section->stored; s++)
+		handles_set(handles, symbols[s].id, s);
+}
+
 struct uint32_result get_data_symbol_index
 (struct data_section const * __restrict const data_section,
  uint32_t id)
 {
+	if (handles_ready(&data_section->handles)) {
+		struct handles_result const handle =
+			handles_get(&data_section->handles, id);
+		struct uint32_result const handle_result = {
+			.found = handle.found,
+			.value = handle.index
+		};
+		return handle_result;
+	}
+
 	unsigned int const n_symbols = data_section->stored;
 	struct data_symbol * __restrict const symbols = data_section->symbols;
 	struct uint32_result returned_result = {
@@ -84,22 +630,826 @@ struct uint32_result get_data_symbol_index
 	return returned_result;
 }
 
-uint32_t data_address_upper16
-(data_address_func_sig)
+/* Exchange the symbols stored at the two indices, without updating the
+ * layout or the image. */
+static void swap_symbols_at
+(struct data_section * __restrict const data_section,
+ uint32_t const first_index,
+ uint32_t const second_index)
+{
+	struct data_symbol * __restrict const symbols_metadata =
+		data_section->symbols;
+
+	struct data_symbol temp = symbols_metadata[first_index];
+	symbols_metadata[first_index] = symbols_metadata[second_index];
+	symbols_metadata[second_index] = temp;
+
+	if (handles_ready(&data_section->handles)) {
+		handles_set(
+			&data_section->handles,
+			symbols_metadata[first_index].id, first_index
+		);
+		handles_set(
+			&data_section->handles,
+			symbols_metadata[second_index].id, second_index
+		);
+	}
+}
+
+/* The content actually stored for a symbol that is not an alias */
+static uint8_t const * stored_content
+(struct data_section const * __restrict const data_section,
+ struct data_symbol const * __restrict const symbol)
+{
+	return uses_contiguous_image(data_section) ?
+		data_section->image + symbol->offset :
+		symbol->data;
+}
+
+static uint32_t content_key
+(uint32_t const align,
+ uint32_t const size,
+ uint8_t const * __restrict const content)
+{
+	return hash_fold32(hash_bytes(content, size, align));
+}
+
+/* Register the content of the symbol, unless another symbol with the
+ * same content hash is already registered.
+ * On failure, the content index is dropped, and rebuilt on the next
+ * addition. */
+static void index_content_of
+(struct data_section * __restrict const data_section,
+ struct data_symbol const * __restrict const symbol)
+{
+	struct id_index * __restrict const content_index =
+		&data_section->content_index;
+	uint8_t const * __restrict const content =
+		stored_content(data_section, symbol);
+	if (!id_index_ready(content_index) || is_alias(symbol) || content == NULL)
+		goto nothing_to_index;
+
+	uint32_t const key = content_key(symbol->align, symbol->size, content);
+	if (!id_index_get(content_index, key).found &&
+	    !id_index_set(content_index, key, symbol->id))
+		id_index_free(content_index);
+
+nothing_to_index:
+	return;
+}
+
+/* Unregister the content of the symbol, if the symbol is the one
+ * registered for this content. Must be called before the content
+ * changes. */
+static void unindex_content_of
+(struct data_section * __restrict const data_section,
+ struct data_symbol const * __restrict const symbol)
+{
+	struct id_index * __restrict const content_index =
+		&data_section->content_index;
+	uint8_t const * __restrict const content =
+		stored_content(data_section, symbol);
+	if (!id_index_ready(content_index) || is_alias(symbol) || content == NULL)
+		goto nothing_to_unindex;
+
+	uint32_t const key = content_key(symbol->align, symbol->size, content);
+	struct id_index_result const registered =
+		id_index_get(content_index, key);
+	if (registered.found && registered.index == symbol->id)
+		id_index_remove(content_index, key);
+
+nothing_to_unindex:
+	return;
+}
+
+static unsigned int data_section_index_contents
+(struct data_section * __restrict const data_section)
+{
+	unsigned int const indexed = id_index_init(
+		&data_section->content_index,
+		data_section->max_symbols_before_realloc
+	);
+
+	for (uint32_t s = 0; s < data_section->stored && indexed; s++)
+		index_content_of(data_section, data_section->symbols+s);
+
+	return id_index_ready(&data_section->content_index);
+}
+
+static unsigned int deduplicating
+(struct data_section * __restrict const data_section)
+{
+	if (data_section->deduplicate &&
+	    !id_index_ready(&data_section->content_index))
+		data_section_index_contents(data_section);
+	return id_index_ready(&data_section->content_index);
+}
+
+/* Search a stored symbol with exactly the same alignment and content.
+ * Contents colliding on the same key are just not deduplicated. */
+static struct uint32_result find_same_content
+(struct data_section const * __restrict const data_section,
+ uint32_t const key,
+ uint32_t const align,
+ uint32_t const size,
+ uint8_t const * __restrict const content)
+{
+	struct uint32_result same = {
+		.found = 0,
+		.value = 0
+	};
+
+	struct id_index_result const registered =
+		id_index_get(&data_section->content_index, key);
+	if (!registered.found) goto not_found;
+
+	struct uint32_result const index =
+		get_data_symbol_index(data_section, registered.index);
+	if (!index.found) goto not_found;
+
+	struct data_symbol const * __restrict const symbol =
+		data_section->symbols+index.value;
+	uint8_t const * __restrict const symbol_content =
+		stored_content(data_section, symbol);
+
+	same.found =
+		!is_alias(symbol) && symbol_content != NULL &&
+		symbol->align == align && symbol->size == size &&
+		memcmp(symbol_content, content, size) == 0;
+	same.value = index.value;
+
+not_found:
+	return same;
+}
+
+/* Make the longest alias of the shared symbol, stored at shared_index,
+ * hold the content instead, and turn the shared symbol into an alias.
+ * The new holder takes the place of the shared symbol. When the new
+ * holder is only a suffix of the shared content, the following symbols
+ * can only move backward, so this cannot fail.
+ * The shared symbol is expected to be deleted or updated right after.
+ * Returns 0 if no alias of the shared symbol remains. */
+static unsigned int hand_over_shared_content
+(struct data_section * __restrict const data_section,
+ uint32_t const shared_index)
+{
+	struct data_symbol * __restrict const symbols = data_section->symbols;
+	uint32_t const n_symbols = data_section->stored;
+	uint32_t const shared_id = symbols[shared_index].id;
+
+	uint32_t holder_index = n_symbols;
+	for (uint32_t s = 0; s < n_symbols; s++) {
+		if (!is_alias(symbols+s) || symbols[s].alias_of != shared_id)
+			continue;
+		if (holder_index == n_symbols ||
+		    symbols[s].alias_offset < symbols[holder_index].alias_offset)
+			holder_index = s;
+		if (symbols[s].alias_offset == 0) break;
+	}
+
+	unsigned int const handed_over = (holder_index != n_symbols);
+	if (!handed_over) {
+		symbols[shared_index].flags &= ~DATA_SYMBOL_SHARED;
+		goto no_alias_left;
+	}
+
+	uint32_t const holder_id = symbols[holder_index].id;
+	uint32_t const shift = symbols[holder_index].alias_offset;
+	uint32_t const content_offset = symbols[shared_index].offset + shift;
+	unsigned int const layout_changed =
+		(shift != 0 || symbols[holder_index].align != symbols[shared_index].align);
+
+	unindex_content_of(data_section, symbols+shared_index);
+
+	swap_symbols_at(data_section, shared_index, holder_index);
+	symbols[shared_index].flags        = DATA_SYMBOL_SHARED;
+	symbols[shared_index].alias_of     = 0;
+	symbols[shared_index].alias_offset = 0;
+	symbols[shared_index].offset       = content_offset;
+	symbols[holder_index].flags        = DATA_SYMBOL_ALIAS;
+	symbols[holder_index].alias_of     = holder_id;
+	symbols[holder_index].alias_offset = 0;
+
+	for (uint32_t a = 0; a < n_symbols; a++) {
+		if (is_alias(symbols+a) && symbols[a].alias_of == shared_id) {
+			symbols[a].alias_of = holder_id;
+			symbols[a].alias_offset -= shift;
+		}
+	}
+
+	index_content_of(data_section, symbols+shared_index);
+
+	if (layout_changed) {
+		invalidate_layout_from(data_section, shared_index);
+		if (uses_contiguous_image(data_section))
+			relayout_image_from(data_section, shared_index, n_symbols);
+	}
+
+no_alias_left:
+	return handed_over;
+}
+
+/* The name to store for the symbol. Interned and bound to the symbol
+ * ID when the section uses a names table. */
+static uint8_t * interned_name_of
+(struct data_section * __restrict const data_section,
+ uint8_t const * __restrict const name,
+ uint32_t const id)
+{
+	uint8_t const * __restrict interned = name;
+	if (data_section->names != NULL && name != NULL)
+		interned = names_table_bind_data_symbol(data_section->names, name, id);
+	// Not being able to intern the name just leaves it unresolvable
+	return (uint8_t *) ((interned != NULL) ? interned : name);
+}
+
+static void rename_data_symbol
+(struct data_section * __restrict const data_section,
+ struct data_symbol * __restrict const symbol,
+ uint8_t const * __restrict const name)
+{
+	if (data_section->names != NULL && symbol->name != NULL)
+		names_table_unbind_data_symbol(
+			data_section->names, symbol->name, symbol->id
+		);
+	symbol->name = interned_name_of(data_section, name, symbol->id);
+}
+
+uint32_t data_address_upper16
+(data_address_func_sig)
+{
+	return data_address(data_section, data_id) >> 16;
+}
+
+uint32_t data_address_lower16
+(data_address_func_sig)
+{
+	uint32_t address = data_address(data_section, data_id) & 0xffff;
+	return address;
+}
+
+
+/* Append a symbol designated by new_id, handed out by this section or
+ * its parent */
+static struct data_section_symbol_added data_section_insert
+(struct data_section * __restrict const data_section,
+ uint32_t const new_id,
+ unsigned int const alignment,
+ unsigned int const size,
+ uint8_t const * __restrict const name,
+ uint8_t const * __restrict const data)
+{
+	struct data_section_symbol_added add_status = {
+		.id = 0,
+		.added = 0
+	};
+	if (!data_section_own_arrays(data_section))
+		goto no_more_memory_for_symbols;
+	
+	if (data_section->stored == data_section->max_symbols_before_realloc)
+		if (!expand_data_symbols_storage_in(data_section))
+			goto no_more_memory_for_symbols;
+	
+	uint32_t const next_index = data_section->stored;
+
+	/* Only resolved once the symbol is actually stored */
+	struct handles * __restrict const handles = &data_section->handles;
+	unsigned int const handled = data_section_track_handles(data_section);
+	if (handled && !handles_adopt(handles, new_id, HANDLES_NOT_HERE))
+		goto no_more_memory_for_handles;
+
+	struct uint32_result same_content = {
+		.found = 0,
+		.value = 0
+	};
+	if (data != NULL && deduplicating(data_section))
+		same_content = find_same_content(
+			data_section, content_key(alignment, size, data),
+			alignment, size, data
+		);
+
+	uint32_t image_offset = 0;
+	if (uses_contiguous_image(data_section) && !same_content.found) {
+		uint32_t const image_end = data_section->image_size;
+		uint32_t const base_address = data_section->base_address;
+		image_offset =
+			round_to(base_address + image_end, alignment) - base_address;
+		if (!reserve_image_space(data_section, image_offset + size))
+			goto no_more_memory_for_content;
+
+		memset(data_section->image+image_end, 0, image_offset - image_end);
+		copy_symbol_content(data_section->image+image_offset, data, size);
+		data_section->image_size = image_offset + size;
+	}
+
+	if (handled) handles_set(handles, new_id, next_index);
+
+	if (data_section->layout == NULL)
+		data_section->layout =
+			generate_data_section_layout(data_section->max_symbols_before_realloc);
+	invalidate_layout_from(data_section, next_index);
+
+	data_section->symbols[next_index].id = new_id;
+	data_section->symbols[next_index].align = alignment;
+	data_section->symbols[next_index].size = size;
+	data_section->symbols[next_index].name =
+		interned_name_of(data_section, name, new_id);
+	data_section->symbols[next_index].data =
+		uses_contiguous_image(data_section) ? NULL : data;
+	data_section->symbols[next_index].offset = image_offset;
+	data_section->symbols[next_index].flags = 0;
+	data_section->symbols[next_index].alias_of = 0;
+	data_section->symbols[next_index].alias_offset = 0;
+
+	if (same_content.found) {
+		data_section->symbols[next_index].flags = DATA_SYMBOL_ALIAS;
+		data_section->symbols[next_index].alias_of =
+			data_section->symbols[same_content.value].id;
+		data_section->symbols[same_content.value].flags |= DATA_SYMBOL_SHARED;
+	}
+	else index_content_of(data_section, data_section->symbols+next_index);
+
+	data_section->stored += 1;
+	if (alignment > data_section->max_align)
+		data_section->max_align = alignment;
+
+	add_status.added = 1;
+	add_status.id = new_id;
+
+no_more_memory_for_content:
+no_more_memory_for_handles:
+no_more_memory_for_symbols:
+	return add_status;
+}
+
+struct data_section_symbol_added data_section_add
+(struct data_section * __restrict const data_section,
+ unsigned int const alignment,
+ unsigned int const size,
+ uint8_t const * __restrict const name,
+ uint8_t const * __restrict const data)
+{
+	struct data_section_symbol_added add_status = {
+		.id = 0,
+		.added = 0
+	};
+
+	struct handle_created const new_id = data_section_new_id(data_section);
+	if (!new_id.created) goto cant_create_id;
+
+	add_status = data_section_insert(
+		data_section, new_id.id, alignment, size, name, data
+	);
+	if (!add_status.added) data_section_drop_id(data_section, new_id.id);
+
+cant_create_id:
+	return add_status;
+}
+
+/* Subsections share the IDs of their parent section */
+static struct data_section_symbol_added data_subsection_add
+(struct data_section * __restrict const data_section,
+ struct data_section * __restrict * __restrict const subsection,
+ unsigned int const alignment,
+ unsigned int const size,
+ uint8_t const * __restrict const name,
+ uint8_t const * __restrict const data)
+{
+	struct data_section_symbol_added add_status = {
+		.id = 0,
+		.added = 0
+	};
+
+	if (*subsection == NULL) {
+		/* Zero-filled symbols have no content to copy : an image would
+		 * reserve and clear their whole size for nothing */
+		enum data_section_storage const storage =
+			(subsection == &data_section->zero_fill) ?
+			data_storage_borrowed_pointers : data_section->storage;
+		*subsection = generate_data_section_with_storage(storage);
+		if (*subsection != NULL) {
+			data_section_set_deduplication(
+				*subsection, data_section->deduplicate
+			);
+			(*subsection)->names = data_section->names;
+			data_section_set_base_address(
+				*subsection, data_section->read_only_base_address
+			);
+		}
+	}
+	if (*subsection == NULL) goto cant_allocate_subsection;
+
+	struct handle_created const new_id = data_section_new_id(data_section);
+	if (!new_id.created) goto cant_create_id;
+
+	add_status = data_section_insert(
+		*subsection, new_id.id, alignment, size, name, data
+	);
+	if (!add_status.added) data_section_drop_id(data_section, new_id.id);
+
+cant_create_id:
+cant_allocate_subsection:
+	return add_status;
+}
+
+struct data_section_symbol_added data_section_add_zero_fill
+(struct data_section * __restrict const data_section,
+ unsigned int const alignment,
+ unsigned int const size,
+ uint8_t const * __restrict const name)
+{
+	return data_subsection_add(
+		data_section, &data_section->zero_fill, alignment, size, name, NULL
+	);
+}
+
+struct data_section_symbol_added data_section_add_read_only
+(struct data_section * __restrict const data_section,
+ unsigned int const alignment,
+ unsigned int const size,
+ uint8_t const * __restrict const name,
+ uint8_t const * __restrict const data)
+{
+	return data_subsection_add(
+		data_section, &data_section->read_only, alignment, size, name, data
+	);
+}
+
+/* The subsection storing a symbol that is not in the written content */
+static struct data_section * data_subsection_holding
+(struct data_section const * __restrict const data_section,
+ uint32_t const id)
+{
+	struct data_section * __restrict holder = NULL;
+	if (data_section->zero_fill != NULL &&
+	    get_data_symbol_index(data_section->zero_fill, id).found)
+		holder = data_section->zero_fill;
+	else if (data_section->read_only != NULL &&
+	         get_data_symbol_index(data_section->read_only, id).found)
+		holder = data_section->read_only;
+	return holder;
+}
+
+struct symbol_found get_data_symbol_infos
+(struct data_section const * __restrict const data_section,
+ uint32_t id)
+{
+
+	struct uint32_result results = get_data_symbol_index(data_section, id);
+	struct symbol_found returned_results = {
+		.found = results.found,
+		.address = data_section->symbols+results.value,
+	};
+	
+	return returned_results;
+}
+
+unsigned int data_section_has_symbol
+(struct data_section const * __restrict const data_section,
+ uint32_t const id)
+{
+	return get_data_symbol_index(data_section, id).found ||
+		data_subsection_holding(data_section, id) != NULL;
+}
+
+/* After removing or realigning a symbol having the largest alignment */
+static void data_section_recompute_max_align
+(struct data_section * __restrict const data_section)
+{
+	uint32_t max_align = 1;
+	for (uint32_t s = 0; s < data_section->stored; s++)
+		if (data_section->symbols[s].align > max_align)
+			max_align = data_section->symbols[s].align;
+	data_section->max_align = max_align;
+}
+
+void update_data_symbol
+(struct data_section * __restrict const data_section,
+ uint32_t const id,
+ uint32_t const align,
+ uint32_t const data_size,
+ uint8_t const * __restrict const name,
+ uint8_t const * __restrict const data)
+{
+	struct data_section * __restrict holder = NULL;
+	if (!data_section_own_arrays(data_section)) goto cant_own_symbols;
+
+	struct symbol_found metadata =
+		get_data_symbol_infos(data_section, id);
+	
+	if (!metadata.found) goto not_in_written_content;
+
+	struct data_symbol * __restrict symbol = metadata.address;
+
+	unsigned int const shares_content =
+		(symbol->flags & (DATA_SYMBOL_ALIAS|DATA_SYMBOL_SHARED)) &&
+		data != NULL && symbol->align == align && symbol->size == data_size &&
+		memcmp(data_symbol_content(data_section, symbol), data, data_size) == 0;
+	if (shares_content) {
+		rename_data_symbol(data_section, symbol, name);
+		if (!uses_contiguous_image(data_section))
+			symbol->data = (uint8_t *) data;
+		goto content_still_shared;
+	}
+
+	/* The aliases of this symbol keep the current content */
+	if ((symbol->flags & DATA_SYMBOL_SHARED) &&
+	    hand_over_shared_content(data_section, symbol - data_section->symbols))
+		symbol = get_data_symbol_infos(data_section, id).address;
+
+	unindex_content_of(data_section, symbol);
+
+	uint32_t const index = symbol - data_section->symbols;
+	unsigned int const layout_changed =
+		(is_alias(symbol) || symbol->align != align || symbol->size != data_size);
+	uint32_t const old_align = symbol->align;
+	uint32_t const old_size  = symbol->size;
+	uint32_t const old_flags = symbol->flags;
+	uint32_t const old_alias_offset = symbol->alias_offset;
+
+	if (layout_changed) invalidate_layout_from(data_section, index);
+	symbol->align = align;
+	if (align > data_section->max_align) data_section->max_align = align;
+	else if (old_align == data_section->max_align)
+		data_section_recompute_max_align(data_section);
+	symbol->size = data_size;
+	rename_data_symbol(data_section, symbol, name);
+	symbol->flags &= ~DATA_SYMBOL_ALIAS;
+	symbol->alias_offset = 0;
+
+	if (uses_contiguous_image(data_section)) {
+		if (layout_changed && !relayout_image_from(data_section, index, index)) {
+			symbol->align = old_align;
+			symbol->size  = old_size;
+			symbol->flags = old_flags;
+			symbol->alias_offset = old_alias_offset;
+			data_section_recompute_max_align(data_section);
+			invalidate_layout_from(data_section, index);
+			goto cant_relayout_image;
+		}
+		copy_symbol_content(
+			data_section->image+symbol->offset, data, data_size
+		);
+	}
+	else symbol->data = data;
+
+cant_relayout_image:
+	index_content_of(data_section, symbol);
+	goto updated;
+
+not_in_written_content:
+	holder = data_subsection_holding(data_section, id);
+	// Zero-filled symbols stay zero-filled
+	if (holder != NULL)
+		update_data_symbol(
+			holder, id, align, data_size, name,
+			(holder == data_section->zero_fill) ? NULL : data
+		);
+updated:
+content_still_shared:
+cant_own_symbols:
+	return;
+}
+
+/* Remove the symbol from this section only. Its ID stays reserved. */
+static void remove_data_symbol
+(struct data_section * __restrict const data_section,
+ uint32_t const id)
+{
+	struct uint32_result index =
+		get_data_symbol_index(data_section, id);
+	if (!index.found || !data_section_own_arrays(data_section))
+		goto not_stored_here;
+
+	/* Leave the content to one of the aliases, if any. The deleted
+	 * symbol then takes no space. */
+	if ((data_section->symbols[index.value].flags & DATA_SYMBOL_SHARED) &&
+	    hand_over_shared_content(data_section, index.value))
+		index = get_data_symbol_index(data_section, id);
+
+	unindex_content_of(data_section, data_section->symbols+index.value);
+	if (data_section->names != NULL &&
+	    data_section->symbols[index.value].name != NULL)
+		names_table_unbind_data_symbol(
+			data_section->names, data_section->symbols[index.value].name, id
+		);
+
+	uint32_t const symbols_stored = data_section->stored;
+	uint32_t const removed_align = data_section->symbols[index.value].align;
+	uint32_t const next_index = index.value + 1;
+	uint32_t const remaining_indices_after = symbols_stored - next_index;
+	uint32_t const remaining_metadata_size =
+		remaining_indices_after * sizeof(struct data_symbol);
+	
+	memmove(
+		data_section->symbols+index.value, data_section->symbols+next_index,
+		remaining_metadata_size
+	);
+	
+	data_section->stored -= 1;
+	if (removed_align == data_section->max_align)
+		data_section_recompute_max_align(data_section);
+	invalidate_layout_from(data_section, index.value);
+
+	/* The following symbols can only move backward, so this is done in
+	 * place and cannot fail. */
+	if (uses_contiguous_image(data_section))
+		relayout_image_from(data_section, index.value, symbols_stored);
+
+	if (handles_ready(&data_section->handles)) {
+		handles_forget(&data_section->handles, id);
+		data_section_reindex_from(data_section, index.value);
+	}
+
+not_stored_here:
+	return;
+}
+
+void delete_data_symbol
+(struct data_section * __restrict const data_section,
+ uint32_t id)
+{
+	struct data_section * __restrict holder = data_section;
+	if (!get_data_symbol_index(data_section, id).found)
+		holder = data_subsection_holding(data_section, id);
+	if (holder == NULL) goto not_found;
+
+	remove_data_symbol(holder, id);
+	data_section_drop_id(data_section, id);
+
+not_found:
+	return;
+}
+
+struct data_section * data_section_snapshot
+(struct data_section * __restrict const data_section)
+{
+	struct data_section * __restrict snapshot = NULL;
+	struct data_section * __restrict zero_fill = NULL;
+	struct data_section * __restrict read_only = NULL;
+
+	if (data_section->shared_arrays_references == NULL) {
+		uint32_t * __restrict const references =
+			allocate_durable_memory(sizeof(uint32_t));
+		if (references == NULL) goto cant_share_arrays;
+		*references = 1;
+		data_section->shared_arrays_references = references;
+	}
+
+	if (data_section->zero_fill != NULL) {
+		zero_fill = data_section_snapshot(data_section->zero_fill);
+		if (zero_fill == NULL) goto cant_snapshot_subsections;
+	}
+	if (data_section->read_only != NULL) {
+		read_only = data_section_snapshot(data_section->read_only);
+		if (read_only == NULL) goto cant_snapshot_subsections;
+	}
+
+	snapshot = allocate_durable_memory(sizeof(struct data_section));
+	if (snapshot == NULL) goto cant_snapshot_subsections;
+
+	/* The layout is only a cache, so the snapshot gets its own. Without
+	 * one, addresses are computed by walking the symbols. */
+	*snapshot = *data_section;
+	snapshot->layout = generate_data_section_layout(
+		data_section->max_symbols_before_realloc
+	);
+	snapshot->deduplicate = 0;
+	snapshot->content_index.slots = NULL;
+	snapshot->zero_fill = zero_fill;
+	snapshot->read_only = read_only;
+	snapshot->names = NULL;
+	__atomic_add_fetch(
+		data_section->shared_arrays_references, 1, __ATOMIC_ACQ_REL
+	);
+	goto snapshot_taken;
+
+cant_snapshot_subsections:
+	if (zero_fill != NULL) free_data_section_snapshot(zero_fill);
+	if (read_only != NULL) free_data_section_snapshot(read_only);
+cant_share_arrays:
+snapshot_taken:
+	return snapshot;
+}
+
+void free_data_section_snapshot
+(struct data_section * __restrict const snapshot)
+{
+	uint32_t * __restrict const references =
+		snapshot->shared_arrays_references;
+	unsigned int const last_reference = (references == NULL) ||
+		__atomic_sub_fetch(references, 1, __ATOMIC_ACQ_REL) == 0;
+	if (last_reference) {
+		free_data_section_arrays(snapshot);
+		free_durable_memory(references);
+	}
+
+	if (snapshot->layout != NULL) free_data_section_layout(snapshot->layout);
+	if (snapshot->zero_fill != NULL)
+		free_data_section_snapshot(snapshot->zero_fill);
+	if (snapshot->read_only != NULL)
+		free_data_section_snapshot(snapshot->read_only);
+	id_index_free(&snapshot->content_index);
+	free_durable_memory(snapshot);
+}
+
+void data_section_open_batches
+(struct data_section * __restrict const data_section)
+{
+	data_section_track_handles(data_section);
+	data_section->batches_next_slot =
+		handles_ready(&data_section->handles) ?
+		data_section->handles.used :
+		data_section->next_id;
+}
+
+struct data_symbols_batch * generate_data_symbols_batch
+(struct data_section * __restrict const data_section)
+{
+	uint32_t const default_n_symbols = 256;
+	struct data_symbols_batch * __restrict batch = NULL;
+
+	struct data_symbol * __restrict const symbols =
+		allocate_durable_memory(default_n_symbols * sizeof(struct data_symbol));
+	if (symbols == NULL) goto cant_allocate_symbols;
+
+	batch = allocate_durable_memory(sizeof(struct data_symbols_batch));
+	if (batch == NULL) goto cant_allocate_batch;
+
+	struct data_symbols_batch const new_batch = {
+		.section     = data_section,
+		.symbols     = symbols,
+		.stored      = 0,
+		.max_symbols = default_n_symbols,
+		.next_slot   = 0,
+		.end_slot    = 0
+	};
+	*batch = new_batch;
+	goto batch_generated;
+
+cant_allocate_batch:
+	free_durable_memory(symbols);
+batch_generated:
+cant_allocate_symbols:
+	return batch;
+}
+
+/* Hand out again the slots reserved by the batch, from first_slot to
+ * the end of its block, and the slots of the first n_ids ids */
+static void data_symbols_batch_release_slots
+(struct data_symbols_batch * __restrict const batch,
+ uint32_t const first_slot,
+ struct data_symbol const * __restrict const symbols,
+ uint32_t const n_ids)
 {
-	return data_address(data_section, data_id) >> 16;
+	struct data_section * __restrict const data_section = batch->section;
+	if (handles_ready(&data_section->handles)) {
+		struct handles * __restrict const handles = &data_section->handles;
+		for (uint32_t slot = first_slot; slot < batch->end_slot; slot++)
+			if (handles_adopt(handles, slot, HANDLES_NOT_HERE))
+				handles_release(handles, slot);
+		for (uint32_t s = 0; s < n_ids; s++)
+			if (handles_adopt(handles, symbols[s].id, HANDLES_NOT_HERE))
+				handles_release(handles, symbols[s].id);
+		batch->end_slot = first_slot;
+	}
+	/* Without handles, IDs are never reused */
+	else if (data_section->next_id < batch->end_slot)
+		data_section->next_id = batch->end_slot;
 }
 
-uint32_t data_address_lower16
-(data_address_func_sig)
+void free_data_symbols_batch
+(struct data_symbols_batch * __restrict const batch)
 {
-	uint32_t address = data_address(data_section, data_id) & 0xffff;
-	return address;
+	/* The IDs of the symbols left are reserved too */
+	if (data_section_own_arrays(batch->section))
+		data_symbols_batch_release_slots(
+			batch, batch->next_slot, batch->symbols, batch->stored
+		);
+	free_durable_memory(batch->symbols);
+	free_durable_memory(batch);
 }
 
+/* The only point of contention between the batches */
+static unsigned int data_symbols_batch_reserve_slots
+(struct data_symbols_batch * __restrict const batch)
+{
+	uint32_t const block_size = 256;
+	uint32_t const first_slot = __atomic_fetch_add(
+		&batch->section->batches_next_slot, block_size, __ATOMIC_RELAXED
+	);
 
-struct data_section_symbol_added data_section_add
-(struct data_section * __restrict const data_section,
+	unsigned int const reserved =
+		(first_slot <= HANDLES_MAX_SLOTS - block_size);
+	if (reserved) {
+		batch->next_slot = first_slot;
+		batch->end_slot  = first_slot + block_size;
+	}
+	return reserved;
+}
+
+struct data_section_symbol_added data_symbols_batch_add
+(struct data_symbols_batch * __restrict const batch,
  unsigned int const alignment,
  unsigned int const size,
  uint8_t const * __restrict const name,
@@ -109,131 +1459,452 @@ struct data_section_symbol_added data_section_add
 		.id = 0,
 		.added = 0
 	};
-	
-	if (data_section->stored == data_section->max_symbols_before_realloc)
-		if (!expand_data_symbols_storage_in(data_section))
-			goto no_more_memory_for_symbols;
-	
-	uint32_t const next_index = data_section->stored;
-	uint32_t const new_id = data_section->next_id;
 
-	data_section->symbols[next_index].id = new_id;
-	data_section->symbols[next_index].align = alignment;
-	data_section->symbols[next_index].size = size;
-	data_section->symbols[next_index].name = name;
-	data_section->symbols[next_index].data = data;
+	if (batch->stored == batch->max_symbols) {
+		uint32_t const new_max = batch->max_symbols * 2;
+		struct data_symbol * __restrict const new_symbols =
+			reallocate_durable_memory(
+				batch->symbols, new_max * sizeof(struct data_symbol)
+			);
+		if (new_symbols == NULL) goto cant_expand_batch;
+		batch->symbols = new_symbols;
+		batch->max_symbols = new_max;
+	}
 
-	data_section->stored += 1;
-	data_section->next_id += 1;
+	if (batch->next_slot == batch->end_slot &&
+	    !data_symbols_batch_reserve_slots(batch))
+		goto cant_reserve_id;
+
+	/* Fresh slots are always at their first generation */
+	uint32_t const id = batch->next_slot;
+	batch->next_slot += 1;
+
+	struct data_symbol * __restrict const symbol =
+		batch->symbols+batch->stored;
+	symbol->id    = id;
+	symbol->align = alignment;
+	symbol->size  = size;
+	symbol->name  = (uint8_t *) name;
+	symbol->data  = (uint8_t *) data;
+	batch->stored += 1;
 
 	add_status.added = 1;
-	add_status.id = new_id;
+	add_status.id = id;
 
-no_more_memory_for_symbols:
+cant_reserve_id:
+cant_expand_batch:
 	return add_status;
 }
 
-struct symbol_found get_data_symbol_infos
-(struct data_section const * __restrict const data_section,
- uint32_t id)
+unsigned int data_section_commit_batch
+(struct data_section * __restrict const data_section,
+ struct data_symbols_batch * __restrict const batch)
 {
+	struct data_symbol const * __restrict const symbols = batch->symbols;
+	uint32_t const n_symbols = batch->stored;
 
-	struct uint32_result results = get_data_symbol_index(data_section, id);
-	struct symbol_found returned_results = {
-		.found = results.found,
-		.address = data_section->symbols+results.value,
-	};
-	
-	return returned_results;
-}
+	unsigned int committed = data_section_own_arrays(data_section);
+	if (!committed) goto cant_own_arrays;
 
-void update_data_symbol
-(struct data_section * __restrict const data_section,
- uint32_t const id,
- uint32_t const align,
- uint32_t const data_size,
- uint8_t const * __restrict const name,
- uint8_t const * __restrict const data)
-{
-	struct symbol_found metadata =
-		get_data_symbol_infos(data_section, id);
-	
-	if (metadata.found) {
-		struct data_symbol * __restrict const symbol = metadata.address;
-		symbol->align = align;
-		symbol->size = data_size;
-		symbol->name = name;
-		symbol->data = data;
+	uint32_t s = 0;
+	for (; s < n_symbols; s++) {
+		struct data_section_symbol_added const added = data_section_insert(
+			data_section, symbols[s].id, symbols[s].align, symbols[s].size,
+			symbols[s].name, symbols[s].data
+		);
+		if (!added.added) break;
 	}
-}
 
-void delete_data_symbol
-(struct data_section * __restrict const data_section,
- uint32_t id)
-{
-	struct uint32_result const index =
-		get_data_symbol_index(data_section, id);
-	if (!index.found) goto id_not_found;
+	committed = (s == n_symbols);
+	if (!committed) {
+		memmove(
+			batch->symbols, batch->symbols+s,
+			(n_symbols - s) * sizeof(struct data_symbol)
+		);
+		batch->stored = n_symbols - s;
+		goto cant_commit_everything;
+	}
+	batch->stored = 0;
 
-	uint32_t const symbols_stored = data_section->stored;
-	uint32_t const next_index = index.value + 1;
-	uint32_t const remaining_indices_after = symbols_stored - next_index;
-	uint32_t const remaining_metadata_size =
-		remaining_indices_after * sizeof(struct data_symbol);
-	
-	struct data_symbol * __restrict const temp_symbols_buffer =
-		malloc(remaining_metadata_size);
-	
-	if (temp_symbols_buffer == NULL)
-		goto cant_allocate_temp_symbols_buffer;
-		
-	memcpy(
-		temp_symbols_buffer, data_section->symbols+next_index,
-		remaining_metadata_size
-	);
-	
-	memcpy(
-		data_section->symbols+index.value, temp_symbols_buffer,
-		remaining_metadata_size
-	);
-	
-	free(temp_symbols_buffer);
-	
-	data_section->stored -= 1;
-	
-cant_allocate_temp_symbols_buffer:
-id_not_found:
-	return;
+	/* Hand out the reserved slots that were not used */
+	data_symbols_batch_release_slots(batch, batch->next_slot, NULL, 0);
+
+cant_commit_everything:
+cant_own_arrays:
+	return committed;
 }
 
 void exchange_symbols_order
 (struct data_section * __restrict const data_section,
  unsigned int const id1, unsigned int const id2)
 {
+	struct data_section * __restrict holder = NULL;
 
 	if (id1 == id2) goto nothing_to_do;
+	if (!data_section_own_arrays(data_section)) goto cant_own_symbols;
 	struct uint32_result const first_index = get_data_symbol_index(
 		data_section, id1
 	);
 	struct uint32_result const second_index = get_data_symbol_index(
 		data_section, id2
 	);
+	if ((first_index.found | second_index.found) == 0)
+		goto not_in_written_content;
 	if ((first_index.found & second_index.found) == 0)
 		goto id_not_found;
 	
-	struct data_symbol * __restrict const symbols_metadata =
-		data_section->symbols;
+	swap_symbols_at(data_section, first_index.value, second_index.value);
 
-	struct data_symbol temp = symbols_metadata[first_index.value];
-	symbols_metadata[first_index.value] = 
-		symbols_metadata[second_index.value];
-	symbols_metadata[second_index.value] = temp;
-	
+	uint32_t const first_index_changed =
+		(first_index.value < second_index.value) ?
+		first_index.value : second_index.value;
+	invalidate_layout_from(data_section, first_index_changed);
+
+	if (uses_contiguous_image(data_section) &&
+	    !relayout_image_from(data_section, first_index_changed, data_section->stored)) {
+		swap_symbols_at(data_section, first_index.value, second_index.value);
+		invalidate_layout_from(data_section, first_index_changed);
+	}
+	goto exchanged;
+
+not_in_written_content:
+	holder = data_subsection_holding(data_section, id1);
+	if (holder != NULL && holder == data_subsection_holding(data_section, id2))
+		exchange_symbols_order(holder, id1, id2);
+exchanged:
 id_not_found:
+cant_own_symbols:
 nothing_to_do:
 	return;
 }
 
+/* Reorder the symbols so that the symbol identified by ids[p] ends at
+ * index p. ids must be a permutation of the stored symbols IDs.
+ * Returns the first index that changed, or the number of symbols
+ * stored if nothing changed. */
+static uint32_t reorder_symbols
+(struct data_section * __restrict const data_section,
+ uint32_t const * __restrict const ids)
+{
+	uint32_t const n_symbols = data_section->stored;
+	uint32_t first_index_changed = n_symbols;
+
+	for (uint32_t p = 0; p < n_symbols; p++) {
+		/* Every index before p is already in place, so the symbol is
+		 * necessarily found after p. */
+		uint32_t const current_index =
+			get_data_symbol_index(data_section, ids[p]).value;
+		if (current_index != p) {
+			swap_symbols_at(data_section, p, current_index);
+			if (first_index_changed == n_symbols) first_index_changed = p;
+		}
+	}
+
+	invalidate_layout_from(data_section, first_index_changed);
+	return first_index_changed;
+}
+
+struct symbol_layout_key {
+	uint32_t hot_rank;
+	uint32_t align;
+	uint32_t misaligned_size;
+	uint32_t index;
+};
+
+static int compare_symbol_layout_keys
+(void const * a, void const * b)
+{
+	struct symbol_layout_key const * __restrict const key_a = a;
+	struct symbol_layout_key const * __restrict const key_b = b;
+
+	/* Hot symbols first, in the order provided.
+	 * Then the biggest alignments first, symbols which keep the
+	 * alignment intact first, and the original order otherwise. */
+	int order = (key_a->hot_rank > key_b->hot_rank) -
+	            (key_a->hot_rank < key_b->hot_rank);
+	if (order == 0)
+		order = (key_a->align < key_b->align) - (key_a->align > key_b->align);
+	if (order == 0)
+		order = (key_a->misaligned_size > key_b->misaligned_size) -
+		        (key_a->misaligned_size < key_b->misaligned_size);
+	if (order == 0)
+		order = (key_a->index > key_b->index) - (key_a->index < key_b->index);
+	return order;
+}
+
+struct data_section_layout_report data_section_optimize_layout
+(struct data_section * __restrict const data_section,
+ uint32_t const * __restrict const hot_ids,
+ uint32_t const n_hot_ids)
+{
+	uint32_t const n_symbols = data_section->stored;
+	uint32_t const size_before = data_section_size(data_section);
+	struct data_section_layout_report report = {
+		.optimized   = 0,
+		.size_before = size_before,
+		.size_after  = size_before,
+		.bytes_saved = 0
+	};
+
+	uint32_t const not_hot = 0xffffffff;
+
+	struct symbol_layout_key * __restrict const keys =
+		allocate_temporary_memory(n_symbols * sizeof(struct symbol_layout_key));
+	uint32_t * __restrict const original_ids =
+		allocate_temporary_memory(n_symbols * sizeof(uint32_t));
+	uint32_t * __restrict const new_ids =
+		allocate_temporary_memory(n_symbols * sizeof(uint32_t));
+
+	if (keys == NULL || original_ids == NULL || new_ids == NULL ||
+	    !data_section_own_arrays(data_section))
+		goto cant_allocate_sorting_space;
+
+	struct data_symbol const * __restrict const symbols =
+		data_section->symbols;
+	for (uint32_t s = 0; s < n_symbols; s++) {
+		keys[s].hot_rank = not_hot;
+		keys[s].align = symbols[s].align;
+		keys[s].misaligned_size = symbols[s].size % symbols[s].align;
+		keys[s].index = s;
+		original_ids[s] = symbols[s].id;
+	}
+
+	for (uint32_t h = n_hot_ids; h-- > 0;) {
+		struct uint32_result index =
+			get_data_symbol_index(data_section, hot_ids[h]);
+		// Aliases are hot through the symbol holding their content
+		if (index.found && is_alias(symbols+index.value))
+			index = get_data_symbol_index(
+				data_section, symbols[index.value].alias_of
+			);
+		if (index.found) keys[index.value].hot_rank = h;
+	}
+
+	qsort(
+		keys, n_symbols, sizeof(struct symbol_layout_key),
+		compare_symbol_layout_keys
+	);
+
+	for (uint32_t p = 0; p < n_symbols; p++)
+		new_ids[p] = symbols[keys[p].index].id;
+
+	uint32_t const first_index_changed =
+		reorder_symbols(data_section, new_ids);
+	if (first_index_changed == n_symbols) goto already_optimal;
+
+	if (uses_contiguous_image(data_section) &&
+	    !relayout_image_from(data_section, first_index_changed, n_symbols))
+		goto cant_relayout_image;
+
+	uint32_t const size_after = data_section_size(data_section);
+
+	/* The alignment buckets are only a heuristic. Never make things
+	 * worse, unless the user asked for a specific order. */
+	if (size_after > size_before && n_hot_ids == 0)
+		goto worse_than_before;
+
+	report.optimized   = 1;
+	report.size_after  = size_after;
+	report.bytes_saved = (int32_t) (size_before - size_after);
+	goto optimized;
+
+worse_than_before:
+cant_relayout_image:
+	/* Going back can't fail, since the image was already big enough to
+	 * go through the new order. */
+	if (uses_contiguous_image(data_section))
+		relayout_image_from(
+			data_section, reorder_symbols(data_section, original_ids),
+			n_symbols
+		);
+	else reorder_symbols(data_section, original_ids);
+
+optimized:
+already_optimal:
+cant_allocate_sorting_space:
+	free_temporary_memory(keys);
+	free_temporary_memory(original_ids);
+	free_temporary_memory(new_ids);
+	return report;
+}
+
+struct string_suffix_key {
+	uint8_t const * content;
+	uint32_t size;
+	uint32_t index;
+};
+
+/* Order the strings as if they were read backward, so that every
+ * string is directly followed by the strings it is a suffix of. */
+static int compare_string_suffix_keys
+(void const * a, void const * b)
+{
+	struct string_suffix_key const * __restrict const key_a = a;
+	struct string_suffix_key const * __restrict const key_b = b;
+
+	uint32_t const shortest =
+		(key_a->size < key_b->size) ? key_a->size : key_b->size;
+	uint8_t const * __restrict const last_a = key_a->content + key_a->size - 1;
+	uint8_t const * __restrict const last_b = key_b->content + key_b->size - 1;
+
+	int order = 0;
+	for (uint32_t c = 0; c < shortest && order == 0; c++)
+		order = (*(last_a - c) > *(last_b - c)) - (*(last_a - c) < *(last_b - c));
+	if (order == 0)
+		order = (key_a->size > key_b->size) - (key_a->size < key_b->size);
+	if (order == 0)
+		order = (key_a->index > key_b->index) - (key_a->index < key_b->index);
+	return order;
+}
+
+static unsigned int is_suffix_of
+(struct string_suffix_key const * __restrict const suffix,
+ struct string_suffix_key const * __restrict const string)
+{
+	return suffix->size <= string->size &&
+		memcmp(
+			string->content + string->size - suffix->size,
+			suffix->content, suffix->size
+		) == 0;
+}
+
+/* The suffix keeps its own alignment once merged */
+static unsigned int can_be_stored_in
+(struct data_symbol const * __restrict const suffix,
+ struct data_symbol const * __restrict const string)
+{
+	return string->align % suffix->align == 0 &&
+		(string->size - suffix->size) % suffix->align == 0;
+}
+
+static struct data_section_layout_report merge_strings_in
+(struct data_section * __restrict const data_section)
+{
+	uint32_t const n_symbols = data_section->stored;
+	uint32_t const size_before = data_section_size(data_section);
+	struct data_section_layout_report report = {
+		.optimized   = 0,
+		.size_before = size_before,
+		.size_after  = size_before,
+		.bytes_saved = 0
+	};
+
+	struct data_symbol * __restrict const symbols = data_section->symbols;
+
+	struct string_suffix_key * __restrict const keys =
+		allocate_temporary_memory(n_symbols * sizeof(struct string_suffix_key));
+	uint32_t * __restrict const holders =
+		allocate_temporary_memory(n_symbols * sizeof(uint32_t));
+
+	if (keys == NULL || holders == NULL ||
+	    !data_section_own_arrays(data_section))
+		goto cant_allocate_sorting_space;
+
+	/* Relaying out the image afterwards only moves the content backward,
+	 * as long as the addresses can be computed. */
+	if (uses_contiguous_image(data_section) &&
+	    !compute_layout_up_to(data_section, n_symbols))
+		goto cant_compute_layout;
+
+	uint32_t n_strings = 0;
+	for (uint32_t s = 0; s < n_symbols; s++) {
+		uint8_t const * __restrict const content =
+			stored_content(data_section, symbols+s);
+		uint32_t const size = symbols[s].size;
+		if (is_alias(symbols+s) || content == NULL || size == 0 ||
+		    content[size-1] != 0)
+			continue;
+		keys[n_strings].content = content;
+		keys[n_strings].size    = size;
+		keys[n_strings].index   = s;
+		n_strings++;
+	}
+
+	qsort(
+		keys, n_strings, sizeof(struct string_suffix_key),
+		compare_string_suffix_keys
+	);
+
+	/* A string that is a suffix of another one is, at least, a suffix
+	 * of the string following it. Which is itself stored in the
+	 * longest string of the chain. */
+	for (uint32_t k = n_strings; k-- > 0;) {
+		holders[k] = k;
+		if (k + 1 == n_strings || !is_suffix_of(keys+k, keys+k+1))
+			continue;
+		uint32_t const holder = holders[k+1];
+		if (can_be_stored_in(
+		    symbols+keys[k].index, symbols+keys[holder].index))
+			holders[k] = holder;
+	}
+
+	uint32_t first_index_changed = n_symbols;
+	for (uint32_t k = 0; k < n_strings; k++) {
+		if (holders[k] == k) continue;
+
+		struct data_symbol * __restrict const string =
+			symbols+keys[k].index;
+		struct data_symbol * __restrict const holder =
+			symbols+keys[holders[k]].index;
+
+		unindex_content_of(data_section, string);
+		string->flags        = DATA_SYMBOL_ALIAS;
+		string->alias_of     = holder->id;
+		string->alias_offset = holder->size - string->size;
+		holder->flags       |= DATA_SYMBOL_SHARED;
+
+		if (keys[k].index < first_index_changed)
+			first_index_changed = keys[k].index;
+	}
+
+	if (first_index_changed == n_symbols) goto nothing_merged;
+
+	/* The aliases of merged strings now point inside their holder */
+	for (uint32_t s = 0; s < n_symbols; s++) {
+		if (!is_alias(symbols+s)) continue;
+		struct data_symbol const * __restrict const aliased =
+			get_data_symbol_infos(data_section, symbols[s].alias_of).address;
+		if (is_alias(aliased)) {
+			symbols[s].alias_of      = aliased->alias_of;
+			symbols[s].alias_offset += aliased->alias_offset;
+		}
+	}
+
+	invalidate_layout_from(data_section, first_index_changed);
+	if (uses_contiguous_image(data_section))
+		relayout_image_from(data_section, first_index_changed, n_symbols);
+
+	uint32_t const size_after = data_section_size(data_section);
+	report.optimized   = 1;
+	report.size_after  = size_after;
+	report.bytes_saved = (int32_t) (size_before - size_after);
+
+nothing_merged:
+cant_compute_layout:
+cant_allocate_sorting_space:
+	free_temporary_memory(keys);
+	free_temporary_memory(holders);
+	return report;
+}
+
+struct data_section_layout_report data_section_merge_strings
+(struct data_section * __restrict const data_section)
+{
+	struct data_section_layout_report report = {
+		.optimized   = 0,
+		.size_before = 0,
+		.size_after  = 0,
+		.bytes_saved = 0
+	};
+
+	/* Writable symbols sharing their bytes would see each other's
+	 * writes at runtime */
+	if (data_section->read_only != NULL)
+		report = merge_strings_in(data_section->read_only);
+
+	return report;
+}
+
 static uint32_t data_size_up_to
 (struct data_section const * __restrict const data_section,
  uint32_t const symbol_index)
@@ -243,19 +1914,44 @@ static uint32_t data_size_up_to
 	for (unsigned int s = 0; s < symbol_index; s++) {
 		struct data_symbol const * __restrict const symbol =
 			data_section->symbols+s;
+		if (is_alias(symbol)) continue;
 		global_size = round_to(global_size, symbol->align);
 		global_size += symbol->size;
 	}
 	return global_size - data_section->base_address;
 }
 
+/* The zero-filled symbols start right after the written content,
+ * aligned so that the whole subsection can be */
+static struct data_section * synced_zero_fill
+(struct data_section const * __restrict const data_section)
+{
+	struct data_section * __restrict const zero_fill =
+		data_section->zero_fill;
+	if (zero_fill != NULL)
+		data_section_set_base_address(
+			zero_fill,
+			round_to(
+				data_section->base_address + data_section_size(data_section),
+				zero_fill->max_align
+			)
+		);
+	return zero_fill;
+}
+
 uint32_t data_address
 (data_address_func_sig)
 {
 	struct uint32_result const index = 
 		get_data_symbol_index(data_section, data_id);
 	uint32_t address = 0;
-	if (index.found) {
+	if (index.found && is_alias(data_section->symbols+index.value))
+		address = data_address(
+			data_section, data_section->symbols[index.value].alias_of
+		) + data_section->symbols[index.value].alias_offset;
+	else if (index.found && compute_layout_up_to(data_section, index.value + 1))
+		address = data_section->layout->addresses[index.value];
+	else if (index.found) {
 		address += data_section->base_address;
 		
 		address += data_size_up_to(data_section, index.value);
@@ -263,9 +1959,49 @@ uint32_t data_address
 		address = 
 			round_to(address, data_section->symbols[index.value].align);
 	}
+	else {
+		struct data_section const * __restrict const holder =
+			data_subsection_holding(data_section, data_id);
+		if (holder == data_section->zero_fill) synced_zero_fill(data_section);
+		if (holder != NULL) address = data_address(holder, data_id);
+	}
 	return address;
 }
 
+void data_section_compute_addresses
+(struct data_section const * __restrict const data_section)
+{
+	compute_layout_up_to(data_section, data_section->stored);
+	if (data_section->read_only != NULL)
+		data_section_compute_addresses(data_section->read_only);
+	if (synced_zero_fill(data_section) != NULL)
+		data_section_compute_addresses(data_section->zero_fill);
+}
+
+uint32_t data_section_addresses_version
+(struct data_section const * __restrict const data_section)
+{
+	uint32_t version = DATA_SECTION_UNTRACKED_ADDRESSES;
+	if (data_section->layout == NULL) goto untracked;
+
+	uint32_t sum = data_section->layout->version;
+	struct data_section const * __restrict const subsections[2] = {
+		data_section->read_only, data_section->zero_fill
+	};
+	for (unsigned int s = 0; s < 2; s++) {
+		if (subsections[s] == NULL) continue;
+		uint32_t const subsection_version =
+			data_section_addresses_version(subsections[s]);
+		if (subsection_version == DATA_SECTION_UNTRACKED_ADDRESSES)
+			goto untracked;
+		sum += subsection_version;
+	}
+	version = (sum != DATA_SECTION_UNTRACKED_ADDRESSES) ? sum : 0;
+
+untracked:
+	return version;
+}
+
 uint32_t data_size
 (data_address_func_sig)
 {
@@ -274,13 +2010,92 @@ uint32_t data_size
 	struct symbol_found symbol = 
 		get_data_symbol_infos(data_section, data_id);
 	if (symbol.found) size = symbol.address->size;
+	else {
+		struct data_section const * __restrict const holder =
+			data_subsection_holding(data_section, data_id);
+		if (holder != NULL) size = data_size(holder, data_id);
+	}
 	return size;
 }
 
 uint32_t data_section_size
 (struct data_section const * __restrict const data_section)
 {
-	return data_size_up_to(data_section, data_section->stored);
+	uint32_t const n_symbols = data_section->stored;
+	uint32_t size = 0;
+
+	if (uses_contiguous_image(data_section))
+		size = data_section->image_size;
+	else if (n_symbols == 0) size = 0;
+	else if (compute_layout_up_to(data_section, n_symbols))
+		size =
+			data_section->layout->addresses[n_symbols-1] +
+			symbol_footprint(data_section->symbols+n_symbols-1) -
+			data_section->base_address;
+	else size = data_size_up_to(data_section, n_symbols);
+
+	return size;
+}
+
+uint32_t data_section_zero_fill_size
+(struct data_section const * __restrict const data_section)
+{
+	struct data_section const * __restrict const zero_fill =
+		synced_zero_fill(data_section);
+	return (zero_fill != NULL) ?
+		zero_fill->base_address + data_section_size(zero_fill) -
+		(data_section->base_address + data_section_size(data_section)) :
+		0;
+}
+
+uint32_t data_section_align
+(struct data_section const * __restrict const data_section)
+{
+	/* Sections set up by hand start without any */
+	return (data_section->max_align != 0) ? data_section->max_align : 1;
+}
+
+uint32_t data_section_zero_fill_align
+(struct data_section const * __restrict const data_section)
+{
+	struct data_section const * __restrict const zero_fill =
+		data_section->zero_fill;
+	return (zero_fill != NULL) ? zero_fill->max_align : 1;
+}
+
+uint32_t data_section_read_only_align
+(struct data_section const * __restrict const data_section)
+{
+	struct data_section const * __restrict const read_only =
+		data_section->read_only;
+	return (read_only != NULL) ? read_only->max_align : 1;
+}
+
+uint32_t data_section_read_only_size
+(struct data_section const * __restrict const data_section)
+{
+	struct data_section const * __restrict const read_only =
+		data_section->read_only;
+	return (read_only != NULL) ? data_section_size(read_only) : 0;
+}
+
+void data_section_set_read_only_base_address
+(struct data_section * __restrict const data_section,
+ uint32_t const base_address)
+{
+	data_section->read_only_base_address = base_address;
+	if (data_section->read_only != NULL)
+		data_section_set_base_address(data_section->read_only, base_address);
+}
+
+uint32_t write_data_section_read_only_content
+(struct data_section const * __restrict const data_section,
+ uint8_t * __restrict const dest)
+{
+	struct data_section const * __restrict const read_only =
+		data_section->read_only;
+	return (read_only != NULL) ?
+		write_data_section_content(read_only, dest) : 0;
 }
 
 
@@ -288,13 +2103,28 @@ uint32_t write_data_section_content
 (struct data_section const * __restrict const data_section,
  uint8_t * __restrict const dest)
 {
+	uint32_t const n_symbols = data_section->stored;
+	uint32_t const base_address = data_section->base_address;
 	unsigned int cursor = 0;
-	for (unsigned int s = 0; s < data_section->stored; s++) {
+
+	if (uses_contiguous_image(data_section)) {
+		memcpy(dest, data_section->image, data_section->image_size);
+		return data_section->image_size;
+	}
+
+	/* The content is laid out exactly like data_address sees it. */
+	unsigned int const use_layout =
+		compute_layout_up_to(data_section, n_symbols);
+	for (unsigned int s = 0; s < n_symbols; s++) {
 		struct data_symbol const * __restrict const symbol =
 			data_section->symbols+s;
-		cursor = round_to(cursor, symbol->align);
-		memcpy(dest+cursor, symbol->data, symbol->size);
-		cursor += symbol->size;
+		if (is_alias(symbol)) continue;
+		unsigned int const symbol_offset = (use_layout) ?
+			data_section->layout->addresses[s] - base_address :
+			round_to(base_address + cursor, symbol->align) - base_address;
+		memset(dest+cursor, 0, symbol_offset - cursor);
+		memcpy(dest+symbol_offset, symbol->data, symbol->size);
+		cursor = symbol_offset + symbol->size;
 	}
 
 	return cursor;
@@ -304,5 +2134,76 @@ void data_section_set_base_address
 (struct data_section * __restrict const data_section,
  uint32_t const base_address)
 {
+	uint32_t const old_base_address = data_section->base_address;
+	if (old_base_address == base_address) goto nothing_to_do;
+
+	/* Only the layout changes, and it is not shared with snapshots */
+	invalidate_addresses_from(data_section, 0);
 	data_section->base_address = base_address;
+
+	/* The padding depends on the base address. The arrays are only
+	 * copied for the snapshots when the image has to move. */
+	if (uses_contiguous_image(data_section) &&
+	    image_offsets_change(data_section) &&
+	    (!data_section_own_arrays(data_section) ||
+	     !relayout_image_from(data_section, 0, data_section->stored))) {
+		data_section->base_address = old_base_address;
+		invalidate_addresses_from(data_section, 0);
+	}
+
+nothing_to_do:
+	return;
+}
+
+void data_section_use_names_table
+(struct data_section * __restrict const data_section,
+ struct names_table * __restrict const names_table)
+{
+	if (!data_section_own_arrays(data_section)) goto cant_own_symbols;
+
+	data_section->names = names_table;
+	for (uint32_t s = 0; s < data_section->stored; s++) {
+		struct data_symbol * __restrict const symbol =
+			data_section->symbols+s;
+		symbol->name = interned_name_of(data_section, symbol->name, symbol->id);
+	}
+
+	if (data_section->zero_fill != NULL)
+		data_section_use_names_table(data_section->zero_fill, names_table);
+	if (data_section->read_only != NULL)
+		data_section_use_names_table(data_section->read_only, names_table);
+
+cant_own_symbols:
+	return;
+}
+
+uint8_t const * data_section_image
+(struct data_section const * __restrict const data_section)
+{
+	return uses_contiguous_image(data_section) ? data_section->image : NULL;
+}
+
+uint8_t const * data_symbol_content
+(struct data_section const * __restrict const data_section,
+ struct data_symbol const * __restrict const symbol)
+{
+	uint8_t const * __restrict content = NULL;
+	if (is_alias(symbol))
+		content = stored_content(
+			data_section,
+			get_data_symbol_infos(data_section, symbol->alias_of).address
+		) + symbol->alias_offset;
+	else content = stored_content(data_section, symbol);
+	return content;
+}
+
+unsigned int data_section_set_deduplication
+(struct data_section * __restrict const data_section,
+ unsigned int const enabled)
+{
+	data_section->deduplicate = enabled;
+	if (!enabled) id_index_free(&data_section->content_index);
+	if (data_section->read_only != NULL)
+		data_section_set_deduplication(data_section->read_only, enabled);
+	return enabled && deduplicating(data_section);
 }
@@ -1,26 +1,123 @@
 #ifndef MYY_DATA_SECTION_H
 #define MYY_DATA_SECTION_H 1
 #include <stdint.h>
+#include <helpers/id_index.h>
+#include <helpers/handles.h>
+#include <helpers/names_table.h>
 
 struct data_section_status {
 	unsigned int allocated;
 	void * address;
 };
 
+/* How the content of the symbols is stored.
+ * - data_storage_borrowed_pointers : Only the pointers provided to
+ *   data_section_add are stored, and the content is gathered when
+ *   writing the section. The caller has to keep the data alive.
+ * - data_storage_contiguous_image : The content is copied in one
+ *   contiguous image, laid out exactly like it will be written in the
+ *   binary. Every modification keeps the image ready for output.
+ */
+enum data_section_storage {
+	data_storage_borrowed_pointers,
+	data_storage_contiguous_image
+};
+
+/* An alias shares the content of another symbol, identified by
+ * alias_of, starting alias_offset bytes into it, and takes no space
+ * in the section.
+ * A shared symbol has, or had, aliases pointing to it. */
+#define DATA_SYMBOL_ALIAS  (1 << 0)
+#define DATA_SYMBOL_SHARED (1 << 1)
+
 struct data_symbol {
 	uint32_t id;
 	uint32_t align;
 	uint32_t size;
 	uint8_t * name;
 	uint8_t * data;
+	// Offset of the content in the image, when using one
+	uint32_t offset;
+	uint32_t flags;
+	uint32_t alias_of;
+	uint32_t alias_offset;
+};
+
+/* Addresses of the symbols, computed lazily.
+ * Only the first "valid" addresses can be trusted. Any modification of
+ * the section invalidates the addresses from the first symbol modified.
+ *
+ * The alignments and footprints of the symbols are mirrored in packed
+ * arrays, so that the addresses can be computed without walking the
+ * symbols themselves. Only the first "mirrored" entries can be
+ * trusted. Moving the base address keeps them.
+ */
+struct data_section_layout {
+	uint32_t * addresses;
+	uint32_t * aligns;
+	uint32_t * footprints;
+	uint32_t valid;
+	uint32_t mirrored;
+	uint32_t max_addresses;
+	/* Increased by every invalidation */
+	uint32_t version;
 };
 
 struct data_section {
 	struct data_symbol * symbols;
 	uint32_t stored;
+	/* IDs handed out when the handles could not be allocated */
 	uint32_t next_id;
 	uint32_t base_address;
+	/* The largest alignment of the stored symbols */
+	uint32_t max_align;
 	uint32_t max_symbols_before_realloc;
+	/* ID -> index in symbols. IDs are handles whose slots are reused
+	 * after deletion. Built on the first addition when the section was
+	 * not generated through generate_data_section. */
+	struct handles handles;
+	/* Like the index, built on the first addition if needed. Stored
+	 * separately so that const queries can still update it. */
+	struct data_section_layout * layout;
+	enum data_section_storage storage;
+	uint8_t * image;
+	uint32_t image_size;
+	uint32_t max_image_size;
+	/* Content hash -> ID of the symbol holding that content.
+	 * Only maintained when deduplicating. */
+	unsigned int deduplicate;
+	struct id_index content_index;
+	/* Zero-filled symbols, placed after the content of this section.
+	 * They share the IDs of this section and take no space in the
+	 * written content. Allocated on the first zero-filled symbol. */
+	struct data_section * zero_fill;
+	/* Read-only symbols, written separately, in a segment that is not
+	 * writable. They share the IDs of this section too. */
+	struct data_section * read_only;
+	uint32_t read_only_base_address;
+	/* When set, the symbols names are interned there, and resolve to
+	 * the symbols IDs. Shared with the subsections. */
+	struct names_table * names;
+	/* First slot not reserved by batches yet. Only modified atomically
+	 * between data_section_open_batches and the batches commits. */
+	uint32_t batches_next_slot;
+	/* When set, the symbols, the image and the handles are shared
+	 * with snapshots, and this counts the sections sharing them.
+	 * They are copied before being modified. */
+	uint32_t * shared_arrays_references;
+};
+
+/* Symbols added by one thread, without any lock, and appended to the
+ * section later, by data_section_commit_batch.
+ * Their IDs are reserved by blocks of slots, taken atomically from the
+ * section, and are valid as soon as they are handed out. */
+struct data_symbols_batch {
+	struct data_section * section;
+	struct data_symbol * symbols;
+	uint32_t stored;
+	uint32_t max_symbols;
+	uint32_t next_slot;
+	uint32_t end_slot;
 };
 
 struct data_section_symbol_added {
@@ -29,6 +126,8 @@ struct data_section_symbol_added {
 };
 
 struct data_section * generate_data_section();
+struct data_section * generate_data_section_with_storage
+(enum data_section_storage const storage);
 unsigned int expand_data_symbols_storage_in
 (struct data_section * __restrict const data_section);
 
@@ -39,6 +138,25 @@ struct data_section_symbol_added data_section_add
  uint8_t const * __restrict const name,
  uint8_t const * __restrict const data);
 
+/* Add a symbol whose content is only zeros, and which takes no space
+ * in the written content. Its address follows the written content.
+ * Updating it keeps it zero-filled. */
+struct data_section_symbol_added data_section_add_zero_fill
+(struct data_section * __restrict const data_section,
+ unsigned int const alignment,
+ unsigned int const size,
+ uint8_t const * __restrict const name);
+
+/* Add a symbol whose content will never be modified at runtime.
+ * Its content is written through write_data_section_read_only_content,
+ * at the address set with data_section_set_read_only_base_address. */
+struct data_section_symbol_added data_section_add_read_only
+(struct data_section * __restrict const data_section,
+ unsigned int const alignment,
+ unsigned int const size,
+ uint8_t const * __restrict const name,
+ uint8_t const * __restrict const data);
+
 struct uint32_result {
 	unsigned int found;
 	uint32_t value;
@@ -53,21 +171,150 @@ struct symbol_found get_data_symbol_infos
 (struct data_section const * __restrict const data_infos,
  uint32_t id);
 
+/* Whether id designates a symbol of the section, or of its
+ * subsections. IDs of deleted symbols don't, even once their slot has
+ * been reused. */
+unsigned int data_section_has_symbol
+(struct data_section const * __restrict const data_section,
+ uint32_t const id);
+
 void exchange_symbols_order
 (struct data_section * __restrict const data_section,
  unsigned int const id1, unsigned int const id2);
 
+struct data_section_layout_report {
+	unsigned int optimized;
+	uint32_t size_before;
+	uint32_t size_after;
+	int32_t bytes_saved;
+};
+
+/* Reorder the symbols to reduce the padding inserted between them.
+ * The symbols identified in hot_ids are placed first, in the same
+ * order, so that they share the same cache lines. The others are
+ * grouped by decreasing alignment.
+ * Without hot symbols, the original order is kept if the new one
+ * does not reduce the section size. */
+struct data_section_layout_report data_section_optimize_layout
+(struct data_section * __restrict const data_section,
+ uint32_t const * __restrict const hot_ids,
+ uint32_t const n_hot_ids);
+
+/* Store the NUL-terminated strings that are suffixes of other strings
+ * inside these other strings, like linkers do with SHF_STRINGS
+ * sections. Merged strings become aliases, and their IDs stay valid.
+ * Only the read-only symbols are merged, and the report sizes are the
+ * read-only content sizes. Writable symbols are left untouched.
+ * A read-only symbol is considered as a string when its last byte
+ * is 0. */
+struct data_section_layout_report data_section_merge_strings
+(struct data_section * __restrict const data_section);
+
 uint32_t write_data_section_content
 (struct data_section const * __restrict const symbols,
  uint8_t * __restrict const dest);
 
+/* The whole section content, ready to be written, when the section
+ * uses a contiguous image. NULL otherwise. */
+uint8_t const * data_section_image
+(struct data_section const * __restrict const data_section);
+
+/* The content of a symbol. With a contiguous image, the returned address
+ * is only valid until the next modification of the section. */
+uint8_t const * data_symbol_content
+(struct data_section const * __restrict const data_section,
+ struct data_symbol const * __restrict const symbol);
+
 void delete_data_symbol
 (struct data_section * __restrict const data_section,
  uint32_t id);
 
+/* Take a snapshot of the section, and of its subsections, showing them
+ * as they are now, whatever is done to the section afterwards.
+ * The snapshot shares the section symbols, image and handles, so taking
+ * one doesn't depend on the section size.
+ * Unlike the frames of text sections, these are not split in chunks :
+ * the first modification of the section following the snapshot copies
+ * all of them, whichever symbols it touches. Only the used parts of the
+ * symbols and the image are copied. Later modifications copy nothing,
+ * until the next snapshot.
+ * Moving the section copies nothing, unless the padding of its image
+ * changes.
+ * Borrowed contents are not copied, only the pointers to them.
+ * The snapshot can be queried and written from another thread while
+ * the section is modified. It must not be modified itself, besides
+ * setting its base address.
+ * Only sections generated through generate_data_section* can be
+ * snapshotted. NULL if the snapshot cannot be allocated. */
+struct data_section * data_section_snapshot
+(struct data_section * __restrict const data_section);
+
+void free_data_section_snapshot
+(struct data_section * __restrict const snapshot);
+
+/* Concurrent appends :
+ * - data_section_open_batches, once, before starting the threads.
+ * - One batch per thread, filled with data_symbols_batch_add.
+ *   The section must not be modified in any other way meanwhile.
+ * - data_section_commit_batch for every batch, once the threads are
+ *   done. The symbols are appended in the order of the commits, so
+ *   committing the batches in a fixed order gives the same section
+ *   whatever the threads scheduling. Only the IDs values may differ.
+ */
+void data_section_open_batches
+(struct data_section * __restrict const data_section);
+
+struct data_symbols_batch * generate_data_symbols_batch
+(struct data_section * __restrict const data_section);
+
+/* The IDs reserved by the batch and not committed are handed out
+ * again, so the threads must be done */
+void free_data_symbols_batch
+(struct data_symbols_batch * __restrict const batch);
+
+/* The name and the data must stay valid until the batch is committed */
+struct data_section_symbol_added data_symbols_batch_add
+(struct data_symbols_batch * __restrict const batch,
+ unsigned int const alignment,
+ unsigned int const size,
+ uint8_t const * __restrict const name,
+ uint8_t const * __restrict const data);
+
+/* Returns 0 if some symbols could not be appended. These are kept in
+ * the batch, and committing it again will append them. */
+unsigned int data_section_commit_batch
+(struct data_section * __restrict const data_section,
+ struct data_symbols_batch * __restrict const batch);
+
 uint32_t data_section_size
 (struct data_section const * __restrict const data_section);
 
+/* The largest alignment of the symbols of the section, or of its
+ * subsections. 1 without symbols. */
+uint32_t data_section_align
+(struct data_section const * __restrict const data_section);
+uint32_t data_section_zero_fill_align
+(struct data_section const * __restrict const data_section);
+uint32_t data_section_read_only_align
+(struct data_section const * __restrict const data_section);
+
+/* The space taken by the zero-filled symbols after the written
+ * content, including the padding required to align them.
+ * They start on the largest of their alignments. */
+uint32_t data_section_zero_fill_size
+(struct data_section const * __restrict const data_section);
+
+uint32_t data_section_read_only_size
+(struct data_section const * __restrict const data_section);
+
+void data_section_set_read_only_base_address
+(struct data_section * __restrict const data_section,
+ uint32_t const base_address);
+
+uint32_t write_data_section_read_only_content
+(struct data_section const * __restrict const data_section,
+ uint8_t * __restrict const dest);
+
 #define data_address_func_sig struct data_section const * __restrict const data_section,\
  uint32_t const data_id
 uint32_t data_address(data_address_func_sig);
@@ -75,6 +322,21 @@ uint32_t data_address_upper16(data_address_func_sig);
 uint32_t data_address_lower16(data_address_func_sig);
 uint32_t data_size(data_address_func_sig);
 
+/* Compute the addresses of every symbol of the section and its
+ * subsections, which are otherwise computed on demand.
+ * Until the section is modified again, data_address and data_size then
+ * only read the section, and can be called from several threads. */
+void data_section_compute_addresses
+(struct data_section const * __restrict const data_section);
+
+#define DATA_SECTION_UNTRACKED_ADDRESSES 0xffffffff
+/* Changes every time the addresses or the sizes of the symbols of the
+ * section, or its subsections, may have changed.
+ * DATA_SECTION_UNTRACKED_ADDRESSES if the changes cannot be tracked,
+ * because some layout could not be allocated. */
+uint32_t data_section_addresses_version
+(struct data_section const * __restrict const data_section);
+
 void update_data_symbol
 (struct data_section * __restrict const data_section,
  uint32_t const id,
@@ -87,5 +349,22 @@ void data_section_set_base_address
 (struct data_section * __restrict const data_section,
  uint32_t const base_address);
 
+/* Intern the names of the symbols in names_table, and keep their
+ * bindings to the symbols IDs up to date. The names of the symbols
+ * already stored are bound too. */
+void data_section_use_names_table
+(struct data_section * __restrict const data_section,
+ struct names_table * __restrict const names_table);
+
+/* When enabled, symbols added with the same alignment and the same
+ * content as an already stored symbol become aliases of that symbol.
+ * Their IDs stay valid, and resolve to the shared copy.
+ * Updating an alias with a different content gives it its own copy
+ * again. Updates never create new aliases.
+ * Returns 1 if deduplication is enabled after the call. */
+unsigned int data_section_set_deduplication
+(struct data_section * __restrict const data_section,
+ unsigned int const enabled);
+
 
 #endif
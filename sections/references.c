@@ -0,0 +1,146 @@
+#include <sections/references.h>
+#include <helpers/memory.h>
+
+struct references_index * generate_references_index()
+{
+	uint32_t const default_n_nodes = 256;
+	struct references_index * __restrict references = NULL;
+
+	struct reference * __restrict const nodes =
+		allocate_durable_memory(default_n_nodes * sizeof(struct reference));
+	if (nodes == NULL) goto cant_allocate_nodes;
+
+	references = allocate_durable_memory(sizeof(struct references_index));
+	if (references == NULL) goto cant_allocate_references;
+
+	references->nodes      = nodes;
+	references->used_nodes = 0;
+	references->max_nodes  = default_n_nodes;
+	references->free_nodes = REFERENCES_END;
+
+	unsigned int initialised = 1;
+	for (unsigned int t = 0; t < n_reference_targets; t++) {
+		references->heads[t].slots = NULL;
+		initialised &= id_index_init(references->heads+t, 64);
+	}
+	if (initialised) goto references_generated;
+
+	for (unsigned int t = 0; t < n_reference_targets; t++)
+		id_index_free(references->heads+t);
+	free_durable_memory(references);
+	references = NULL;
+
+cant_allocate_references:
+	free_durable_memory(nodes);
+references_generated:
+cant_allocate_nodes:
+	return references;
+}
+
+static uint32_t references_index_new_node
+(struct references_index * __restrict const references)
+{
+	uint32_t node = references->free_nodes;
+	if (node != REFERENCES_END) {
+		references->free_nodes = references->nodes[node].next;
+		goto recycled;
+	}
+
+	if (references->used_nodes == references->max_nodes) {
+		uint32_t const new_max = references->max_nodes * 2;
+		struct reference * __restrict const new_nodes =
+			reallocate_durable_memory(
+				references->nodes, new_max * sizeof(struct reference)
+			);
+		if (new_nodes == NULL) goto cant_expand_nodes;
+		references->nodes     = new_nodes;
+		references->max_nodes = new_max;
+	}
+
+	node = references->used_nodes;
+	references->used_nodes += 1;
+
+cant_expand_nodes:
+recycled:
+	return node;
+}
+
+unsigned int references_index_add
+(struct references_index * __restrict const references,
+ enum reference_target const target,
+ uint32_t const target_id,
+ uint32_t const frame_id,
+ uint32_t const instruction_index,
+ uint32_t const arg_index)
+{
+	struct id_index * __restrict const heads = references->heads+target;
+	struct id_index_result const head = id_index_get(heads, target_id);
+
+	uint32_t const node = references_index_new_node(references);
+	unsigned int added = (node != REFERENCES_END);
+	if (!added) goto cant_allocate_node;
+
+	/* New references are chained first */
+	added = id_index_set(heads, target_id, node);
+	if (!added) {
+		references->nodes[node].next = references->free_nodes;
+		references->free_nodes = node;
+		goto cant_index_node;
+	}
+
+	struct reference * __restrict const reference = references->nodes+node;
+	reference->frame_id          = frame_id;
+	reference->instruction_index = instruction_index;
+	reference->arg_index         = arg_index;
+	reference->next = (head.found) ? head.index : REFERENCES_END;
+
+cant_index_node:
+cant_allocate_node:
+	return added;
+}
+
+void references_index_remove
+(struct references_index * __restrict const references,
+ enum reference_target const target,
+ uint32_t const target_id,
+ uint32_t const frame_id,
+ uint32_t const instruction_index,
+ uint32_t const arg_index)
+{
+	struct id_index * __restrict const heads = references->heads+target;
+	struct id_index_result const head = id_index_get(heads, target_id);
+	if (!head.found) goto not_referenced;
+
+	struct reference * __restrict const nodes = references->nodes;
+	uint32_t previous = REFERENCES_END;
+	uint32_t node = head.index;
+	while (node != REFERENCES_END &&
+	       !(nodes[node].frame_id == frame_id &&
+	         nodes[node].instruction_index == instruction_index &&
+	         nodes[node].arg_index == arg_index)) {
+		previous = node;
+		node = nodes[node].next;
+	}
+	if (node == REFERENCES_END) goto not_referenced;
+
+	uint32_t const next = nodes[node].next;
+	if (previous != REFERENCES_END) nodes[previous].next = next;
+	else if (next != REFERENCES_END) id_index_set(heads, target_id, next);
+	else id_index_remove(heads, target_id);
+
+	nodes[node].next = references->free_nodes;
+	references->free_nodes = node;
+
+not_referenced:
+	return;
+}
+
+uint32_t references_index_first
+(struct references_index const * __restrict const references,
+ enum reference_target const target,
+ uint32_t const target_id)
+{
+	struct id_index_result const head =
+		id_index_get(references->heads+target, target_id);
+	return (head.found) ? head.index : REFERENCES_END;
+}
@@ -0,0 +1,72 @@
+#ifndef MYY_SECTIONS_REFERENCES_H
+#define MYY_SECTIONS_REFERENCES_H 1
+
+#include <stdint.h>
+#include <helpers/id_index.h>
+
+/* Reverse index of the instructions arguments referring to data
+ * symbols or frames.
+ * For each referenced ID, the references are chained in a pool of
+ * nodes, from a head found through an id_index. Removed nodes are
+ * recycled through a free list. */
+
+#define REFERENCES_END 0xffffffff
+
+enum reference_target {
+	reference_to_data_symbol,
+	reference_to_frame,
+	n_reference_targets
+};
+
+struct reference {
+	uint32_t frame_id;
+	uint32_t instruction_index;
+	uint32_t arg_index;
+	uint32_t next;
+};
+
+struct references_index {
+	struct id_index heads[n_reference_targets];
+	struct reference * nodes;
+	uint32_t used_nodes;
+	uint32_t max_nodes;
+	uint32_t free_nodes;
+};
+
+struct references_index * generate_references_index();
+
+unsigned int references_index_add
+(struct references_index * __restrict const references,
+ enum reference_target const target,
+ uint32_t const target_id,
+ uint32_t const frame_id,
+ uint32_t const instruction_index,
+ uint32_t const arg_index);
+
+void references_index_remove
+(struct references_index * __restrict const references,
+ enum reference_target const target,
+ uint32_t const target_id,
+ uint32_t const frame_id,
+ uint32_t const instruction_index,
+ uint32_t const arg_index);
+
+/* Iterate over the references to an ID :
+ * for (uint32_t r = references_index_first(references, target, id);
+ *      r != REFERENCES_END;
+ *      r = references_index_next(references, r))
+ *   references->nodes[r] ...
+ * An instruction using the same ID in two arguments is listed twice. */
+uint32_t references_index_first
+(struct references_index const * __restrict const references,
+ enum reference_target const target,
+ uint32_t const target_id);
+
+static inline uint32_t references_index_next
+(struct references_index const * __restrict const references,
+ uint32_t const node)
+{
+	return references->nodes[node].next;
+}
+
+#endif
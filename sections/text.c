@@ -16,3 +16,15 @@ void frame_set_name
 {
 	text_frame_metadata->name = name;
 }
+
+unsigned int frame_add_name
+(struct text_frame_metadata * __restrict const text_frame_metadata,
+ struct names_table * __restrict const names_table,
+ uint8_t const * __restrict const name)
+{
+	uint8_t const * __restrict const interned =
+		names_table_bind_frame(names_table, name, text_frame_metadata->id);
+	if (interned != NULL && text_frame_metadata->name == NULL)
+		frame_set_name(text_frame_metadata, interned);
+	return interned != NULL;
+}
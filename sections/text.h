@@ -2,6 +2,7 @@
 #define MYY_SECTIONS_TEXT_H 1
 
 #include <stdint.h>
+#include <helpers/names_table.h>
 
 struct text_frame_metadata {
 	uint32_t const id;
@@ -28,6 +29,14 @@ void frame_set_name
 (struct text_frame_metadata * __restrict const text_frame_metadata,
  uint8_t const * __restrict const name);
 
+/* Make name refer to the frame, through names_table.
+ * A frame can have multiple names. The first one becomes the frame
+ * name, if it had none. */
+unsigned int frame_add_name
+(struct text_frame_metadata * __restrict const text_frame_metadata,
+ struct names_table * __restrict const names_table,
+ uint8_t const * __restrict const name);
+
 
 
 #endif
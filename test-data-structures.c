@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 
 #define LOG(...) fprintf(stderr, __VA_ARGS__)
 
@@ -350,10 +351,891 @@ void test_update_data_symbol() {
 
 }
 
+void assert_symbol_id_resolves
+(struct data_section const * __restrict const data_section,
+ unsigned int const id)
+{
+	struct symbol_found const result =
+		get_data_symbol_infos(data_section, id);
+	assert(result.found);
+	assert(result.address->id == id);
+}
+
+void test_symbols_index() {
+	struct data_section * __restrict const data_section =
+		generate_data_section();
+	assert(data_section != NULL);
+
+	uint8_t test_string[] = "INDEXED";
+	uint8_t test_string_name[] = "indexed";
+	unsigned int const n_symbols = 1000;
+
+	for (unsigned int s = 0; s < n_symbols; s++) {
+		uint32_t id = assert_add_symbol(
+			data_section, test_string, sizeof(test_string), test_string_name
+		);
+		assert(id == s);
+	}
+
+	for (unsigned int s = 0; s < n_symbols; s++)
+		assert_symbol_id_resolves(data_section, s);
+
+	delete_data_symbol(data_section, 0);
+	delete_data_symbol(data_section, 500);
+	delete_data_symbol(data_section, 999);
+	exchange_symbols_order(data_section, 1, 998);
+	exchange_symbols_order(data_section, 250, 750);
+
+	assert(data_section->stored == n_symbols - 3);
+	assert(data_section->symbols[0].id == 998);
+	assert(data_section->symbols[data_section->stored-1].id == 1);
+
+	assert_symbol_not_there(data_section, 0);
+	assert_symbol_not_there(data_section, 500);
+	assert_symbol_not_there(data_section, 999);
+	assert_symbol_not_there(data_section, n_symbols);
+
+	for (unsigned int s = 1; s < n_symbols - 1; s++)
+		if (s != 500) assert_symbol_id_resolves(data_section, s);
+
+	/* The freed slots are reused, with a new generation, and the
+	 * deleted IDs keep not resolving */
+	for (unsigned int r = 0; r < 3; r++) {
+		uint32_t const id = assert_add_symbol(
+			data_section, test_string, sizeof(test_string), test_string_name
+		);
+		uint32_t const slot = handle_slot(id);
+		assert(slot == 0 || slot == 500 || slot == 999);
+		assert(handle_generation(id) == 1);
+		assert_symbol_id_resolves(data_section, id);
+	}
+	assert_symbol_not_there(data_section, 0);
+	assert_symbol_not_there(data_section, 500);
+	assert_symbol_not_there(data_section, 999);
+	assert(
+		assert_add_symbol(
+			data_section, test_string, sizeof(test_string), test_string_name
+		) == n_symbols
+	);
+
+	uint32_t id = 998;
+	for (unsigned int g = 1; g < 10; g++) {
+		delete_data_symbol(data_section, id);
+		assert(!data_section_has_symbol(data_section, id));
+		uint32_t const new_id = assert_add_symbol(
+			data_section, test_string, sizeof(test_string), test_string_name
+		);
+		assert(handle_slot(new_id) == 998 && handle_generation(new_id) == g);
+		assert_symbol_not_there(data_section, id);
+		assert_symbol_id_resolves(data_section, new_id);
+		id = new_id;
+	}
+	assert(data_section->stored == n_symbols + 1);
+}
+
+uint32_t expected_address_of
+(struct data_section const * __restrict const data_section,
+ uint32_t const id)
+{
+	uint32_t address = data_section->base_address;
+	for (unsigned int s = 0; s < data_section->stored; s++) {
+		struct data_symbol const * __restrict const symbol =
+			data_section->symbols+s;
+		address = (address + symbol->align - 1) / symbol->align * symbol->align;
+		if (symbol->id == id) break;
+		address += symbol->size;
+	}
+	return address;
+}
+
+void assert_layout_consistent
+(struct data_section const * __restrict const data_section)
+{
+	for (unsigned int s = 0; s < data_section->stored; s++) {
+		uint32_t const id = data_section->symbols[s].id;
+		assert(
+			data_address(data_section, id) ==
+			expected_address_of(data_section, id)
+		);
+	}
+}
+
+void test_data_layout() {
+	struct data_section * __restrict const data_section =
+		generate_data_section();
+	assert(data_section != NULL);
+
+	uint8_t table[64] = {0};
+	uint8_t table_name[] = "table";
+	uint32_t const aligns[4] = {1, 4, 16, 8};
+	unsigned int const n_symbols = 300;
+
+	data_section_set_base_address(data_section, 0x20003);
+	for (unsigned int s = 0; s < n_symbols; s++) {
+		struct data_section_symbol_added const added = data_section_add(
+			data_section, aligns[s % 4], 1 + s % 37, table_name, table
+		);
+		assert(added.added);
+	}
+	assert_layout_consistent(data_section);
+
+	uint32_t const last_id = data_section->symbols[n_symbols-1].id;
+	uint32_t const end_before = data_address(data_section, last_id);
+	update_data_symbol(data_section, 10, 16, 64, table_name, table);
+	assert_layout_consistent(data_section);
+	assert(data_address(data_section, last_id) > end_before);
+
+	delete_data_symbol(data_section, 150);
+	assert_layout_consistent(data_section);
+
+	exchange_symbols_order(data_section, 3, 290);
+	assert_layout_consistent(data_section);
+
+	data_section_set_base_address(data_section, 0x30000);
+	assert_layout_consistent(data_section);
+	assert(data_address(data_section, 0) == 0x30000);
+
+	uint32_t const last_index = data_section->stored - 1;
+	assert(
+		data_section_size(data_section) ==
+		expected_address_of(data_section, data_section->symbols[last_index].id) +
+		data_section->symbols[last_index].size - 0x30000
+	);
+
+	static uint8_t content[16384];
+	assert(sizeof(content) >= data_section_size(data_section));
+	assert(
+		write_data_section_content(data_section, content) ==
+		data_section_size(data_section)
+	);
+}
+
+/* Mostly padding-free symbols, so that whole runs of addresses can be
+ * computed at once, broken by a few ones that need padding. */
+void test_packed_layout() {
+	struct data_section * __restrict const data_section =
+		generate_data_section();
+	assert(data_section != NULL);
+
+	uint8_t table[64] = {0};
+	uint8_t table_name[] = "table";
+	unsigned int const n_symbols = 1000;
+
+	data_section_set_base_address(data_section, 0x40000);
+	for (unsigned int s = 0; s < n_symbols; s++) {
+		uint32_t const align = (s % 97 == 0) ? 16 : 4;
+		uint32_t const size  = (s % 89 == 0) ? 3 : 4 * (1 + s % 5);
+		struct data_section_symbol_added const added = data_section_add(
+			data_section, align, size, table_name, table
+		);
+		assert(added.added);
+	}
+	assert_layout_consistent(data_section);
+
+	/* An unaligned base pads the first symbol only */
+	data_section_set_base_address(data_section, 0x40001);
+	assert_layout_consistent(data_section);
+	assert(data_address(data_section, 0) == 0x40010);
+
+	update_data_symbol(data_section, 500, 8, 6, table_name, table);
+	assert_layout_consistent(data_section);
+
+	data_section_set_base_address(data_section, 0x40000);
+	assert_layout_consistent(data_section);
+
+	delete_data_symbol(data_section, 3);
+	exchange_symbols_order(data_section, 10, 990);
+	assert_layout_consistent(data_section);
+
+	struct data_section_symbol_added const last = data_section_add(
+		data_section, 4, 4, table_name, table
+	);
+	assert(last.added);
+	assert_layout_consistent(data_section);
+}
+
+void assert_same_content
+(struct data_section const * __restrict const borrowing_section,
+ struct data_section const * __restrict const image_section)
+{
+	static uint8_t borrowed_content[16384];
+	static uint8_t image_content[16384];
+
+	uint32_t const size = data_section_size(borrowing_section);
+	assert(size == data_section_size(image_section));
+	assert(size <= sizeof(borrowed_content));
+
+	memset(borrowed_content, 0xff, size);
+	assert(write_data_section_content(borrowing_section, borrowed_content) == size);
+	assert(write_data_section_content(image_section, image_content) == size);
+	assert(memcmp(borrowed_content, image_content, size) == 0);
+	assert(memcmp(data_section_image(image_section), image_content, size) == 0);
+
+	for (unsigned int s = 0; s < borrowing_section->stored; s++) {
+		uint32_t const id = borrowing_section->symbols[s].id;
+		assert(
+			data_address(borrowing_section, id) ==
+			data_address(image_section, id)
+		);
+	}
+}
+
+void test_contiguous_image() {
+	struct data_section * __restrict const borrowing_section =
+		generate_data_section();
+	struct data_section * __restrict const image_section =
+		generate_data_section_with_storage(data_storage_contiguous_image);
+	assert(borrowing_section != NULL);
+	assert(image_section != NULL);
+	assert(data_section_image(borrowing_section) == NULL);
+
+	static uint8_t contents[200][40];
+	uint8_t name[] = "content";
+	uint32_t const aligns[5] = {1, 8, 2, 16, 4};
+	unsigned int const n_symbols = 200;
+
+	data_section_set_base_address(borrowing_section, 0x20001);
+	data_section_set_base_address(image_section, 0x20001);
+	for (unsigned int s = 0; s < n_symbols; s++) {
+		memset(contents[s], s + 1, sizeof(contents[s]));
+		struct data_section_symbol_added const borrowed = data_section_add(
+			borrowing_section, aligns[s % 5], 1 + s % 40, name, contents[s]
+		);
+		struct data_section_symbol_added const copied = data_section_add(
+			image_section, aligns[s % 5], 1 + s % 40, name, contents[s]
+		);
+		assert(borrowed.added && copied.added);
+		assert(borrowed.id == copied.id);
+	}
+	assert_same_content(borrowing_section, image_section);
+
+	struct symbol_found const symbol =
+		get_data_symbol_infos(image_section, 7);
+	assert(symbol.found);
+	assert(
+		memcmp(
+			data_symbol_content(image_section, symbol.address),
+			contents[7], symbol.address->size
+		) == 0
+	);
+
+	update_data_symbol(borrowing_section, 20, 4, 40, name, contents[199]);
+	update_data_symbol(image_section, 20, 4, 40, name, contents[199]);
+	assert_same_content(borrowing_section, image_section);
+
+	update_data_symbol(borrowing_section, 41, 1, 3, name, contents[5]);
+	update_data_symbol(image_section, 41, 1, 3, name, contents[5]);
+	assert_same_content(borrowing_section, image_section);
+
+	delete_data_symbol(borrowing_section, 0);
+	delete_data_symbol(image_section, 0);
+	delete_data_symbol(borrowing_section, 100);
+	delete_data_symbol(image_section, 100);
+	assert_same_content(borrowing_section, image_section);
+
+	exchange_symbols_order(borrowing_section, 3, 180);
+	exchange_symbols_order(image_section, 3, 180);
+	assert_same_content(borrowing_section, image_section);
+
+	data_section_set_base_address(borrowing_section, 0x30006);
+	data_section_set_base_address(image_section, 0x30006);
+	assert_same_content(borrowing_section, image_section);
+}
+
+void test_layout_optimization() {
+	struct data_section * __restrict const borrowing_section =
+		generate_data_section();
+	struct data_section * __restrict const image_section =
+		generate_data_section_with_storage(data_storage_contiguous_image);
+	assert(borrowing_section != NULL);
+	assert(image_section != NULL);
+
+	static uint8_t contents[64][16];
+	uint8_t name[] = "mixed";
+	unsigned int const n_symbols = 64;
+
+	/* 1-byte strings interleaved with 16-bytes aligned tables */
+	for (unsigned int s = 0; s < n_symbols; s++) {
+		uint32_t const align = (s % 2) ? 16 : 1;
+		uint32_t const size  = (s % 2) ? 16 : 2;
+		memset(contents[s], s, sizeof(contents[s]));
+		assert(data_section_add(borrowing_section, align, size, name, contents[s]).added);
+		assert(data_section_add(image_section, align, size, name, contents[s]).added);
+	}
+
+	uint32_t const size_before = data_section_size(borrowing_section);
+	struct data_section_layout_report const report =
+		data_section_optimize_layout(borrowing_section, NULL, 0);
+	assert(report.optimized);
+	assert(report.size_before == size_before);
+	assert(report.size_after == data_section_size(borrowing_section));
+	assert(report.size_after == 32 * 16 + 32 * 2);
+	assert(report.bytes_saved == (int32_t) (size_before - report.size_after));
+	assert_layout_consistent(borrowing_section);
+
+	struct data_section_layout_report const image_report =
+		data_section_optimize_layout(image_section, NULL, 0);
+	assert(image_report.size_after == report.size_after);
+	assert_same_content(borrowing_section, image_section);
+
+	/* Already optimal */
+	assert(!data_section_optimize_layout(borrowing_section, NULL, 0).optimized);
+
+	uint32_t const hot_ids[3] = {4, 63, 0};
+	data_section_optimize_layout(borrowing_section, hot_ids, 3);
+	data_section_optimize_layout(image_section, hot_ids, 3);
+	assert(borrowing_section->symbols[0].id == 4);
+	assert(borrowing_section->symbols[1].id == 63);
+	assert(borrowing_section->symbols[2].id == 0);
+	assert(borrowing_section->symbols[3].align == 16);
+	assert_layout_consistent(borrowing_section);
+	assert_same_content(borrowing_section, image_section);
+}
+
+void assert_written_at_symbol_address
+(struct data_section const * __restrict const data_section,
+ uint32_t const id,
+ uint8_t const * __restrict const expected,
+ uint32_t const size)
+{
+	static uint8_t content[16384];
+	assert(data_section_size(data_section) <= sizeof(content));
+	write_data_section_content(data_section, content);
+
+	uint32_t const offset =
+		data_address(data_section, id) - data_section->base_address;
+	assert(data_size(data_section, id) == size);
+	assert(memcmp(content+offset, expected, size) == 0);
+}
+
+void test_deduplication() {
+	struct data_section * __restrict const sections[2] = {
+		generate_data_section(),
+		generate_data_section_with_storage(data_storage_contiguous_image)
+	};
+	assert(sections[0] != NULL);
+	assert(sections[1] != NULL);
+
+	uint8_t name[] = "dup";
+	uint8_t hello[] = "hello";
+	uint8_t hello_again[] = "hello";
+	uint8_t world[] = "world";
+	uint8_t table[16] = {1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16};
+	uint8_t table_copy[16] = {1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16};
+	uint8_t other_table[16] = {0xff};
+
+	for (unsigned int i = 0; i < 2; i++) {
+		struct data_section * __restrict const data_section = sections[i];
+		assert(data_section_set_deduplication(data_section, 1));
+		data_section_set_base_address(data_section, 0x1000);
+
+		assert(data_section_add(data_section, 1, 6, name, hello).id == 0);
+		assert(data_section_add(data_section, 4, 16, name, table).id == 1);
+		assert(data_section_add(data_section, 1, 6, name, hello_again).id == 2);
+		// Different alignment, so not the same symbol
+		assert(data_section_add(data_section, 4, 6, name, hello).id == 3);
+		assert(data_section_add(data_section, 1, 6, name, world).id == 4);
+		assert(data_section_add(data_section, 4, 16, name, table_copy).id == 5);
+
+		assert(data_address(data_section, 2) == data_address(data_section, 0));
+		assert(data_address(data_section, 5) == data_address(data_section, 1));
+		assert(data_address(data_section, 3) != data_address(data_section, 0));
+		// 6 bytes, 2 bytes of padding, 16, 6, 6
+		assert(data_section_size(data_section) == 6 + 2 + 16 + 6 + 6);
+		assert_written_at_symbol_address(data_section, 2, hello, 6);
+		assert_written_at_symbol_address(data_section, 5, table, 16);
+
+		// The aliases keep the content of deleted symbols
+		delete_data_symbol(data_section, 0);
+		assert_written_at_symbol_address(data_section, 2, hello, 6);
+		assert_written_at_symbol_address(data_section, 4, world, 6);
+		assert(data_section_size(data_section) == 6 + 2 + 16 + 6 + 6);
+
+		// ... and of updated symbols
+		update_data_symbol(data_section, 1, 4, 16, name, other_table);
+		assert_written_at_symbol_address(data_section, 1, other_table, 16);
+		assert_written_at_symbol_address(data_section, 5, table, 16);
+		assert_written_at_symbol_address(data_section, 2, hello, 6);
+
+		// Updating with the same content keeps things shared.
+		// The new symbol reuses the slot of the deleted one.
+		uint32_t const size_before = data_section_size(data_section);
+		uint32_t const reused = data_section_add(data_section, 1, 6, name, world).id;
+		assert(handle_slot(reused) == 0 && reused != 0);
+		update_data_symbol(data_section, reused, 1, 6, name, world);
+		assert(data_address(data_section, reused) == data_address(data_section, 4));
+		assert(data_section_size(data_section) == size_before);
+
+		// An alias updated with a new content gets its own copy
+		update_data_symbol(data_section, reused, 1, 6, name, hello);
+		assert(data_address(data_section, reused) != data_address(data_section, 4));
+		assert_written_at_symbol_address(data_section, reused, hello, 6);
+		assert_written_at_symbol_address(data_section, 4, world, 6);
+	}
+	assert_same_content(sections[0], sections[1]);
+
+	/* Lots of symbols sharing a few contents */
+	static uint8_t contents[100][8];
+	struct data_section * __restrict const image_section =
+		generate_data_section_with_storage(data_storage_contiguous_image);
+	assert(image_section != NULL);
+	assert(data_section_set_deduplication(image_section, 1));
+	for (unsigned int s = 0; s < 100000; s++) {
+		uint8_t * __restrict const content = contents[s % 100];
+		memset(content, s % 100, sizeof(contents[0]));
+		assert(data_section_add(image_section, 8, 8, name, content).added);
+	}
+	assert(data_section_size(image_section) == 100 * 8);
+	assert_written_at_symbol_address(image_section, 99999, contents[99], 8);
+}
+
+#define BATCH_THREADS 4
+#define BATCH_SYMBOLS 3000
+static uint8_t batch_contents[BATCH_THREADS][BATCH_SYMBOLS][24];
+
+struct batch_thread {
+	struct data_symbols_batch * batch;
+	unsigned int t;
+	uint32_t ids[BATCH_SYMBOLS];
+};
+
+static uint32_t batch_symbol_size(unsigned int const s) {
+	return 1 + s % 23;
+}
+
+static void * fill_batch(void * const arg) {
+	struct batch_thread * __restrict const thread = arg;
+	uint8_t name[] = "batched";
+	for (unsigned int s = 0; s < BATCH_SYMBOLS; s++) {
+		memset(batch_contents[thread->t][s], thread->t * 64 + s % 61, 24);
+		struct data_section_symbol_added const added = data_symbols_batch_add(
+			thread->batch, 1 << (s % 4), batch_symbol_size(s), name,
+			batch_contents[thread->t][s]
+		);
+		assert(added.added);
+		thread->ids[s] = added.id;
+	}
+	return NULL;
+}
+
+void test_concurrent_batches() {
+	struct data_section * __restrict const batched =
+		generate_data_section_with_storage(data_storage_contiguous_image);
+	struct data_section * __restrict const sequential =
+		generate_data_section();
+	assert(batched != NULL && sequential != NULL);
+	data_section_set_base_address(batched, 0x8000);
+	data_section_set_base_address(sequential, 0x8000);
+
+	uint8_t name[] = "first";
+	uint8_t first[4] = {1, 2, 3, 4};
+	assert(data_section_add(batched, 4, 4, name, first).id == 0);
+	assert(data_section_add(sequential, 4, 4, name, first).id == 0);
+
+	static struct batch_thread threads[BATCH_THREADS];
+	pthread_t pthreads[BATCH_THREADS];
+	data_section_open_batches(batched);
+	for (unsigned int t = 0; t < BATCH_THREADS; t++) {
+		threads[t].batch = generate_data_symbols_batch(batched);
+		threads[t].t = t;
+		assert(threads[t].batch != NULL);
+		assert(pthread_create(pthreads+t, NULL, fill_batch, threads+t) == 0);
+	}
+	for (unsigned int t = 0; t < BATCH_THREADS; t++)
+		pthread_join(pthreads[t], NULL);
+
+	/* Committed in the threads order, whatever the order in which they
+	 * reserved their IDs */
+	for (unsigned int t = 0; t < BATCH_THREADS; t++) {
+		assert(data_section_commit_batch(batched, threads[t].batch));
+		free_data_symbols_batch(threads[t].batch);
+		for (unsigned int s = 0; s < BATCH_SYMBOLS; s++)
+			assert(data_section_add(
+				sequential, 1 << (s % 4), batch_symbol_size(s), name,
+				batch_contents[t][s]
+			).added);
+	}
+	assert(batched->stored == 1 + BATCH_THREADS * BATCH_SYMBOLS);
+
+	static uint8_t batched_content[1 << 20];
+	static uint8_t sequential_content[1 << 20];
+	uint32_t const size = data_section_size(batched);
+	assert(size == data_section_size(sequential));
+	assert(size <= sizeof(batched_content));
+	assert(write_data_section_content(batched, batched_content) == size);
+	assert(write_data_section_content(sequential, sequential_content) == size);
+	assert(memcmp(batched_content, sequential_content, size) == 0);
+
+	for (unsigned int t = 0; t < BATCH_THREADS; t++) {
+		for (unsigned int s = 0; s < BATCH_SYMBOLS; s++) {
+			uint32_t const id = threads[t].ids[s];
+			uint32_t const index = 1 + t * BATCH_SYMBOLS + s;
+			assert(batched->symbols[index].id == id);
+			assert(data_size(batched, id) == batch_symbol_size(s));
+			assert(
+				data_address(batched, id) ==
+				data_address(sequential, sequential->symbols[index].id)
+			);
+		}
+	}
+
+	/* The unused reserved IDs are handed out again */
+	uint32_t const after = data_section_add(batched, 4, 4, name, first).id;
+	assert(data_section_has_symbol(batched, after));
+	assert(handle_slot(after) < batched->batches_next_slot);
+}
+
+void test_freed_batches() {
+	struct data_section * __restrict const data_section =
+		generate_data_section();
+	assert(data_section != NULL);
+
+	uint8_t name[] = "freed";
+	uint8_t content[4] = {1, 2, 3, 4};
+	assert(data_section_add(data_section, 4, 4, name, content).id == 0);
+
+	/* Batches freed without being committed don't keep their IDs */
+	data_section_open_batches(data_section);
+	struct data_symbols_batch * __restrict const batch =
+		generate_data_symbols_batch(data_section);
+	assert(batch != NULL);
+	uint32_t ids[2];
+	for (unsigned int s = 0; s < 2; s++)
+		ids[s] = data_symbols_batch_add(batch, 4, 4, name, content).id;
+	uint32_t const reserved = data_section->batches_next_slot;
+	free_data_symbols_batch(batch);
+
+	for (unsigned int s = 1; s < reserved; s++) {
+		uint32_t const id = data_section_add(data_section, 4, 4, name, content).id;
+		assert(handle_slot(id) < reserved);
+	}
+	assert(data_section->handles.used == reserved);
+	for (unsigned int s = 0; s < 2; s++)
+		assert(!data_section_has_symbol(data_section, ids[s]));
+}
+
+void test_data_section_snapshots() {
+	struct data_section * __restrict const data_section =
+		generate_data_section_with_storage(data_storage_contiguous_image);
+	assert(data_section != NULL);
+	data_section_set_base_address(data_section, 0x30000);
+
+	uint8_t name[] = "snap";
+	uint8_t contents[64][8];
+	for (unsigned int s = 0; s < 64; s++) {
+		memset(contents[s], s, sizeof(contents[s]));
+		assert(data_section_add(data_section, 1 << (s % 3), 1 + s % 8, name, contents[s]).added);
+	}
+	assert(data_section_add_zero_fill(data_section, 16, 256, name).id == 64);
+
+	static uint8_t before[1024], shown[1024];
+	uint32_t const size = data_section_size(data_section);
+	assert(write_data_section_content(data_section, before) == size);
+	uint32_t addresses[65];
+	for (unsigned int id = 0; id < 65; id++)
+		addresses[id] = data_address(data_section, id);
+
+	/* Snapshots freed before any modification share everything */
+	struct data_section * __restrict const unused =
+		data_section_snapshot(data_section);
+	assert(unused != NULL && unused->symbols == data_section->symbols);
+	free_data_section_snapshot(unused);
+
+	struct data_section * __restrict const snapshot =
+		data_section_snapshot(data_section);
+	assert(snapshot != NULL);
+	assert(snapshot->symbols == data_section->symbols);
+
+	/* Moving the section without changing the padding copies nothing */
+	data_section_set_base_address(data_section, 0x30010);
+	assert(snapshot->symbols == data_section->symbols);
+	assert(data_section_image(snapshot) == data_section_image(data_section));
+	assert(data_address(data_section, 5) == addresses[5] + 0x10);
+	assert(data_address(snapshot, 5) == addresses[5]);
+	data_section_set_base_address(data_section, 0x30000);
+
+	uint8_t other[16] = {0xaa};
+	update_data_symbol(data_section, 3, 8, 16, name, other);
+	delete_data_symbol(data_section, 10);
+	exchange_symbols_order(data_section, 0, 63);
+	assert(data_section_add(data_section, 4, 16, name, other).added);
+	data_section_set_base_address(data_section, 0x30001);
+	assert(snapshot->symbols != data_section->symbols);
+	assert(data_section_size(data_section) != size);
+
+	assert(data_section_size(snapshot) == size);
+	assert(write_data_section_content(snapshot, shown) == size);
+	assert(memcmp(before, shown, size) == 0);
+	for (unsigned int id = 0; id < 65; id++)
+		assert(data_address(snapshot, id) == addresses[id]);
+	assert(data_section_has_symbol(snapshot, 10));
+	assert(!data_section_has_symbol(data_section, 10));
+
+	free_data_section_snapshot(snapshot);
+	assert(data_address(data_section, 3) != addresses[3]);
+	assert_written_at_symbol_address(data_section, 3, other, 16);
+}
+
+void test_string_merging() {
+	struct data_section * __restrict const sections[2] = {
+		generate_data_section(),
+		generate_data_section_with_storage(data_storage_contiguous_image)
+	};
+	assert(sections[0] != NULL);
+	assert(sections[1] != NULL);
+
+	uint8_t name[] = "str";
+	uint8_t hello_world[] = "Hello world\n";
+	uint8_t world[] = "world\n";
+	uint8_t newline[] = "\n";
+	uint8_t other[] = "other";
+	uint8_t not_a_string[4] = {'l', 'd', '\n', 'x'};
+	uint8_t ld_aligned[] = "ld\n";
+	uint8_t world_again[] = "world\n";
+
+	for (unsigned int i = 0; i < 2; i++) {
+		struct data_section * __restrict const data_section = sections[i];
+		data_section_set_base_address(data_section, 0x1000);
+		data_section_set_read_only_base_address(data_section, 0x2000);
+		data_section_set_deduplication(data_section, 1);
+
+		assert(data_section_add_read_only(data_section, 1, 6, name, other).id == 0);
+		assert(data_section_add_read_only(data_section, 1, 7, name, world).id == 1);
+		assert(data_section_add_read_only(data_section, 1, 4, name, not_a_string).id == 2);
+		assert(data_section_add_read_only(data_section, 1, 13, name, hello_world).id == 3);
+		assert(data_section_add_read_only(data_section, 1, 2, name, newline).id == 4);
+		// Would be misaligned inside "Hello world\n"
+		assert(data_section_add_read_only(data_section, 4, 4, name, ld_aligned).id == 5);
+		// Deduplicated, then merged through its holder
+		assert(data_section_add_read_only(data_section, 1, 7, name, world_again).id == 6);
+		// Writable strings never share their bytes
+		assert(data_section_add(data_section, 1, 13, name, hello_world).id == 7);
+		assert(data_section_add(data_section, 1, 7, name, world).id == 8);
+
+		struct data_section const * __restrict const read_only =
+			data_section->read_only;
+		uint32_t const size_before = data_section_read_only_size(data_section);
+		struct data_section_layout_report const report =
+			data_section_merge_strings(data_section);
+		assert(report.optimized);
+		assert(report.size_before == size_before);
+		assert(report.size_after == data_section_read_only_size(data_section));
+		// "other", "ld\nx", "Hello world\n", 1 byte of padding, "ld\n"
+		assert(report.size_after == 6 + 4 + 13 + 1 + 4);
+		assert(report.bytes_saved == (int32_t) (size_before - report.size_after));
+
+		uint32_t const hello_address = data_address(data_section, 3);
+		assert(data_address(data_section, 1) == hello_address + 6);
+		assert(data_address(data_section, 6) == hello_address + 6);
+		// Stored in the aligned "ld\n", which could not be merged
+		assert(data_address(data_section, 5) % 4 == 0);
+		assert(data_address(data_section, 4) == data_address(data_section, 5) + 2);
+		assert_written_at_symbol_address(read_only, 0, other, 6);
+		assert_written_at_symbol_address(read_only, 1, world, 7);
+		assert_written_at_symbol_address(read_only, 2, not_a_string, 4);
+		assert_written_at_symbol_address(read_only, 3, hello_world, 13);
+		assert_written_at_symbol_address(read_only, 4, newline, 2);
+		assert_written_at_symbol_address(read_only, 5, ld_aligned, 4);
+		assert_written_at_symbol_address(read_only, 6, world, 7);
+
+		assert(data_section_size(data_section) == 13 + 7);
+		assert(data_address(data_section, 8) == data_address(data_section, 7) + 13);
+		assert_written_at_symbol_address(data_section, 7, hello_world, 13);
+		assert_written_at_symbol_address(data_section, 8, world, 7);
+
+		// Nothing left to merge
+		assert(!data_section_merge_strings(data_section).optimized);
+
+		// The suffixes survive the string holding them
+		delete_data_symbol(data_section, 3);
+		assert(data_section_read_only_size(data_section) == 6 + 4 + 7 + 3 + 4);
+		assert_written_at_symbol_address(read_only, 1, world, 7);
+		assert_written_at_symbol_address(read_only, 4, newline, 2);
+		assert_written_at_symbol_address(read_only, 6, world, 7);
+		assert_written_at_symbol_address(read_only, 5, ld_aligned, 4);
+	}
+	assert_same_content(sections[0]->read_only, sections[1]->read_only);
+	assert_same_content(sections[0], sections[1]);
+}
+
+void test_zero_fill() {
+	struct data_section * __restrict const data_section =
+		generate_data_section();
+	assert(data_section != NULL);
+	data_section_set_base_address(data_section, 0x3000);
+
+	uint8_t name[] = "bss";
+	uint8_t content[6] = "12345";
+
+	assert(data_section_add(data_section, 1, 6, name, content).id == 0);
+	assert(data_section_add_zero_fill(data_section, 16, 64 << 20, name).id == 1);
+	assert(data_section_add(data_section, 1, 3, name, content).id == 2);
+	assert(data_section_add_zero_fill(data_section, 4, 10, name).id == 3);
+
+	// Only the written content counts
+	assert(data_section_size(data_section) == 9);
+	assert(data_address(data_section, 2) == 0x3006);
+	assert(data_address(data_section, 1) == 0x3010);
+	assert(data_address(data_section, 3) == 0x3010 + (64 << 20));
+	assert(data_size(data_section, 1) == 64 << 20);
+	assert(data_section_zero_fill_size(data_section) == 7 + (64 << 20) + 10);
+
+	// The zero-filled symbols follow the written content
+	update_data_symbol(data_section, 2, 1, 12, name, content);
+	assert(data_address(data_section, 1) == 0x3020);
+	delete_data_symbol(data_section, 1);
+	assert(data_address(data_section, 3) == 0x3014);
+	assert(data_section_zero_fill_size(data_section) == 2 + 10);
+
+	update_data_symbol(data_section, 3, 8, 4, name, content);
+	assert(data_address(data_section, 3) == 0x3018);
+	assert(data_size(data_section, 3) == 4);
+	assert(data_section_size(data_section) == 18);
+
+	// The slot of the deleted zero-filled symbol is reused
+	uint32_t const reused = data_section_add(data_section, 1, 2, name, content).id;
+	assert(handle_slot(reused) == 1);
+	assert(!data_section_has_symbol(data_section, 1));
+	assert(data_address(data_section, reused) == 0x3012);
+	assert(data_address(data_section, 3) == 0x3018);
+
+	// No image is reserved for them, even in image sections
+	struct data_section * __restrict const image_section =
+		generate_data_section_with_storage(data_storage_contiguous_image);
+	assert(image_section != NULL);
+	assert(data_section_add(image_section, 1, 6, name, content).added);
+	assert(data_section_add_zero_fill(image_section, 16, 64 << 20, name).added);
+	assert(data_section_image(image_section->zero_fill) == NULL);
+	assert(data_section_zero_fill_size(image_section) == 10 + (64 << 20));
+}
+
+void test_read_only() {
+	struct data_section * __restrict const data_section =
+		generate_data_section_with_storage(data_storage_contiguous_image);
+	assert(data_section != NULL);
+	data_section_set_base_address(data_section, 0x20000);
+	data_section_set_read_only_base_address(data_section, 0x10100);
+
+	uint8_t name[] = "ro";
+	uint8_t writable[4] = {1, 2, 3, 4};
+	uint8_t table[8] = {5, 6, 7, 8, 9, 10, 11, 12};
+	uint8_t message[] = "read only\n";
+	uint8_t only[] = "only\n";
+
+	assert(data_section_add(data_section, 4, 4, name, writable).id == 0);
+	assert(data_section_add_read_only(data_section, 8, 8, name, table).id == 1);
+	assert(data_section_add_zero_fill(data_section, 4, 64, name).id == 2);
+	assert(data_section_add_read_only(data_section, 1, 11, name, message).id == 3);
+	assert(data_section_add_read_only(data_section, 1, 6, name, only).id == 4);
+
+	assert(data_section_size(data_section) == 4);
+	assert(data_section_read_only_size(data_section) == 8 + 11 + 6);
+	assert(data_address(data_section, 0) == 0x20000);
+	assert(data_address(data_section, 2) == 0x20004);
+	assert(data_address(data_section, 1) == 0x10100);
+	assert(data_address(data_section, 3) == 0x10108);
+	assert(data_size(data_section, 3) == 11);
+
+	// Not aligned anymore, so the padding changes
+	data_section_set_read_only_base_address(data_section, 0x10104);
+	assert(data_address(data_section, 1) == 0x10108);
+
+	uint8_t content[64];
+	assert(write_data_section_read_only_content(data_section, content) == 4 + 8 + 11 + 6);
+	assert(memcmp(content+4, table, 8) == 0);
+	assert(memcmp(content+12, message, 11) == 0);
+
+	// Read-only strings are merged together
+	struct data_section_layout_report const report =
+		data_section_merge_strings(data_section);
+	assert(report.optimized);
+	assert(report.bytes_saved == 6);
+	assert(data_address(data_section, 4) == data_address(data_section, 3) + 5);
+
+	update_data_symbol(data_section, 1, 8, 4, name, table+4);
+	delete_data_symbol(data_section, 0);
+	assert(data_section_size(data_section) == 0);
+	assert(data_address(data_section, 3) == 0x1010c);
+	assert(write_data_section_read_only_content(data_section, content) == 4 + 4 + 11);
+	assert(memcmp(content+4, table+4, 4) == 0);
+	assert(memcmp(content+8, message, 11) == 0);
+}
+
+void test_names_table() {
+	struct names_table * __restrict const names_table =
+		generate_names_table();
+	assert(names_table != NULL);
+
+	struct data_section * __restrict const data_section =
+		generate_data_section();
+	assert(data_section != NULL);
+
+	uint8_t content[4] = {1, 2, 3, 4};
+	char early_name[] = "early";
+	assert(data_section_add(data_section, 1, 4, early_name, content).id == 0);
+
+	data_section_use_names_table(data_section, names_table);
+	assert(data_section->symbols[0].name != (uint8_t *) early_name);
+	assert(strcmp(data_section->symbols[0].name, "early") == 0);
+
+	assert(data_section_add(data_section, 1, 4, "message", content).id == 1);
+	assert(data_section_add_read_only(data_section, 1, 4, "constants", content).id == 2);
+	assert(data_section_add_zero_fill(data_section, 1, 4, "buffer").id == 3);
+
+	struct names_table_result found =
+		names_table_data_symbol(names_table, "early");
+	assert(found.found && found.id == 0);
+	found = names_table_data_symbol(names_table, "constants");
+	assert(found.found && found.id == 2);
+	found = names_table_data_symbol(names_table, "buffer");
+	assert(found.found && found.id == 3);
+	assert(!names_table_data_symbol(names_table, "nothing").found);
+
+	// Interned names are unique
+	assert(names_table_intern(names_table, "message") == data_section->symbols[1].name);
+
+	update_data_symbol(data_section, 1, 1, 4, "renamed", content);
+	assert(!names_table_data_symbol(names_table, "message").found);
+	found = names_table_data_symbol(names_table, "renamed");
+	assert(found.found && found.id == 1);
+
+	delete_data_symbol(data_section, 0);
+	delete_data_symbol(data_section, 3);
+	assert(!names_table_data_symbol(names_table, "early").found);
+	assert(!names_table_data_symbol(names_table, "buffer").found);
+
+	/* Enough names to grow everything */
+	char name[32];
+	for (unsigned int n = 0; n < 20000; n++) {
+		snprintf(name, sizeof(name), "symbol_%u", n);
+		assert(names_table_bind_data_symbol(names_table, name, n + 100) != NULL);
+	}
+	for (unsigned int n = 0; n < 20000; n += 7) {
+		snprintf(name, sizeof(name), "symbol_%u", n);
+		found = names_table_data_symbol(names_table, name);
+		assert(found.found && found.id == n + 100);
+	}
+	found = names_table_data_symbol(names_table, "renamed");
+	assert(found.found && found.id == 1);
+}
+
 int main() {
 	test_add_data();
 	test_delete_data();
 	test_exchange_data();
 	test_update_data_symbol();
+	test_symbols_index();
+	test_data_layout();
+	test_packed_layout();
+	test_contiguous_image();
+	test_layout_optimization();
+	test_deduplication();
+	test_string_merging();
+	test_zero_fill();
+	test_read_only();
+	test_names_table();
+	test_concurrent_batches();
+	test_freed_batches();
+	test_data_section_snapshots();
 	return 0;
 }
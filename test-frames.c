@@ -4,6 +4,7 @@
 #include <stddef.h> // NULL
 #include <assert.h>
 #include <string.h>
+#include <stdlib.h>
 
 unsigned int id = 0;
 uint32_t id_generator() {
@@ -43,8 +44,8 @@ void assert_mnemonic_args
  uint32_t arg_value)
 {
 	instruction_arg(inst, index, arg_type, arg_value);
-	assert(inst->args[index].type == arg_type);
-	assert(inst->args[index].value == arg_value);
+	assert(inst->types[index] == arg_type);
+	assert(inst->values[index] == arg_value);
 }
 
 void test_generate_frame() {
@@ -237,8 +238,8 @@ void test_frame_addresses_retrieving() {
 	armv7_frame_set_address(exit_frame, 0x11000);
 	
 	uint32_t expected_main_frame_code[2] = {
-		0xeb000003,
-		0xea0003e2
+		0xeb000002,
+		0xea0003e1
 	};
 	
 	uint32_t expected_write_frame_code[7] = {
@@ -304,8 +305,8 @@ void test_frame_addresses_retrieving() {
 	
 	armv7_frame_set_address(write_frame, 0x10000);
 	uint32_t expected_new_main_frame_code[2] = {
-		0xebffffe3,
-		0xea0003e2
+		0xebffffe2,
+		0xea0003e1
 	};
 	
 	assert(
@@ -321,8 +322,904 @@ void test_frame_addresses_retrieving() {
 	);
 }
 
+void test_frame_names() {
+	struct names_table * __restrict const names_table =
+		generate_names_table();
+	assert(names_table != NULL);
+
+	struct armv7_text_frame * __restrict const main_frame =
+		generate_armv7_text_frame(id_generator);
+	struct armv7_text_frame * __restrict const other_frame =
+		generate_armv7_text_frame(id_generator);
+	assert(main_frame != NULL);
+	assert(other_frame != NULL);
+
+	char main_name[] = "main";
+	assert(frame_add_name(&main_frame->metadata, names_table, main_name));
+	assert(frame_add_name(&main_frame->metadata, names_table, "_start"));
+	assert(frame_add_name(&other_frame->metadata, names_table, "write"));
+
+	// The first name is kept, and interned
+	assert(strcmp(main_frame->metadata.name, "main") == 0);
+	assert(main_frame->metadata.name != (uint8_t *) main_name);
+
+	struct names_table_result found =
+		names_table_frame(names_table, "_start");
+	assert(found.found);
+	assert(found.id == main_frame->metadata.id);
+	found = names_table_frame(names_table, "write");
+	assert(found.found);
+	assert(found.id == other_frame->metadata.id);
+	assert(!names_table_frame(names_table, "read").found);
+	assert(!names_table_data_symbol(names_table, "main").found);
+
+	names_table_unbind_frame(names_table, "_start", main_frame->metadata.id);
+	assert(!names_table_frame(names_table, "_start").found);
+	assert(names_table_frame(names_table, "main").found);
+}
+
+unsigned int count_references
+(struct references_index const * __restrict const references,
+ enum reference_target const target,
+ uint32_t const target_id,
+ uint32_t const frame_id,
+ uint32_t const instruction_index)
+{
+	unsigned int found = 0;
+	for (uint32_t r = references_index_first(references, target, target_id);
+	     r != REFERENCES_END;
+	     r = references_index_next(references, r))
+		found +=
+			references->nodes[r].frame_id == frame_id &&
+			references->nodes[r].instruction_index == instruction_index;
+	return found;
+}
+
+void test_references_index() {
+	struct references_index * __restrict const references =
+		generate_references_index();
+	assert(references != NULL);
+
+	struct armv7_text_frame * __restrict const caller =
+		generate_armv7_text_frame(id_generator);
+	struct armv7_text_frame * __restrict const callee =
+		generate_armv7_text_frame(id_generator);
+	assert(caller != NULL);
+	assert(callee != NULL);
+
+	uint32_t const caller_id = caller->metadata.id;
+	uint32_t const callee_id = callee->metadata.id;
+
+	/* Instructions written before tracking are recorded too */
+	struct instruction_representation * __restrict const early =
+		assert_add_inst(caller);
+	instruction_mnemonic_id(early, inst_movw_immediate);
+	instruction_arg(early, 0, arg_register, r0);
+	instruction_arg(early, 1, arg_data_symbol_address_bottom16, 3);
+	armv7_frame_track_references(caller, references);
+	assert(count_references(references, reference_to_data_symbol, 3, caller_id, 0) == 1);
+
+	assert_add_inst(caller);
+	frame_instruction_mnemonic_id(caller, 1, inst_movt_immediate);
+	frame_instruction_arg(caller, 1, 0, arg_register, r0);
+	frame_instruction_arg(caller, 1, 1, arg_data_symbol_address_top16, 3);
+	assert_add_inst(caller);
+	frame_instruction_mnemonic_id(caller, 2, inst_bl_address);
+	frame_instruction_arg(caller, 2, 0, arg_condition, cond_al);
+	frame_instruction_arg(caller, 2, 1, arg_frame_address_pc_relative, callee_id);
+
+	assert(count_references(references, reference_to_data_symbol, 3, caller_id, 1) == 1);
+	assert(count_references(references, reference_to_frame, callee_id, caller_id, 2) == 1);
+	assert(references_index_first(references, reference_to_data_symbol, 4) == REFERENCES_END);
+
+	/* Changing the argument moves the reference */
+	frame_instruction_arg(caller, 1, 1, arg_data_symbol_address_top16, 4);
+	assert(count_references(references, reference_to_data_symbol, 3, caller_id, 1) == 0);
+	assert(count_references(references, reference_to_data_symbol, 3, caller_id, 0) == 1);
+	assert(count_references(references, reference_to_data_symbol, 4, caller_id, 1) == 1);
+
+	/* Changing the mnemonic resets the arguments */
+	frame_instruction_mnemonic_id(caller, 2, inst_svc_immediate);
+	assert(references_index_first(references, reference_to_frame, callee_id) == REFERENCES_END);
+
+	/* Lots of references to the same symbol */
+	armv7_frame_track_references(callee, references);
+	for (uint32_t i = 0; i < 1000; i++) {
+		assert_add_inst(callee);
+		frame_instruction_mnemonic_id(callee, i, inst_mov_immediate);
+		frame_instruction_arg(callee, i, 1, arg_data_symbol_size, 3);
+	}
+	assert(count_references(references, reference_to_data_symbol, 3, callee_id, 999) == 1);
+	for (uint32_t i = 0; i < 1000; i += 2)
+		frame_instruction_arg(callee, i, 1, arg_immediate, 0);
+	unsigned int remaining = 0;
+	for (uint32_t r = references_index_first(references, reference_to_data_symbol, 3);
+	     r != REFERENCES_END;
+	     r = references_index_next(references, r))
+		remaining++;
+	assert(remaining == 500 + 1);
+
+	armv7_frame_track_references(callee, NULL);
+	assert(count_references(references, reference_to_data_symbol, 3, caller_id, 0) == 1);
+	assert(count_references(references, reference_to_data_symbol, 3, callee_id, 999) == 0);
+}
+
+static void add_mov(
+	struct armv7_text_frame * __restrict const frame,
+	uint32_t const value)
+{
+	struct instruction_representation * __restrict const inst =
+		assert_add_inst(frame);
+	instruction_mnemonic_id(inst, inst_mov_immediate);
+	instruction_arg(inst, 0, arg_register, r0);
+	instruction_arg(inst, 1, arg_immediate, value);
+}
+
+void test_text_section_snapshots() {
+	struct armv7_text_section * __restrict const text_section =
+		generate_armv7_text_section();
+	struct data_section * __restrict const data_section =
+		generate_data_section();
+	assert(text_section != NULL);
+	assert(data_section != NULL);
+
+	struct armv7_text_frame * frames[3];
+	for (unsigned int f = 0; f < 3; f++) {
+		frames[f] = generate_armv7_text_frame(id_generator);
+		assert(frames[f] != NULL);
+		assert(armv7_text_section_add_frame(text_section, frames[f]));
+		add_mov(frames[f], f);
+	}
+	struct instruction_representation * __restrict const branch =
+		assert_add_inst(frames[0]);
+	instruction_mnemonic_id(branch, inst_bl_address);
+	instruction_arg(branch, 0, arg_condition, cond_al);
+	instruction_arg(
+		branch, 1, arg_frame_address_pc_relative, frames[2]->metadata.id
+	);
+	armv7_text_section_rebase_at(text_section, 0x10000);
+
+	static uint8_t before[32], snapshot_output[32], after[64];
+	uint32_t const size_before = armv7_text_section_size(text_section);
+	assert(size_before == 16);
+	armv7_text_section_write_at(text_section, data_section, before);
+
+	struct instruction_representation const * __restrict const modified =
+		armv7_frame_instruction(frames[2], 0);
+	struct armv7_text_section * __restrict const snapshot =
+		armv7_text_section_snapshot(text_section);
+	assert(snapshot != NULL);
+
+	/* Modify the live section in every possible way */
+	add_mov(frames[1], 0xff);
+	frame_instruction_arg(frames[2], 0, 1, arg_immediate, 0x42);
+	/* The live instructions are modified in place */
+	assert(armv7_frame_instruction(frames[2], 0) == modified);
+	assert(modified->values[1] == 0x42);
+	struct armv7_text_frame * __restrict const added =
+		generate_armv7_text_frame(id_generator);
+	assert(added != NULL);
+	assert(armv7_text_section_add_frame(text_section, added));
+	add_mov(added, 3);
+	armv7_text_section_rebase_at(text_section, 0x20000);
+	assert(armv7_text_section_size(text_section) == size_before + 8);
+
+	/* Only the chunks modified in place are copied for the snapshot.
+	 * Frames growing share all their chunks. */
+	assert(frames[1]->versions->owned_chunks == 0);
+	assert(frames[1]->versions->frame.instructions == frames[1]->instructions);
+	assert(frames[2]->versions->owned_chunks == 1);
+	assert(frames[2]->versions->frame.instructions != frames[2]->instructions);
+
+	assert(armv7_text_section_size(snapshot) == size_before);
+	armv7_text_section_write_at(snapshot, data_section, snapshot_output);
+	assert(memcmp(before, snapshot_output, size_before) == 0);
+	assert(text_section_frame_address(snapshot, frames[2]->metadata.id) == 0x1000c);
+	assert(text_section_frame_address(text_section, frames[2]->metadata.id) == 0x20010);
+
+	/* A second snapshot shows the section as modified */
+	armv7_text_section_write_at(text_section, data_section, after);
+	/* And so do the frames moved when writing the section */
+	assert(frames[0]->versions->owned_chunks == 0);
+	assert(frames[0]->versions->frame.instructions == frames[0]->instructions);
+	struct armv7_text_section * __restrict const second =
+		armv7_text_section_snapshot(text_section);
+	assert(second != NULL);
+	frame_instruction_arg(frames[1], 1, 1, arg_immediate, 0xfe);
+	/* Both snapshots shared that chunk, and now share its copy */
+	assert(frames[1]->versions->owned_chunks == 1);
+	assert(frames[1]->versions->older->owned_chunks == 0);
+	assert(
+		frames[1]->versions->older->frame.instructions ==
+		frames[1]->versions->frame.instructions
+	);
+
+	/* Enough frames to move the live frames references */
+	for (unsigned int f = 0; f < 600; f++) {
+		struct armv7_text_frame * __restrict const frame =
+			generate_armv7_text_frame(id_generator);
+		assert(frame != NULL);
+		assert(armv7_text_section_add_frame(text_section, frame));
+	}
+
+	free_armv7_text_section_snapshot(snapshot);
+	for (unsigned int f = 0; f < 3; f++)
+		assert(frames[f]->versions == NULL || frames[f]->versions->older == NULL);
+
+	memset(snapshot_output, 0, sizeof(snapshot_output));
+	armv7_text_section_write_at(second, data_section, snapshot_output);
+	assert(memcmp(after, snapshot_output, size_before + 8) == 0);
+	free_armv7_text_section_snapshot(second);
+
+	for (unsigned int f = 0; f < 3; f++)
+		assert(frames[f]->versions == NULL);
+	armv7_text_section_write_at(text_section, data_section, snapshot_output);
+	assert(memcmp(after, snapshot_output, size_before + 8) != 0);
+}
+
+void test_frames_index() {
+	struct armv7_text_section * __restrict const text_section =
+		generate_armv7_text_section();
+	assert(text_section != NULL);
+
+	static struct armv7_text_frame * frames[2000];
+	for (unsigned int f = 0; f < 1000; f++) {
+		frames[f] = generate_armv7_text_frame(id_generator);
+		assert(frames[f] != NULL);
+		assert(armv7_text_section_add_frame(text_section, frames[f]));
+		add_mov(frames[f], f);
+	}
+	armv7_text_section_rebase_at(text_section, 0x10000);
+
+	struct armv7_text_section * __restrict const snapshot =
+		armv7_text_section_snapshot(text_section);
+	assert(snapshot != NULL);
+
+	for (unsigned int f = 1000; f < 2000; f++) {
+		frames[f] = generate_armv7_text_frame(id_generator);
+		assert(frames[f] != NULL);
+		assert(armv7_text_section_add_frame(text_section, frames[f]));
+		add_mov(frames[f], f);
+	}
+	armv7_text_section_rebase_at(text_section, 0x20000);
+
+	for (unsigned int f = 0; f < 2000; f++)
+		assert(
+			text_section_frame_address(text_section, frames[f]->metadata.id) ==
+			0x20000 + f * 4
+		);
+	for (unsigned int f = 0; f < 1000; f++)
+		assert(
+			text_section_frame_address(snapshot, frames[f]->metadata.id) ==
+			0x10000 + f * 4
+		);
+	assert(text_section_frame_address(snapshot, frames[1000]->metadata.id) == 0);
+	assert(text_section_frame_address(text_section, id + 1) == 0);
+
+	free_armv7_text_section_snapshot(snapshot);
+	assert(
+		text_section_frame_address(text_section, frames[1999]->metadata.id) ==
+		0x20000 + 1999 * 4
+	);
+}
+
+void test_frames_pool() {
+	struct armv7_text_section * __restrict const text_section =
+		generate_armv7_text_section();
+	struct data_section * __restrict const data_section =
+		generate_data_section();
+	assert(text_section != NULL);
+	assert(data_section != NULL);
+	struct armv7_frames_pool * __restrict const pool =
+		armv7_text_section_frames_pool(text_section);
+	assert(pool != NULL);
+	assert(armv7_text_section_frames_pool(text_section) == pool);
+
+	uint32_t const expected[4] = {0, 3, 20, 200};
+	uint32_t const capacities[4] = {8, 8, 32, 256};
+	for (unsigned int e = 0; e < 4; e++) {
+		struct armv7_text_frame * __restrict const frame =
+			generate_pooled_armv7_text_frame(pool, id_generator, expected[e]);
+		assert(frame != NULL);
+		assert(frame->pool == pool);
+		assert(frame->metadata.max_instructions == capacities[e]);
+	}
+
+	/* Pooled frames, growing inside and outside the pool, encode like
+	 * the others */
+	struct armv7_text_frame * __restrict const pooled =
+		generate_pooled_armv7_text_frame(pool, id_generator, 1);
+	struct armv7_text_frame * __restrict const alone =
+		generate_armv7_text_frame(id_generator);
+	assert(pooled != NULL && alone != NULL);
+	assert(armv7_text_section_add_frame(text_section, pooled));
+
+	struct armv7_text_section * __restrict snapshot = NULL;
+	for (unsigned int i = 0; i < 300; i++) {
+		if (i == 12) {
+			snapshot = armv7_text_section_snapshot(text_section);
+			assert(snapshot != NULL);
+		}
+		add_mov(pooled, i & 0xff);
+		add_mov(alone, i & 0xff);
+	}
+	assert(pooled->metadata.max_instructions == 512);
+
+	static uint32_t pooled_code[300], alone_code[300], snapshot_code[12];
+	assert(armv7_frame_gen_machine_code(pooled, text_section, data_section, pooled_code));
+	assert(armv7_frame_gen_machine_code(alone, text_section, data_section, alone_code));
+	assert(memcmp(pooled_code, alone_code, sizeof(pooled_code)) == 0);
+
+	armv7_text_section_write_at(snapshot, data_section, (uint8_t *) snapshot_code);
+	assert(memcmp(snapshot_code, alone_code, sizeof(snapshot_code)) == 0);
+
+	/* Only the chunk holding the modified instruction is copied */
+	frame_instruction_arg(pooled, 10, 1, arg_immediate, 0x42);
+	assert(pooled->versions->owned_chunks == 2);
+	assert(pooled->versions->frame.instructions == pooled->instructions);
+	assert(pooled->versions->frame.chunks[0] != pooled->chunks[0]);
+	armv7_text_section_write_at(snapshot, data_section, (uint8_t *) snapshot_code);
+	assert(memcmp(snapshot_code, alone_code, sizeof(snapshot_code)) == 0);
+
+	/* Sections with snapshots are kept */
+	free_armv7_text_section(text_section);
+	assert(armv7_text_section_frames_pool(text_section) == pool);
+	free_armv7_text_section_snapshot(snapshot);
+	free_armv7_text_section(text_section);
+}
+
+void test_frame_chunks() {
+	assert(sizeof(struct instruction_representation) == 16);
+
+	struct armv7_text_frame * __restrict const frame =
+		generate_armv7_text_frame(id_generator);
+	assert(frame != NULL);
+
+	static struct instruction_representation * added[1000];
+	for (unsigned int i = 0; i < 1000; i++) {
+		added[i] = assert_add_inst(frame);
+		instruction_mnemonic_id(added[i], inst_mov_immediate);
+		instruction_arg(added[i], 0, arg_register, r1);
+		instruction_arg(added[i], 1, arg_immediate, i & 0xff);
+	}
+	assert(frame->metadata.max_instructions == 1024);
+
+	/* Instructions never moved */
+	for (unsigned int i = 0; i < 1000; i++) {
+		assert(armv7_frame_instruction(frame, i) == added[i]);
+		assert(added[i]->values[1] == (int32_t) (i & 0xff));
+	}
+
+	static uint32_t code[1000];
+	assert(armv7_frame_gen_machine_code(frame, NULL, NULL, code) == 4000);
+	for (unsigned int i = 0; i < 1000; i++)
+		assert(code[i] == op_mov_immediate(r1, i & 0xff));
+}
+
+/* Small frames calling each other, a frame too big for one task, and
+ * data symbols addresses */
+static void fill_write_test_section(
+	struct armv7_text_section * __restrict const text_section,
+	struct data_section * __restrict const data_section,
+	struct armv7_text_frame ** __restrict const frames,
+	unsigned int const n_frames)
+{
+	uint8_t const word[4] = {1, 2, 3, 4};
+	uint32_t symbols[16];
+	for (unsigned int d = 0; d < 16; d++) {
+		struct data_section_symbol_added const status =
+			data_section_add(data_section, 4, sizeof(word), NULL, word);
+		assert(status.added);
+		symbols[d] = status.id;
+	}
+
+	for (unsigned int f = 0; f < n_frames; f++) {
+		frames[f] = generate_armv7_text_frame(id_generator);
+		assert(frames[f] != NULL);
+		assert(armv7_text_section_add_frame(text_section, frames[f]));
+	}
+	for (unsigned int f = 0; f < n_frames; f++) {
+		unsigned int const n_instructions = (f == n_frames / 2) ? 10000 : f % 7;
+		for (unsigned int i = 0; i < n_instructions; i++) {
+			struct instruction_representation * __restrict const inst =
+				assert_add_inst(frames[f]);
+			if (i % 2) {
+				instruction_mnemonic_id(inst, inst_bl_address);
+				instruction_arg(inst, 0, arg_condition, cond_al);
+				instruction_arg(
+					inst, 1, arg_frame_address_pc_relative,
+					frames[(f + i) % n_frames]->metadata.id
+				);
+			}
+			else {
+				instruction_mnemonic_id(inst, inst_movw_immediate);
+				instruction_arg(inst, 0, arg_register, r1);
+				instruction_arg(
+					inst, 1, arg_data_symbol_address_bottom16, symbols[i % 16]
+				);
+			}
+		}
+	}
+	armv7_text_section_rebase_at(text_section, 0x10000);
+	data_section_set_base_address(data_section, 0x80000);
+}
+
+void test_parallel_write() {
+	struct armv7_text_section * __restrict const text_section =
+		generate_armv7_text_section();
+	struct data_section * __restrict const data_section =
+		generate_data_section();
+	assert(text_section != NULL);
+	assert(data_section != NULL);
+
+	static struct armv7_text_frame * frames[3000];
+	fill_write_test_section(text_section, data_section, frames, 3000);
+
+	uint32_t const size = armv7_text_section_size(text_section);
+	uint8_t * __restrict const serial = malloc(size);
+	uint8_t * __restrict const parallel = malloc(size);
+	assert(serial != NULL && parallel != NULL);
+	armv7_text_section_write_at(text_section, data_section, serial);
+
+	unsigned int const n_threads[4] = {1, 2, 3, 8};
+	for (unsigned int t = 0; t < 4; t++) {
+		memset(parallel, 0, size);
+		armv7_text_section_write_at_in_parallel(
+			text_section, data_section, parallel, n_threads[t]
+		);
+		assert(memcmp(serial, parallel, size) == 0);
+	}
+
+	/* Snapshots too */
+	struct armv7_text_section * __restrict const snapshot =
+		armv7_text_section_snapshot(text_section);
+	assert(snapshot != NULL);
+	add_mov(frames[0], 1);
+	memset(parallel, 0, size);
+	armv7_text_section_write_at_in_parallel(snapshot, data_section, parallel, 4);
+	assert(memcmp(serial, parallel, size) == 0);
+	free_armv7_text_section_snapshot(snapshot);
+
+	free(serial);
+	free(parallel);
+}
+
+void test_frame_code_cache() {
+	struct armv7_text_section * __restrict const text_section =
+		generate_armv7_text_section();
+	struct data_section * __restrict const data_section =
+		generate_data_section();
+	assert(text_section != NULL);
+	assert(data_section != NULL);
+
+	uint8_t const word[4] = {1, 2, 3, 4};
+	struct data_section_symbol_added const symbol =
+		data_section_add(data_section, 4, sizeof(word), NULL, word);
+	assert(symbol.added);
+
+	struct armv7_text_frame * frames[3];
+	for (unsigned int f = 0; f < 3; f++) {
+		frames[f] = generate_armv7_text_frame(id_generator);
+		assert(frames[f] != NULL);
+		assert(armv7_text_section_add_frame(text_section, frames[f]));
+	}
+	add_mov(frames[0], 1);
+	struct instruction_representation * __restrict inst =
+		assert_add_inst(frames[1]);
+	instruction_mnemonic_id(inst, inst_bl_address);
+	instruction_arg(inst, 0, arg_condition, cond_al);
+	instruction_arg(inst, 1, arg_frame_address_pc_relative, frames[2]->metadata.id);
+	inst = assert_add_inst(frames[2]);
+	instruction_mnemonic_id(inst, inst_movw_immediate);
+	instruction_arg(inst, 0, arg_register, r1);
+	instruction_arg(inst, 1, arg_data_symbol_address_bottom16, symbol.id);
+	armv7_text_section_rebase_at(text_section, 0x10000);
+	data_section_set_base_address(data_section, 0x20000);
+
+	uint32_t written[4], expected[4];
+	armv7_text_section_write_at(text_section, data_section, (uint8_t *) written);
+	for (unsigned int f = 0; f < 3; f++) {
+		assert(frames[f]->code.valid);
+		armv7_frame_gen_machine_code(
+			frames[f], text_section, data_section, expected+f
+		);
+	}
+	assert(memcmp(written, expected, 12) == 0);
+
+	/* Unchanged frames are copied from their code */
+	for (unsigned int f = 0; f < 3; f++) frames[f]->code.words[0] = f;
+	armv7_text_section_write_at(text_section, data_section, (uint8_t *) written);
+	for (unsigned int f = 0; f < 3; f++) assert(written[f] == f);
+
+	/* Changing the first frame moves the two others, and the branch
+	 * doesn't move relatively to its target. The last frame code doesn't
+	 * depend on its address, and is copied as is. */
+	frame_instruction_arg(frames[0], 0, 1, arg_immediate, 2);
+	assert_add_inst(frames[0]);
+	frame_instruction_mnemonic_id(frames[0], 1, inst_mov_immediate);
+	frame_instruction_arg(frames[0], 1, 1, arg_immediate, 3);
+	armv7_text_section_rebase_at(text_section, 0x10000);
+	armv7_text_section_write_at(text_section, data_section, (uint8_t *) written);
+	armv7_frame_gen_machine_code(frames[0], text_section, data_section, expected);
+	armv7_frame_gen_machine_code(frames[1], text_section, data_section, expected+2);
+	assert(memcmp(written, expected, 12) == 0);
+	assert(written[3] == 2);
+
+	/* Moving the data only affects the frame using it */
+	frames[0]->code.words[0] = 0;
+	frames[1]->code.words[0] = 1;
+	data_section_set_base_address(data_section, 0x30000);
+	armv7_text_section_write_at(text_section, data_section, (uint8_t *) written);
+	armv7_frame_gen_machine_code(frames[2], text_section, data_section, expected+3);
+	assert(written[0] == 0 && written[2] == 1);
+	assert(written[3] == expected[3]);
+	assert(written[3] == op_movw_immediate(r1, 0));
+
+	/* Modifying a frame leaves the code of the others as is */
+	frames[0]->code.words[0] = 0;
+	frames[1]->code.words[0] = 1;
+	frame_instruction_arg(frames[2], 0, 0, arg_register, r2);
+	assert(!frames[2]->code.valid);
+	assert(frames[0]->code.valid && frames[1]->code.valid);
+	armv7_text_section_write_at(text_section, data_section, (uint8_t *) written);
+	assert(written[0] == 0 && written[2] == 1);
+	assert(written[3] == op_movw_immediate(r2, 0));
+
+	/* Instructions modified through their address */
+	instruction_arg(inst, 0, arg_register, r3);
+	armv7_frame_invalidate_code(frames[2]);
+	armv7_text_section_write_at(text_section, data_section, (uint8_t *) written);
+	assert(written[3] == op_movw_immediate(r3, 0));
+}
+
+static void assert_frames_placed_from(
+	struct armv7_text_section const * __restrict const text_section,
+	uint32_t address)
+{
+	uint32_t size = 0;
+	for (uint32_t f = 0; f < text_section->n_frames_refs; f++) {
+		struct armv7_text_frame const * __restrict const frame =
+			text_section->frames_refs[f];
+		assert(text_section_frame_address(text_section, frame->metadata.id) == address);
+		address += armv7_frame_size(frame);
+		size += armv7_frame_size(frame);
+	}
+	assert(armv7_text_section_size(text_section) == size);
+}
+
+void test_incremental_layout() {
+	struct armv7_text_section * __restrict const text_section =
+		generate_armv7_text_section();
+	assert(text_section != NULL);
+
+	static struct armv7_text_frame * frames[500];
+	for (unsigned int f = 0; f < 500; f++) {
+		frames[f] = generate_armv7_text_frame(id_generator);
+		assert(frames[f] != NULL);
+		for (unsigned int i = 0; i < f % 5; i++) add_mov(frames[f], i);
+		assert(armv7_text_section_add_frame(text_section, frames[f]));
+	}
+	armv7_text_section_rebase_at(text_section, 0x10000);
+	assert_frames_placed_from(text_section, 0x10000);
+
+	/* Growing a frame moves the next ones */
+	add_mov(frames[10], 1);
+	add_mov(frames[10], 2);
+	assert_frames_placed_from(text_section, 0x10000);
+
+	/* Inserting and removing frames in the middle */
+	struct armv7_text_frame * __restrict const inserted =
+		generate_armv7_text_frame(id_generator);
+	assert(inserted != NULL);
+	add_mov(inserted, 3);
+	assert(armv7_text_section_insert_frame(text_section, inserted, 100));
+	assert(text_section->frames_refs[100] == inserted);
+	assert(text_section->n_frames_refs == 501);
+	assert_frames_placed_from(text_section, 0x10000);
+
+	assert(armv7_text_section_remove_frame(text_section, 3) == frames[3]);
+	assert(armv7_text_section_remove_frame(text_section, 600) == NULL);
+	assert(text_section_frame_address(text_section, frames[3]->metadata.id) == 0);
+	assert(text_section->n_frames_refs == 500);
+	assert_frames_placed_from(text_section, 0x10000);
+
+	/* The frames know their addresses once written */
+	uint8_t * __restrict const output =
+		malloc(armv7_text_section_size(text_section));
+	assert(output != NULL);
+	armv7_text_section_write_at(text_section, NULL, output);
+	free(output);
+	uint32_t const last_id = frames[499]->metadata.id;
+	uint32_t const last_address =
+		text_section_frame_address(text_section, last_id);
+	assert(frames[499]->metadata.base_address == last_address);
+
+	/* Frames moved by hand stay where they are put */
+	armv7_frame_set_address(frames[0], 0x50000);
+	assert(text_section_frame_address(text_section, frames[0]->metadata.id) == 0x50000);
+	assert(text_section_frame_address(text_section, last_id) == last_address);
+	add_mov(frames[1], 4);
+	assert(text_section_frame_address(text_section, last_id) == last_address);
+
+	armv7_text_section_rebase_at(text_section, 0x20000);
+	assert_frames_placed_from(text_section, 0x20000);
+
+	/* Frames encoded before the section is written use their address
+	 * in the layout */
+	struct instruction_representation * __restrict const branch =
+		assert_add_inst(frames[499]);
+	instruction_mnemonic_id(branch, inst_bl_address);
+	instruction_arg(branch, 0, arg_condition, cond_al);
+	instruction_arg(branch, 1, arg_frame_address_pc_relative, frames[2]->metadata.id);
+	add_mov(frames[50], 5);
+	uint32_t direct[5], placed[5];
+	assert(frames[499]->metadata.stored_instructions == 5);
+	assert(armv7_frame_gen_machine_code(frames[499], text_section, NULL, direct) == 20);
+	uint8_t * __restrict const placing =
+		malloc(armv7_text_section_size(text_section));
+	assert(placing != NULL);
+	armv7_text_section_write_at(text_section, NULL, placing);
+	free(placing);
+	armv7_frame_gen_machine_code(frames[499], text_section, NULL, placed);
+	assert(memcmp(direct, placed, sizeof(direct)) == 0);
+}
+
+void test_frame_fixups() {
+	struct armv7_text_section * __restrict const text_section =
+		generate_armv7_text_section();
+	struct data_section * __restrict const data_section =
+		generate_data_section();
+	assert(text_section != NULL);
+	assert(data_section != NULL);
+
+	uint8_t const word[4] = {1, 2, 3, 4};
+	struct data_section_symbol_added const symbol =
+		data_section_add(data_section, 4, sizeof(word), NULL, word);
+	assert(symbol.added);
+
+	struct armv7_text_frame * __restrict const frame =
+		generate_armv7_text_frame(id_generator);
+	struct armv7_text_frame * __restrict const callee =
+		generate_armv7_text_frame(id_generator);
+	assert(frame != NULL && callee != NULL);
+	assert(armv7_text_section_add_frame(text_section, frame));
+	assert(armv7_text_section_add_frame(text_section, callee));
+
+	add_mov(frame, 1);
+	struct instruction_representation * __restrict inst =
+		assert_add_inst(frame);
+	instruction_mnemonic_id(inst, inst_movw_immediate);
+	instruction_arg(inst, 0, arg_register, r1);
+	instruction_arg(inst, 1, arg_data_symbol_address_bottom16, symbol.id);
+	inst = assert_add_inst(frame);
+	instruction_mnemonic_id(inst, inst_movt_immediate);
+	instruction_arg(inst, 0, arg_register, r1);
+	instruction_arg(inst, 1, arg_data_symbol_address_top16, symbol.id);
+	add_mov(frame, 2);
+	inst = assert_add_inst(frame);
+	instruction_mnemonic_id(inst, inst_bl_address);
+	instruction_arg(inst, 0, arg_condition, cond_al);
+	instruction_arg(inst, 1, arg_frame_address_pc_relative, callee->metadata.id);
+	add_mov(callee, 3);
+	armv7_text_section_rebase_at(text_section, 0x10000);
+	data_section_set_base_address(data_section, 0x20000);
+
+	uint32_t written[6], expected[6];
+	armv7_text_section_write_at(text_section, data_section, (uint8_t *) written);
+	armv7_frame_gen_machine_code(frame, text_section, data_section, expected);
+	armv7_frame_gen_machine_code(callee, text_section, data_section, expected+5);
+	assert(memcmp(written, expected, sizeof(written)) == 0);
+
+	/* Only the instructions referring to something are listed */
+	assert(frame->code.n_fixups == 3);
+	assert(frame->code.fixups[0].instruction == 1);
+	assert(frame->code.fixups[0].kinds == ARMV7_FIXUP_DATA);
+	assert(frame->code.fixups[1].instruction == 2);
+	assert(frame->code.fixups[2].instruction == 4);
+	assert(frame->code.fixups[2].kinds == ARMV7_FIXUP_FRAMES);
+	assert(callee->code.n_fixups == 0);
+	/* Along with the argument to patch, and what it refers to */
+	assert(frame->code.fixups[0].arg == 1);
+	assert(frame->code.fixups[0].target == (int32_t) symbol.id);
+	assert(frame->code.fixups[2].arg == 1);
+	assert(frame->code.fixups[2].target == (int32_t) callee->metadata.id);
+
+	/* Moving the data only applies the data fixups again */
+	frame->code.words[0] = 0;
+	frame->code.words[4] = 4;
+	data_section_set_base_address(data_section, 0x1230000);
+	armv7_text_section_write_at(text_section, data_section, (uint8_t *) written);
+	armv7_frame_gen_machine_code(frame, text_section, data_section, expected);
+	assert(written[0] == 0 && written[4] == 4);
+	assert(written[1] == expected[1] && written[2] == expected[2]);
+	assert(written[2] == op_movt_immediate(r1, 0x123));
+
+	/* Moving the frames only applies the frames fixups again */
+	frame->code.words[1] = 1;
+	armv7_text_section_rebase_at(text_section, 0x40000);
+	armv7_text_section_write_at(text_section, data_section, (uint8_t *) written);
+	armv7_frame_gen_machine_code(frame, text_section, data_section, expected);
+	assert(written[0] == 0 && written[1] == 1);
+	assert(written[4] == expected[4]);
+
+	/* Arguments that can flip the instruction when negative make it
+	 * encoded again as a whole */
+	inst = assert_add_inst(callee);
+	instruction_mnemonic_id(inst, inst_sub_immediate);
+	instruction_arg(inst, 0, arg_register, r0);
+	instruction_arg(inst, 1, arg_register, r0);
+	instruction_arg(inst, 2, arg_data_symbol_size, symbol.id);
+	uint32_t grown[7];
+	armv7_text_section_write_at(text_section, data_section, (uint8_t *) grown);
+	assert(callee->code.n_fixups == 1);
+	assert(callee->code.fixups[0].arg == ARMV7_FIXUP_WHOLE_INSTRUCTION);
+	assert(grown[6] == op_sub_immediate(r0, r0, sizeof(word)));
+}
+
+void test_deleted_data_references() {
+	struct armv7_text_section * __restrict const text_section =
+		generate_armv7_text_section();
+	struct data_section * __restrict const data_section =
+		generate_data_section();
+	assert(text_section != NULL);
+	assert(data_section != NULL);
+
+	uint8_t const word[4] = {1, 2, 3, 4};
+	uint8_t const padding[12] = {0};
+	data_section_add(data_section, 4, sizeof(padding), NULL, padding);
+	uint32_t const deleted_id =
+		data_section_add(data_section, 4, sizeof(word), NULL, word).id;
+
+	struct armv7_text_frame * __restrict const frame =
+		generate_armv7_text_frame(id_generator);
+	assert(frame != NULL);
+	assert(armv7_text_section_add_frame(text_section, frame));
+	struct instruction_representation * __restrict const inst =
+		assert_add_inst(frame);
+	instruction_mnemonic_id(inst, inst_movw_immediate);
+	instruction_arg(inst, 0, arg_register, r1);
+	instruction_arg(inst, 1, arg_data_symbol_address_bottom16, deleted_id);
+	armv7_text_section_rebase_at(text_section, 0x10000);
+	data_section_set_base_address(data_section, 0x20000);
+
+	uint32_t written;
+	assert(armv7_text_section_write_at(text_section, data_section, (uint8_t *) &written));
+	assert(written == op_movw_immediate(r1, 0x0c));
+
+	/* The new symbol reuses the slot of the deleted one, at another
+	 * address. The instruction still refers to the deleted one. */
+	delete_data_symbol(data_section, deleted_id);
+	uint32_t const reused_id =
+		data_section_add(data_section, 16, sizeof(word), NULL, word).id;
+	assert(handle_slot(reused_id) == handle_slot(deleted_id));
+	assert(reused_id != deleted_id);
+
+	assert(!armv7_encode_instruction_resolved(
+		data_section, text_section, inst, 0x10000).found);
+	assert(armv7_frame_gen_machine_code(frame, text_section, data_section, &written) == 0);
+	assert(!armv7_text_section_write_at(text_section, data_section, (uint8_t *) &written));
+	assert(!frame->code.valid);
+	assert(!armv7_text_section_write_at_in_parallel(
+		text_section, data_section, (uint8_t *) &written, 2));
+
+	instruction_arg(inst, 1, arg_data_symbol_address_bottom16, reused_id);
+	assert(armv7_text_section_write_at(text_section, data_section, (uint8_t *) &written));
+	assert(written == op_movw_immediate(r1, 0x10));
+	assert(frame->code.valid);
+}
+
+void test_encodings() {
+	uint32_t const samples[] = {
+		0, 1, 2, 0xe, 0xf, 0x10, 0xfff, 0x1000, 0xffff, 0x12345,
+		0xfffffc, 0x1000000, 0x7fffffff, 0x80000001, 0xfffff000,
+		0xfffffffe, 0xffffffff
+	};
+	unsigned int const n_samples = sizeof(samples) / sizeof(uint32_t);
+
+	for (unsigned int m = 0; m < n_known_instructions; m++)
+		for (unsigned int a = 0; a < n_samples; a++)
+			for (unsigned int b = 0; b < n_samples; b++)
+				for (unsigned int c = 0; c < n_samples; c += 3) {
+					uint32_t const values[MAX_ARGS] =
+						{samples[a], samples[b], samples[c]};
+					assert(
+						armv7_encode_values(m, values) ==
+						op_functions[m](values[0], values[1], values[2])
+					);
+				}
+}
+
+void test_batch_encoding() {
+	/* Enough for the vectorized blocks and a remainder */
+	uint32_t const n = 37;
+	uint32_t values[MAX_ARGS][37];
+	uint32_t batch[37];
+	uint32_t seed = 1;
+	for (uint32_t i = 0; i < n; i++)
+		for (unsigned int a = 0; a < MAX_ARGS; a++) {
+			seed = seed * 1103515245 + 12345;
+			values[a][i] = (int32_t) seed >> (seed & 15);
+		}
+
+	uint32_t const * const columns[MAX_ARGS] =
+		{values[0], values[1], values[2]};
+	for (unsigned int m = 0; m < n_known_instructions; m++) {
+		armv7_encode_values_batch(m, columns, n, batch);
+		for (uint32_t i = 0; i < n; i++) {
+			uint32_t const instruction_values[MAX_ARGS] =
+				{values[0][i], values[1][i], values[2][i]};
+			assert(batch[i] == armv7_encode_values(m, instruction_values));
+		}
+	}
+
+	/* Runs of mnemonics in a frame */
+	struct armv7_text_frame * __restrict const frame =
+		generate_armv7_text_frame(id_generator);
+	assert(frame != NULL);
+	for (uint32_t i = 0; i < 100; i++) {
+		struct instruction_representation * __restrict const inst =
+			assert_add_inst(frame);
+		instruction_mnemonic_id(
+			inst, (i < 40) ? inst_movw_immediate : inst_mov_immediate
+		);
+		instruction_arg(inst, 0, arg_register, i & 0xf);
+		instruction_arg(inst, 1, arg_immediate, (i % 7) * 0x1234 - 0x4000);
+	}
+	uint32_t code[100];
+	armv7_frame_gen_machine_code(frame, NULL, NULL, code);
+	for (uint32_t i = 0; i < 100; i++)
+		assert(code[i] == armv7_encode_instruction(
+			NULL, NULL, armv7_frame_instruction(frame, i), i * 4
+		));
+}
+
+void test_needs_layout() {
+	struct armv7_text_frame * __restrict const frame =
+		generate_armv7_text_frame(id_generator);
+	assert(frame != NULL);
+
+	struct instruction_representation * __restrict const inst =
+		assert_add_inst(frame);
+	instruction_mnemonic_id(inst, inst_bl_address);
+	assert(inst->needs_layout);
+	instruction_arg(inst, 1, arg_address, 0x1000);
+	assert(!inst->needs_layout);
+	assert(inst->mnemonic_id == inst_bl_address);
+
+	/* movw defaults to the lower half of a data symbol address */
+	instruction_mnemonic_id(inst, inst_movw_immediate);
+	assert(inst->needs_layout);
+	instruction_arg(inst, 1, arg_immediate, 7);
+	assert(!inst->needs_layout);
+	instruction_arg(inst, 1, arg_data_symbol_address_bottom16, 0);
+	assert(inst->needs_layout);
+	instruction_arg(inst, 0, arg_register, r3);
+	assert(inst->needs_layout);
+	frame_instruction_arg(frame, 0, 1, arg_immediate, 5);
+	assert(!inst->needs_layout);
+
+	/* Encoded without any section to resolve from */
+	uint32_t code;
+	armv7_frame_gen_machine_code(frame, NULL, NULL, &code);
+	assert(code == op_movw_immediate(r3, 5));
+}
+
 int main() {
 	test_generate_frame();
 	test_frame_addresses_retrieving();
+	test_frame_names();
+	test_references_index();
+	test_text_section_snapshots();
+	test_frames_index();
+	test_frames_pool();
+	test_frame_chunks();
+	test_parallel_write();
+	test_frame_code_cache();
+	test_incremental_layout();
+	test_frame_fixups();
+	test_deleted_data_references();
+	test_encodings();
+	test_batch_encoding();
+	test_needs_layout();
 	return 0;
 }